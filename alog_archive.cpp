@@ -0,0 +1,198 @@
+/*
+ * alog_archive: converts the log files under a log path(the
+ * <path>/<YYYYMMDD>/<prefix>YYYYMMDD_HH[.N].log layout of initLog) or given
+ * files to columnar archives(<file>.alar, see log_archive.h) for the analytics,
+ * a pool of threads converts a file each. with -q it queries archives: the time
+ * and the level columns select the records, and only the blocks of selected
+ * records have their bodies decompressed, none with -c.
+ *
+ * build: g++ -std=c++17 -O2 -I. alog_archive.cpp -lpthread [-DALOG_WITH_ZSTD -lzstd]
+ *        [-DALOG_WITH_ZLIB -lz]
+ * usage: alog_archive [-j threads] [-z zstd|gzip|none] [-o folder] <log path | file>...
+ *        alog_archive -q [-l debg|info|warn|crit] [-f from] [-t to] [-c] <archive>...
+ *        from and to are "YYYY-MM-DD hh:mm:ss[.mmm]", to is inclusive, -l keeps
+ *        the level and above, -c counts only.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log_archive.h"
+
+using namespace anet::log;
+
+static constexpr size_t gOutput_buffer_size = 4 * 1024 * 1024;
+
+// parseTime converts a time argument to its ms, false if it is not a time.
+static bool parseTime(const std::string &arg, const char *ms, int64_t &out) {
+	std::string time = arg.size() == 19 ? arg + ms : arg;
+	if (time.size() != gRecord_time_size || !isRecordTime(time.data(), time.data() + time.size())) {
+		return false;
+	}
+	out = recordMs(time.data());
+	return true;
+}
+
+// logFiles returns the log files of the arguments, a folder takes its *.log files.
+static std::vector<std::string> logFiles(const std::vector<std::string> &args) {
+	std::vector<std::string> paths;
+	for (auto &arg : args) {
+		std::error_code ec;
+		if (!std::filesystem::is_directory(arg, ec)) {
+			paths.push_back(arg);
+			continue;
+		}
+		for (std::filesystem::recursive_directory_iterator it(arg, ec), end; !ec && it != end; it.increment(ec)) {
+			std::string name = it->path().filename().string();
+			if (it->is_regular_file(ec) && name.size() > 4 && name.compare(name.size() - 4, 4, ".log") == 0) {
+				paths.push_back(it->path().string());
+			}
+		}
+	}
+	std::sort(paths.begin(), paths.end());
+	return paths;
+}
+
+static int convert(const std::vector<std::string> &args, unsigned threads, eCompression compression,
+	const std::string &folder) {
+	std::vector<std::string> paths = logFiles(args);
+	std::atomic<size_t> next{ 0 }, failed{ 0 };
+	std::atomic<unsigned long long> records{ 0 }, bytesIn{ 0 }, bytesOut{ 0 };
+	std::mutex mutex;
+	auto worker = [&]() {
+		for (size_t i = next++; i < paths.size(); i = next++) {
+			const std::string &path = paths[i];
+			std::string archive = folder.empty() ? path + gArchive_suffix :
+				(std::filesystem::path(folder) / std::filesystem::path(path).filename()).string() + gArchive_suffix;
+			long long n = archiveLogFile(path, archive, compression);
+			std::error_code ec;
+			if (n < 0) {
+				std::lock_guard<std::mutex> guard(mutex);
+				fprintf(stderr, "alog_archive: can not convert %s\n", path.c_str());
+				++failed;
+				continue;
+			}
+			records += (unsigned long long)n;
+			bytesIn += std::filesystem::file_size(path, ec);
+			bytesOut += std::filesystem::file_size(archive, ec);
+		}
+	};
+	std::vector<std::thread> pool;
+	for (unsigned i = 0; i < threads && i < paths.size(); i++) {
+		pool.emplace_back(worker);
+	}
+	for (auto &th : pool) {
+		th.join();
+	}
+	fprintf(stderr, "alog_archive: %llu records, %zu files, %llu MB to %llu MB(%s, %zu threads)\n",
+		records.load(), paths.size() - failed.load(), bytesIn.load() >> 20, bytesOut.load() >> 20,
+		compression == eCompression::noneCompression ? "none" : compressionSuffix(compression) + 1, pool.size());
+	return failed == 0 && !paths.empty() ? 0 : 1;
+}
+
+static int query(const std::vector<std::string> &archives, int level, int64_t from, int64_t to, bool count) {
+	unsigned mask = 0;
+	for (int l = level; l < 4; l++) {
+		mask |= 1u << l;
+	}
+	// static: the FILE uses it until the exit flush.
+	static char buffer[gOutput_buffer_size];
+	setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+	size_t matches = 0;
+	std::vector<ArchiveRow> rows;
+	std::string text;
+	for (auto &path : archives) {
+		ArchiveReader reader;
+		if (!reader.open(path)) {
+			fprintf(stderr, "alog_archive: %s is not an archive\n", path.c_str());
+			continue;
+		}
+		rows.clear();
+		matches += reader.scan(from, to, mask, [&rows, count](const ArchiveRow &row) {
+			if (!count) {
+				rows.push_back(row);
+			}
+		});
+		for (auto &row : rows) {
+			if (reader.text(row, text)) {
+				fwrite(text.data(), 1, text.size(), stdout);
+			}
+		}
+	}
+	if (count) {
+		printf("%zu\n", matches);
+	}
+	fflush(stdout);
+	return matches > 0 ? 0 : 1;
+}
+
+static void usage() {
+	fprintf(stderr, "usage: alog_archive [-j threads] [-z zstd|gzip|none] [-o folder] <log path | file>...\n"
+		"       alog_archive -q [-l debg|info|warn|crit] [-f from] [-t to] [-c] <archive>...\n");
+}
+
+int main(int argc, char **argv) {
+	unsigned threads = std::thread::hardware_concurrency();
+	eCompression compression = eCompression::zstdCompression;
+	std::string folder;
+	bool queryMode = false, count = false;
+	int level = 0;
+	int64_t from = INT64_MIN, to = INT64_MAX;
+	std::vector<std::string> args;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool value = i + 1 < argc;
+		if (arg == "-j" && value) {
+			threads = unsigned(atoi(argv[++i]));
+		} else if (arg == "-z" && value) {
+			std::string name = argv[++i];
+			compression = name == "gzip" ? eCompression::gzipCompression :
+				name == "none" ? eCompression::noneCompression : eCompression::zstdCompression;
+		} else if (arg == "-o" && value) {
+			folder = argv[++i];
+		} else if (arg == "-q") {
+			queryMode = true;
+		} else if (arg == "-c") {
+			count = true;
+		} else if (arg == "-l" && value) {
+			std::string name = argv[++i];
+			level = -1;
+			for (int l = 0; l < 4; l++) {
+				if (name == gArchiveLevels[l]) {
+					level = l;
+				}
+			}
+			if (level < 0) {
+				usage();
+				return 1;
+			}
+		} else if (arg == "-f" && value) {
+			if (!parseTime(argv[++i], ".000", from)) {
+				usage();
+				return 1;
+			}
+		} else if (arg == "-t" && value) {
+			if (!parseTime(argv[++i], ".999", to)) {
+				usage();
+				return 1;
+			}
+		} else {
+			args.push_back(arg);
+		}
+	}
+	if (args.empty()) {
+		usage();
+		return 1;
+	}
+	if (queryMode) {
+		return query(args, level, from, to, count);
+	}
+	return convert(args, threads > 0 ? threads : 1, resolveCompression(compression), folder);
+}
@@ -0,0 +1,98 @@
+/*
+ * alog_collector: drains the shared memory rings of the producers of a name
+ * (see aLog::enableSharedMemory) into one log, with batched writes, and the
+ * optional size rotation, retention and compression.
+ *
+ * build: g++ -std=c++17 -O2 -I. -I<anet utils> alog_collector.cpp log.cpp -lpthread -lrt
+ * usage: alog_collector <name> <log path> [-p prefix] [-s rotate bytes] [-n max files]
+ *                       [-t max total bytes] [-z zstd|gzip] [-l compression level]
+ */
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include "log.h"
+
+using namespace anet::log;
+
+static std::atomic<bool> gQuit{ false };
+
+static void onQuit(int) {
+	gQuit = true;
+}
+
+static void usage() {
+	fprintf(stderr, "usage: alog_collector <name> <log path> [-p prefix] [-s rotate bytes] "
+		"[-n max files] [-t max total bytes] [-z zstd|gzip] [-l compression level]\n");
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		usage();
+		return 1;
+	}
+	std::string name = argv[1];
+	std::string path = argv[2];
+	std::string prefix = name;
+	RotatePolicy policy;
+	eCompression compression = eCompression::noneCompression;
+	int level = 3;
+	for (int i = 3; i + 1 < argc; i += 2) {
+		const char *opt = argv[i], *value = argv[i + 1];
+		if (strcmp(opt, "-p") == 0) {
+			prefix = value;
+		} else if (strcmp(opt, "-s") == 0) {
+			policy.maxFileSize = strtoull(value, nullptr, 10);
+		} else if (strcmp(opt, "-n") == 0) {
+			policy.maxFiles = size_t(strtoull(value, nullptr, 10));
+		} else if (strcmp(opt, "-t") == 0) {
+			policy.maxTotalSize = strtoull(value, nullptr, 10);
+		} else if (strcmp(opt, "-z") == 0) {
+			compression = strcmp(value, "gzip") == 0 ? eCompression::gzipCompression :
+				eCompression::zstdCompression;
+		} else if (strcmp(opt, "-l") == 0) {
+			level = atoi(value);
+		} else {
+			usage();
+			return 1;
+		}
+	}
+
+	aLog &log = aLog::instance();
+	if (compression != eCompression::noneCompression && !log.enableCompression(compression, level)) {
+		fprintf(stderr, "alog_collector: compression is not built in\n");
+	}
+	if (!log.setLogInfo(path, prefix, gAsyncLogWriteFrequency)) {
+		fprintf(stderr, "alog_collector: can not open the log under %s\n", path.c_str());
+		return 1;
+	}
+	if (policy.maxFileSize > 0 || policy.maxFiles > 0 || policy.maxTotalSize > 0) {
+		log.setRotation(policy);
+	}
+
+	signal(SIGINT, onQuit);
+	signal(SIGTERM, onQuit);
+
+	// the rings are polled, and the poll backs off while they are idle.
+	ShmCollector collector(name);
+	auto output = [&log](const char *batch, size_t len) { log.appendBatch(batch, len); };
+	int idleUs = 0;
+	while (!gQuit) {
+		if (collector.poll(output) > 0) {
+			idleUs = 0;
+			continue;
+		}
+		idleUs = idleUs < 100 ? idleUs + 10 : (idleUs < 2000 ? idleUs * 2 : 2000);
+		std::this_thread::sleep_for(std::chrono::microseconds(idleUs));
+	}
+
+	// the last records.
+	while (collector.poll(output) > 0) {
+	}
+	return 0;
+}
@@ -0,0 +1,503 @@
+/*
+ * alog_grep: searches a literal in the log files under a log path(the
+ * <path>/<YYYYMMDD>/<prefix>YYYYMMDD_HH[.N].log layout of initLog) or in given
+ * files, and prints the matching records(a record with its hex dump lines).
+ *
+ * the files are mapped, narrowed by time with the first and the last record
+ * (and the sidecar time index, see aLog::enableTimeIndex), cut into chunks at
+ * record boundaries and scanned by a pool of threads with an avx2/sse2 search
+ * of the literal's first and last bytes. the level and the time of a match are
+ * read from the fixed "time [level] " prefix of its record. the records are
+ * printed in file order, as the chunks are written in their order.
+ *
+ * build: g++ -std=c++17 -O2 -I. alog_grep.cpp -lpthread
+ * usage: alog_grep [-l debg|info|warn|crit] [-f from] [-t to] [-j threads] [-c]
+ *                  <literal> <log path | file>...
+ *        from and to are "YYYY-MM-DD hh:mm:ss[.mmm]" or "hh:mm:ss[.mmm]"(on the
+ *        date of every file), -l keeps the level and above, -c counts only.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log_index.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ALOG_GREP_X86 1
+#endif
+
+using namespace anet::log;
+
+// bytes of a chunk, and the chunks in flight per thread.
+static constexpr size_t gChunk_size = 8 * 1024 * 1024;
+static constexpr size_t gChunks_ahead = 4;
+static constexpr size_t gOutput_buffer_size = 4 * 1024 * 1024;
+// the records of the two interfaces may be out of time order within it.
+static constexpr int64_t gTime_window = 2;
+// "YYYY-MM-DD hh:mm:ss.mmm [" comes before the level.
+static constexpr size_t gLevel_offset = gRecord_time_size + 2;
+
+static const char *gLevelNames[] = { "debg", "info", "warn", "crit" };
+
+// literal search: the positions where both the first and the last byte of the
+// literal match are compared in full.
+using FindFunc = const char* (*)(const char *p, const char *end, const std::string &literal);
+
+static const char* findScalar(const char *p, const char *end, const std::string &literal) {
+	void *found = memmem(p, size_t(end - p), literal.data(), literal.size());
+	return found != nullptr ? static_cast<const char*>(found) : end;
+}
+
+#if defined(ALOG_GREP_X86)
+static const char* findSse2(const char *p, const char *end, const std::string &literal) {
+	size_t n = literal.size();
+	if (n < 2) {
+		return findScalar(p, end, literal);
+	}
+	const __m128i first = _mm_set1_epi8(literal[0]);
+	const __m128i last = _mm_set1_epi8(literal[n - 1]);
+	for (; end - p >= ptrdiff_t(n - 1 + 16); p += 16) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + n - 1));
+		unsigned mask = unsigned(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+		while (mask != 0) {
+			unsigned bit = unsigned(__builtin_ctz(mask));
+			if (memcmp(p + bit + 1, literal.data() + 1, n - 2) == 0) {
+				return p + bit;
+			}
+			mask &= mask - 1;
+		}
+	}
+	return findScalar(p, end, literal);
+}
+
+__attribute__((target("avx2")))
+static const char* findAvx2(const char *p, const char *end, const std::string &literal) {
+	size_t n = literal.size();
+	if (n < 2) {
+		return findScalar(p, end, literal);
+	}
+	const __m256i first = _mm256_set1_epi8(literal[0]);
+	const __m256i last = _mm256_set1_epi8(literal[n - 1]);
+	for (; end - p >= ptrdiff_t(n - 1 + 32); p += 32) {
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + n - 1));
+		unsigned mask = unsigned(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+		while (mask != 0) {
+			unsigned bit = unsigned(__builtin_ctz(mask));
+			if (memcmp(p + bit + 1, literal.data() + 1, n - 2) == 0) {
+				return p + bit;
+			}
+			mask &= mask - 1;
+		}
+	}
+	return findSse2(p, end, literal);
+}
+#endif
+
+static FindFunc selectFind(const char **name) {
+#if defined(ALOG_GREP_X86)
+	if (__builtin_cpu_supports("avx2")) {
+		*name = "avx2";
+		return findAvx2;
+	}
+	*name = "sse2";
+	return findSse2;
+#else
+	*name = "scalar";
+	return findScalar;
+#endif
+}
+
+// a mapped log file, and its range to scan.
+struct LogFile {
+	std::string path;
+	const char *data{ nullptr };
+	size_t size{ 0 };
+	size_t begin{ 0 };
+	size_t end{ 0 };
+	// the time range on the file's date, empty if there is none.
+	std::string from;
+	std::string to;
+};
+
+// a chunk of a file, and what its scan printed.
+struct Chunk {
+	const LogFile *file;
+	size_t begin;
+	size_t end;
+	std::string output;
+	size_t matches{ 0 };
+	bool done{ false };
+};
+
+struct Options {
+	std::string literal;
+	int level{ 0 };
+	std::string from;
+	std::string to;
+	bool count{ false };
+};
+
+// recordBoundary moves an offset forward to the start of a record.
+static size_t recordBoundary(const LogFile &file, size_t offset) {
+	if (offset == 0 || offset >= file.size) {
+		return offset < file.size ? offset : file.size;
+	}
+	const char *end = file.data + file.size;
+	const char *p = file.data + offset;
+	if (p[-1] == '\n' && recordTime(p, end) != nullptr) {
+		return offset;
+	}
+	const char *eol = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+	if (eol == nullptr) {
+		return file.size;
+	}
+	return size_t(recordEnd(eol, end) - file.data);
+}
+
+// lastRecordTime returns the time of the last record of the file.
+static const char* lastRecordTime(const LogFile &file) {
+	const char *begin = file.data, *p = file.data + file.size;
+	while (p > begin) {
+		// the start of the line before p.
+		const char *line = p - 1;
+		while (line > begin && line[-1] != '\n') {
+			--line;
+		}
+		const char *time = recordTime(line, file.data + file.size);
+		if (time != nullptr) {
+			return time;
+		}
+		p = line;
+	}
+	return nullptr;
+}
+
+// completeTime completes a time argument to "YYYY-MM-DD hh:mm:ss.mmm" with the
+// date and the milliseconds, empty if it is not a time.
+static std::string completeTime(const std::string &arg, const char *date, const char *ms) {
+	std::string time = arg;
+	if (date != nullptr && (time.size() == 8 || time.size() == 12)) {
+		time = std::string(date, 10) + " " + time;
+	}
+	if (time.size() == 19) {
+		time += ms;
+	}
+	if (time.size() != gRecord_time_size || !isRecordTime(time.data(), time.data() + time.size())) {
+		return std::string();
+	}
+	return time;
+}
+
+// narrow sets the range of the file to scan, false if no record is in the time.
+static bool narrow(LogFile &file, const Options &options) {
+	file.begin = 0;
+	file.end = file.size;
+	if (options.from.empty() && options.to.empty()) {
+		return true;
+	}
+	const char *end = file.data + file.size;
+	const char *first = nullptr;
+	for (const char *p = file.data; p < end && first == nullptr; p = recordEnd(p, end)) {
+		first = recordTime(p, end);
+	}
+	const char *last = lastRecordTime(file);
+	if (first == nullptr || last == nullptr) {
+		return false;
+	}
+	file.from = options.from.empty() ? std::string(gRecord_time_size, '0') : completeTime(options.from, first, ".000");
+	file.to = options.to.empty() ? std::string(gRecord_time_size, '9') : completeTime(options.to, first, ".999");
+	if (file.from.empty() || file.to.empty()) {
+		return false;
+	}
+	if (memcmp(first, file.to.data(), gRecord_time_size) > 0 ||
+		timeSecond(last) + gTime_window < timeSecond(file.from.data())) {
+		return false;
+	}
+
+	// the index seeks to the from second, and to the window after the to second.
+	std::vector<TimeIndexEntry> entries;
+	if (!loadTimeIndex(file.path, entries) || entries.empty()) {
+		return true;
+	}
+	auto lower = [](const TimeIndexEntry &entry, int64_t second) { return entry.second < second; };
+	if (!options.from.empty()) {
+		auto it = std::lower_bound(entries.begin(), entries.end(), timeSecond(file.from.data()), lower);
+		file.begin = it != entries.end() ? it->offset : entries.back().offset;
+	}
+	if (!options.to.empty()) {
+		auto it = std::lower_bound(entries.begin(), entries.end(), timeSecond(file.to.data()) + gTime_window + 1, lower);
+		if (it != entries.end()) {
+			file.end = it->offset;
+		}
+	}
+	if (file.begin > file.size || file.end > file.size || file.begin > file.end) {
+		file.begin = 0;
+		file.end = file.size;
+	}
+	return true;
+}
+
+// scan finds the records of the literal in a chunk.
+static void scan(Chunk &chunk, const Options &options, FindFunc find) {
+	const LogFile &file = *chunk.file;
+	const char *begin = file.data + chunk.begin;
+	const char *end = file.data + chunk.end;
+	const char *fileEnd = file.data + file.size;
+	const char *p = begin;
+	while (p < end) {
+		const char *found = find(p, end, options.literal);
+		if (found >= end) {
+			break;
+		}
+
+		// the record of the match: back to the line with a time.
+		const char *record = found;
+		for (;;) {
+			while (record > begin && record[-1] != '\n') {
+				--record;
+			}
+			if (record <= begin || recordTime(record, fileEnd) != nullptr) {
+				break;
+			}
+			--record;
+		}
+		const char *next = recordEnd(found, fileEnd);
+		p = next;
+
+		// the level and the time of its prefix.
+		const char *time = recordTime(record, fileEnd);
+		if (options.level > 0) {
+			if (time != record || size_t(fileEnd - record) < gLevel_offset + 4) {
+				continue;
+			}
+			const char *level = record + gLevel_offset;
+			bool keep = false;
+			for (int i = options.level; i < int(sizeof(gLevelNames) / sizeof(gLevelNames[0])); i++) {
+				keep = keep || memcmp(level, gLevelNames[i], 4) == 0;
+			}
+			if (!keep) {
+				continue;
+			}
+		}
+		if (!file.from.empty()) {
+			if (time == nullptr || memcmp(time, file.from.data(), gRecord_time_size) < 0 ||
+				memcmp(time, file.to.data(), gRecord_time_size) > 0) {
+				continue;
+			}
+		}
+
+		++chunk.matches;
+		if (!options.count) {
+			chunk.output.append(record, size_t(next - record));
+			if (next[-1] != '\n') {
+				chunk.output.push_back('\n');
+			}
+		}
+	}
+}
+
+// orderFiles sorts the files by folder and hour, and the size rotated files
+// (<name>.N.log) by N after <name>.log.
+static void orderFiles(std::vector<std::string> &paths) {
+	auto key = [](const std::string &path) {
+		std::string stem = path.size() > 4 ? path.substr(0, path.size() - 4) : path;
+		long index = 0;
+		size_t dot = stem.rfind('.');
+		if (dot != std::string::npos && dot + 1 < stem.size() &&
+			stem.find_first_not_of("0123456789", dot + 1) == std::string::npos) {
+			index = strtol(stem.c_str() + dot + 1, nullptr, 10);
+			stem.resize(dot);
+		}
+		return std::make_pair(stem, index);
+	};
+	std::sort(paths.begin(), paths.end(), [&key](const std::string &a, const std::string &b) {
+		return key(a) < key(b);
+	});
+}
+
+static void usage() {
+	fprintf(stderr, "usage: alog_grep [-l debg|info|warn|crit] [-f from] [-t to] [-j threads] [-c] "
+		"<literal> <log path | file>...\n");
+}
+
+int main(int argc, char **argv) {
+	Options options;
+	unsigned threads = std::thread::hardware_concurrency();
+	std::vector<std::string> args;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool value = i + 1 < argc;
+		if (arg == "-l" && value) {
+			std::string level = argv[++i];
+			options.level = -1;
+			for (int l = 0; l < int(sizeof(gLevelNames) / sizeof(gLevelNames[0])); l++) {
+				if (level == gLevelNames[l]) {
+					options.level = l;
+				}
+			}
+			if (options.level < 0) {
+				usage();
+				return 1;
+			}
+		} else if (arg == "-f" && value) {
+			options.from = argv[++i];
+		} else if (arg == "-t" && value) {
+			options.to = argv[++i];
+		} else if (arg == "-j" && value) {
+			threads = unsigned(atoi(argv[++i]));
+		} else if (arg == "-c") {
+			options.count = true;
+		} else {
+			args.push_back(arg);
+		}
+	}
+	if (args.size() < 2 || args[0].empty()) {
+		usage();
+		return 1;
+	}
+	options.literal = args[0];
+	threads = threads > 0 ? threads : 1;
+
+	// the log files: a folder takes its *.log files.
+	std::vector<std::string> paths;
+	for (size_t i = 1; i < args.size(); i++) {
+		std::error_code ec;
+		if (!std::filesystem::is_directory(args[i], ec)) {
+			paths.push_back(args[i]);
+			continue;
+		}
+		for (std::filesystem::recursive_directory_iterator it(args[i], ec), end; !ec && it != end; it.increment(ec)) {
+			std::string name = it->path().filename().string();
+			if (it->is_regular_file(ec) && name.size() > 4 && name.compare(name.size() - 4, 4, ".log") == 0) {
+				paths.push_back(it->path().string());
+			}
+		}
+	}
+	orderFiles(paths);
+
+	// map and narrow the files, then cut them into chunks.
+	std::vector<std::unique_ptr<LogFile>> files;
+	std::vector<std::unique_ptr<Chunk>> chunks;
+	for (auto &path : paths) {
+		int fd = ::open(path.c_str(), O_RDONLY);
+		struct stat st;
+		if (fd < 0 || fstat(fd, &st) != 0) {
+			fprintf(stderr, "alog_grep: can not open %s\n", path.c_str());
+			if (fd >= 0) {
+				::close(fd);
+			}
+			continue;
+		}
+		auto file = std::make_unique<LogFile>();
+		file->path = path;
+		file->size = size_t(st.st_size);
+		if (file->size > 0) {
+			void *data = mmap(nullptr, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+			file->data = data != MAP_FAILED ? static_cast<const char*>(data) : nullptr;
+		}
+		::close(fd);
+		if (file->data == nullptr || !narrow(*file, options)) {
+			if (file->data != nullptr) {
+				munmap(const_cast<char*>(file->data), file->size);
+			}
+			continue;
+		}
+		madvise(const_cast<char*>(file->data), file->size, MADV_SEQUENTIAL);
+		size_t begin = recordBoundary(*file, file->begin);
+		while (begin < file->end) {
+			size_t end = begin + gChunk_size < file->end ? recordBoundary(*file, begin + gChunk_size) : file->end;
+			end = end < file->end ? end : file->end;
+			auto chunk = std::make_unique<Chunk>();
+			chunk->file = file.get();
+			chunk->begin = begin;
+			chunk->end = end;
+			chunks.push_back(std::move(chunk));
+			begin = end;
+		}
+		files.push_back(std::move(file));
+	}
+
+	const char *findName = "";
+	FindFunc find = selectFind(&findName);
+
+	// the workers scan the chunks in order, a bounded number ahead of the writer.
+	std::mutex mutex;
+	std::condition_variable scanned, written;
+	size_t nextChunk = 0, writtenChunks = 0;
+	auto worker = [&]() {
+		for (;;) {
+			size_t index;
+			{
+				std::unique_lock<std::mutex> guard(mutex);
+				written.wait(guard, [&]() {
+					return nextChunk >= chunks.size() || nextChunk < writtenChunks + size_t(threads) * gChunks_ahead;
+				});
+				if (nextChunk >= chunks.size()) {
+					return;
+				}
+				index = nextChunk++;
+			}
+			scan(*chunks[index], options, find);
+			{
+				std::lock_guard<std::mutex> guard(mutex);
+				chunks[index]->done = true;
+			}
+			scanned.notify_all();
+		}
+	};
+	std::vector<std::thread> pool;
+	for (unsigned i = 0; i < threads; i++) {
+		pool.emplace_back(worker);
+	}
+
+	// static: the FILE uses it until the exit flush.
+	static char buffer[gOutput_buffer_size];
+	setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+	size_t matches = 0, bytes = 0;
+	for (size_t i = 0; i < chunks.size(); i++) {
+		Chunk &chunk = *chunks[i];
+		{
+			std::unique_lock<std::mutex> guard(mutex);
+			scanned.wait(guard, [&chunk]() { return chunk.done; });
+		}
+		fwrite(chunk.output.data(), 1, chunk.output.size(), stdout);
+		matches += chunk.matches;
+		bytes += chunk.end - chunk.begin;
+		std::string().swap(chunk.output);
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			writtenChunks = i + 1;
+		}
+		written.notify_all();
+	}
+	for (auto &th : pool) {
+		th.join();
+	}
+	if (options.count) {
+		printf("%zu\n", matches);
+	}
+	fflush(stdout);
+
+	for (auto &file : files) {
+		munmap(const_cast<char*>(file->data), file->size);
+	}
+	fprintf(stderr, "alog_grep: %zu records, %zu files, %zu MB scanned(%s, %u threads)\n",
+		matches, files.size(), bytes >> 20, findName, threads);
+	return matches > 0 ? 0 : 1;
+}
@@ -0,0 +1,239 @@
+/*
+ * alog_merge: merges the per-thread shard files(see aLog::enableThreadShards)
+ * into one stream ordered by time. a record is a line which starts with the
+ * time(text, json or logfmt record) and the lines which follow it without a
+ * time(e.g. a hex dump). the shards are mapped, not read, and merged with a
+ * heap of one record per shard, so shards of tens of GB take no more memory
+ * than the page cache gives. records of the same millisecond keep the order of
+ * their shard, and the shards are taken in the order of the arguments. posix only.
+ *
+ * build: g++ -std=c++17 -O2 -I. alog_merge.cpp
+ * usage: alog_merge [-o output] <shard file | folder>...
+ *        (a folder takes its *.t<tid>.log files, recursively)
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log_index.h"
+
+using namespace anet::log;
+
+// output buffer, and the mapped bytes released behind the cursor at once.
+static constexpr size_t gOutput_buffer_size = 4 * 1024 * 1024;
+static constexpr size_t gRelease_size = 64 * 1024 * 1024;
+
+class Shard {
+public:
+	explicit Shard(const std::string &path) : m_path(path) {}
+	~Shard() {
+		if (m_data != nullptr) {
+			munmap(m_data, m_size);
+		}
+	}
+	Shard(const Shard &rhs) = delete;
+	Shard& operator=(const Shard &rhs) = delete;
+
+	bool open() {
+		int fd = ::open(m_path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			::close(fd);
+			return false;
+		}
+		m_size = size_t(st.st_size);
+		if (m_size > 0) {
+			void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data == MAP_FAILED) {
+				::close(fd);
+				return false;
+			}
+			m_data = static_cast<char*>(data);
+			madvise(m_data, m_size, MADV_SEQUENTIAL);
+		}
+		::close(fd);
+		m_cursor = m_data;
+		this->next();
+		return true;
+	}
+
+	// next moves to the next record, false at the end.
+	bool next() {
+		char *end = m_data + m_size;
+		m_begin = m_cursor;
+		if (m_begin == nullptr || m_begin >= end) {
+			return false;
+		}
+		// the head of a shard without a time sorts first.
+		const char *time = recordTime(m_begin, end);
+		m_time = time;
+		m_cursor = const_cast<char*>(recordEnd(m_begin, end));
+
+		// the page cache takes back the merged part.
+		size_t done = size_t(m_begin - m_data);
+		if (done - m_released >= gRelease_size) {
+			size_t page = size_t(sysconf(_SC_PAGESIZE));
+			size_t upto = done / page * page;
+			madvise(m_data + m_released, upto - m_released, MADV_DONTNEED);
+			m_released = upto;
+		}
+		return true;
+	}
+
+	bool done() const {
+		return m_begin == nullptr || m_begin >= m_data + m_size;
+	}
+	const char* time() const {
+		return m_time;
+	}
+	const char* data() const {
+		return m_begin;
+	}
+	size_t size() const {
+		return size_t(m_cursor - m_begin);
+	}
+	const std::string& path() const {
+		return m_path;
+	}
+
+private:
+	std::string m_path;
+	char *m_data{ nullptr };
+	size_t m_size{ 0 };
+	size_t m_released{ 0 };
+	// the current record [m_begin, m_cursor), and its time.
+	char *m_begin{ nullptr };
+	char *m_cursor{ nullptr };
+	const char *m_time{ nullptr };
+};
+
+// isShardFile checks the name as <prefix>YYYYMMDD_HH.t<tid>.log.
+static bool isShardFile(const std::string &name) {
+	static const char suffix[] = ".log";
+	size_t n = name.size();
+	if (n < 8 || name.compare(n - 4, 4, suffix) != 0) {
+		return false;
+	}
+	size_t pos = name.rfind(".t", n - 4);
+	if (pos == std::string::npos || pos + 2 >= n - 4) {
+		return false;
+	}
+	for (size_t i = pos + 2; i < n - 4; i++) {
+		if (name[i] < '0' || name[i] > '9') {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void usage() {
+	fprintf(stderr, "usage: alog_merge [-o output] <shard file | folder>...\n");
+}
+
+int main(int argc, char **argv) {
+	std::string output;
+	std::vector<std::string> paths;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			output = argv[++i];
+			continue;
+		}
+		std::error_code ec;
+		if (!std::filesystem::is_directory(argv[i], ec)) {
+			paths.push_back(argv[i]);
+			continue;
+		}
+		std::vector<std::string> found;
+		for (std::filesystem::recursive_directory_iterator it(argv[i], ec), end; !ec && it != end; it.increment(ec)) {
+			if (it->is_regular_file(ec) && isShardFile(it->path().filename().string())) {
+				found.push_back(it->path().string());
+			}
+		}
+		std::sort(found.begin(), found.end());
+		paths.insert(paths.end(), found.begin(), found.end());
+	}
+	if (paths.empty()) {
+		usage();
+		return 1;
+	}
+
+	std::vector<std::unique_ptr<Shard>> shards;
+	for (auto &path : paths) {
+		auto shard = std::make_unique<Shard>(path);
+		if (!shard->open()) {
+			fprintf(stderr, "alog_merge: can not open %s\n", path.c_str());
+			return 1;
+		}
+		shards.push_back(std::move(shard));
+	}
+
+	FILE *out = output.empty() ? stdout : fopen(output.c_str(), "wb");
+	if (out == nullptr) {
+		fprintf(stderr, "alog_merge: can not create %s\n", output.c_str());
+		return 1;
+	}
+	// static: the FILE uses it until the exit flush.
+	static char buffer[gOutput_buffer_size];
+	setvbuf(out, buffer, _IOFBF, sizeof(buffer));
+
+	// the heap of the shards' current records: the earliest time first, then
+	// the shard order.
+	auto later = [&shards](size_t a, size_t b) {
+		const char *ta = shards[a]->time(), *tb = shards[b]->time();
+		if (ta == nullptr || tb == nullptr) {
+			if (ta != tb) {
+				return tb == nullptr;
+			}
+			return a > b;
+		}
+		int r = memcmp(ta, tb, gRecord_time_size);
+		return r != 0 ? r > 0 : a > b;
+	};
+	std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heap(later);
+	for (size_t i = 0; i < shards.size(); i++) {
+		if (!shards[i]->done()) {
+			heap.push(i);
+		}
+	}
+
+	size_t records = 0;
+	while (!heap.empty()) {
+		size_t index = heap.top();
+		heap.pop();
+		Shard &shard = *shards[index];
+		// a shard keeps the lead for a run of records, which skips the heap.
+		for (;;) {
+			fwrite(shard.data(), 1, shard.size(), out);
+			if (shard.data()[shard.size() - 1] != '\n') {
+				fputc('\n', out);
+			}
+			++records;
+			if (!shard.next()) {
+				break;
+			}
+			if (!heap.empty() && later(index, heap.top())) {
+				heap.push(index);
+				break;
+			}
+		}
+	}
+
+	bool ok = fflush(out) == 0;
+	if (out != stdout) {
+		ok = fclose(out) == 0 && ok;
+	}
+	fprintf(stderr, "alog_merge: %zu records from %zu shards\n", records, shards.size());
+	return ok ? 0 : 1;
+}
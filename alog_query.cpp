@@ -0,0 +1,179 @@
+/*
+ * alog_query: prints the records of a time range of a log file, with the
+ * sidecar time index(see aLog::enableTimeIndex) to seek to the range, so the
+ * cost is the range's, not the file's. the log is mapped and only the pages of
+ * the range are read. without the index the file is scanned from its start.
+ *
+ * the records of the synchronous and the asynchronous interfaces may be written
+ * a little out of time order, so the scan goes on for window seconds after the
+ * range(2 by default, the writer's default frequency is 1 second).
+ *
+ * build: g++ -std=c++17 -O2 -I. alog_query.cpp
+ * usage: alog_query <log file> <from> <to> [-w window seconds] [-o output]
+ *        from and to are "YYYY-MM-DD hh:mm:ss[.mmm]" or "hh:mm:ss[.mmm]"(the
+ *        date of the file's first record), to is inclusive.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log_index.h"
+
+using namespace anet::log;
+
+static constexpr size_t gOutput_buffer_size = 4 * 1024 * 1024;
+
+// normalize completes a time argument to "YYYY-MM-DD hh:mm:ss.mmm", the date
+// and the milliseconds are taken from the defaults. empty if it is not a time.
+static std::string normalize(const std::string &arg, const std::string &date, const char *ms) {
+	std::string time = arg;
+	if (time.size() == 8 || time.size() == 12) {
+		time = date + " " + time;
+	}
+	if (time.size() == 19) {
+		time += ms;
+	}
+	if (!isRecordTime(time.data(), time.data() + time.size()) || time.size() != gRecord_time_size) {
+		return std::string();
+	}
+	return time;
+}
+
+static void usage() {
+	fprintf(stderr, "usage: alog_query <log file> <from> <to> [-w window seconds] [-o output]\n"
+		"       from and to are \"YYYY-MM-DD hh:mm:ss[.mmm]\" or \"hh:mm:ss[.mmm]\"\n");
+}
+
+int main(int argc, char **argv) {
+	if (argc < 4) {
+		usage();
+		return 1;
+	}
+	std::string path = argv[1];
+	int window = 2;
+	std::string output;
+	for (int i = 4; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "-w") == 0) {
+			window = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "-o") == 0) {
+			output = argv[i + 1];
+		} else {
+			usage();
+			return 1;
+		}
+	}
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "alog_query: can not open %s\n", path.c_str());
+		return 1;
+	}
+	size_t size = size_t(st.st_size);
+	if (size == 0) {
+		::close(fd);
+		return 0;
+	}
+	void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED) {
+		fprintf(stderr, "alog_query: can not map %s\n", path.c_str());
+		return 1;
+	}
+	const char *data = static_cast<const char*>(mapped);
+	const char *end = data + size;
+
+	// the date of the first record, for the times without one.
+	std::string date;
+	for (const char *p = data; p < end && date.empty(); p = recordEnd(p, end)) {
+		const char *time = recordTime(p, end);
+		if (time != nullptr) {
+			date.assign(time, 10);
+		}
+	}
+	std::string from = normalize(argv[2], date, ".000");
+	std::string to = normalize(argv[3], date, ".999");
+	if (from.empty() || to.empty()) {
+		usage();
+		return 1;
+	}
+	int64_t stopSecond = timeSecond(to.c_str()) + window;
+
+	// seek: the records before the first entry of the from second are earlier.
+	uint64_t start = 0;
+	std::vector<TimeIndexEntry> entries;
+	if (loadTimeIndex(path, entries)) {
+		int64_t fromSecond = timeSecond(from.c_str());
+		auto it = std::lower_bound(entries.begin(), entries.end(), fromSecond,
+			[](const TimeIndexEntry &entry, int64_t second) { return entry.second < second; });
+		if (it == entries.begin()) {
+			// the head of a file before its index was opened is not indexed.
+			start = 0;
+		} else if (!entries.empty()) {
+			// past the last entry, the records after it are unknown.
+			start = it != entries.end() ? it->offset : entries.back().offset;
+		}
+		if (start > size) {
+			start = 0;
+		}
+	} else {
+		fprintf(stderr, "alog_query: no index of %s, scanning the file\n", path.c_str());
+	}
+	madvise(const_cast<char*>(data) + start / 4096 * 4096, size - start / 4096 * 4096, MADV_SEQUENTIAL);
+
+	FILE *out = output.empty() ? stdout : fopen(output.c_str(), "wb");
+	if (out == nullptr) {
+		fprintf(stderr, "alog_query: can not create %s\n", output.c_str());
+		return 1;
+	}
+	// static: the FILE uses it until the exit flush.
+	static char buffer[gOutput_buffer_size];
+	setvbuf(out, buffer, _IOFBF, sizeof(buffer));
+
+	// the records of the range, written in runs.
+	size_t records = 0;
+	const char *runBegin = nullptr, *runEnd = nullptr;
+	const char *p = data + start;
+	while (p < end) {
+		const char *next = recordEnd(p, end);
+		const char *time = recordTime(p, end);
+		if (time != nullptr) {
+			if (memcmp(time, from.data(), gRecord_time_size) >= 0 &&
+				memcmp(time, to.data(), gRecord_time_size) <= 0) {
+				if (runEnd != p) {
+					if (runBegin != nullptr) {
+						fwrite(runBegin, 1, size_t(runEnd - runBegin), out);
+					}
+					runBegin = p;
+				}
+				runEnd = next;
+				++records;
+			} else if (timeSecond(time) > stopSecond) {
+				break;
+			}
+		}
+		p = next;
+	}
+	if (runBegin != nullptr) {
+		fwrite(runBegin, 1, size_t(runEnd - runBegin), out);
+		if (runEnd[-1] != '\n') {
+			fputc('\n', out);
+		}
+	}
+
+	bool ok = fflush(out) == 0;
+	if (out != stdout) {
+		ok = fclose(out) == 0 && ok;
+	}
+	munmap(mapped, size);
+	fprintf(stderr, "alog_query: %zu records, %zu of %zu bytes scanned\n",
+		records, size_t(p - data - start), size);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,296 @@
+/*
+ * alog_bench: the benchmark suite of the log. every case logs a number of
+ * messages from N threads and reports the throughput(messages and payload MB
+ * per second, until the log is released, so the asynchronous drain counts) and
+ * the latency of the calls(p50/p99/p99.9/max and a log2 histogram in ns):
+ *
+ *  - synchronous and asynchronous calls,
+ *  - printf style Debug and {} style debug,
+ *  - 1 to 64 threads, payloads of 16 B to 4 KiB,
+ *  - the log file on tmpfs, and a null sink with the file level above the
+ *    records(the formatting and the hand-off without the file),
+ *  - calls below the log level.
+ *
+ * the results are written as json(to stdout or --json <file>) for the trend
+ * tracking, and a summary line per case goes to stderr.
+ *
+ * build: the alog_bench target of CMakeLists.txt, or
+ *        g++ -std=c++17 -O2 -I.. -I<anet utils> alog_bench.cpp ../log.cpp -lpthread
+ * usage: alog_bench [--json file] [--path tmpfs folder] [--threads 1,2,4] [--sizes 16,256]
+ *                   [--count messages per case] [--quick]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log.h"
+
+using namespace anet::log;
+
+// payload bytes a case logs at most, which bounds the asynchronous queue.
+static constexpr size_t gCase_max_bytes = 256 * 1024 * 1024;
+// log2 buckets of the latency histogram, up to ~1 s.
+static constexpr int gHistogram_buckets = 31;
+
+enum class eTarget { tmpfsTarget, nullTarget };
+enum class eStyle { printfStyle, braceStyle };
+
+struct Case {
+	eTarget target;
+	bool async;
+	eStyle style;
+	int threads;
+	size_t size;
+	bool disabled;
+};
+
+struct Result {
+	Case c;
+	size_t messages;
+	double seconds;
+	double callSeconds;
+	long long p50, p99, p999, max;
+	std::vector<size_t> histogram;
+};
+
+struct Config {
+	std::string path{ "/dev/shm/alog_bench" };
+	std::vector<int> threads{ 1, 2, 4, 8, 16, 32, 64 };
+	std::vector<size_t> sizes{ 16, 64, 256, 1024, 4096 };
+	size_t count{ 200000 };
+	std::string json;
+};
+
+static const char* targetName(eTarget target) {
+	return target == eTarget::tmpfsTarget ? "tmpfs" : "null";
+}
+static const char* styleName(eStyle style) {
+	return style == eStyle::printfStyle ? "printf" : "brace";
+}
+
+static int bucketOf(long long ns) {
+	int bucket = 0;
+	while (bucket + 1 < gHistogram_buckets && (1LL << (bucket + 1)) <= ns) {
+		++bucket;
+	}
+	return bucket;
+}
+
+// call logs one message in the case's way.
+static inline void call(aLog &log, const Case &c, const char *payload) {
+	if (c.style == eStyle::printfStyle) {
+		if (c.async) {
+			log.ADebug("%s", payload);
+		} else {
+			log.Debug("%s", payload);
+		}
+	} else {
+		if (c.async) {
+			log.Adebug("{}", payload);
+		} else {
+			log.debug("{}", payload);
+		}
+	}
+}
+
+static Result run(const Config &config, const Case &c) {
+	Result result;
+	result.c = c;
+	size_t messages = config.count;
+	if (messages * c.size > gCase_max_bytes) {
+		messages = gCase_max_bytes / c.size;
+	}
+	size_t perThread = (messages + size_t(c.threads) - 1) / size_t(c.threads);
+	result.messages = perThread * size_t(c.threads);
+
+	std::string payload(c.size, 'x');
+	for (size_t i = 0; i < c.size; i += 10) {
+		payload[i] = char('a' + i / 10 % 26);
+	}
+	std::vector<std::vector<long long>> samples(size_t(c.threads));
+	std::string dir = config.path + "/case";
+	std::error_code ec;
+	std::filesystem::remove_all(dir, ec);
+	std::filesystem::create_directories(dir, ec);
+
+	auto begin = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point called;
+	{
+		aLog log(dir, "bench", 10);
+		if (c.disabled) {
+			log.setLevel(int(eLogLevel::critLevel));
+		} else if (c.target == eTarget::nullTarget) {
+			log.setLevel(int(eLogLevel::critLevel));
+			log.addSink(std::make_shared<CallbackSink>([](eLogLevel, const char*, size_t) {}));
+		}
+
+		std::atomic<int> ready{ 0 };
+		std::vector<std::thread> producers;
+		for (int t = 0; t < c.threads; t++) {
+			producers.emplace_back([&, t]() {
+				auto &own = samples[size_t(t)];
+				own.reserve(perThread);
+				++ready;
+				while (ready.load() < c.threads) {
+					std::this_thread::yield();
+				}
+				for (size_t i = 0; i < perThread; i++) {
+					auto start = std::chrono::steady_clock::now();
+					call(log, c, payload.c_str());
+					auto stop = std::chrono::steady_clock::now();
+					own.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+				}
+			});
+		}
+		for (auto &th : producers) {
+			th.join();
+		}
+		called = std::chrono::steady_clock::now();
+	}
+	auto end = std::chrono::steady_clock::now();
+	std::filesystem::remove_all(dir, ec);
+	result.seconds = std::chrono::duration<double>(end - begin).count();
+	result.callSeconds = std::chrono::duration<double>(called - begin).count();
+
+	std::vector<long long> all;
+	all.reserve(result.messages);
+	for (auto &own : samples) {
+		all.insert(all.end(), own.begin(), own.end());
+	}
+	std::sort(all.begin(), all.end());
+	auto at = [&all](double q) { return all[size_t(q * double(all.size() - 1))]; };
+	result.p50 = at(0.5);
+	result.p99 = at(0.99);
+	result.p999 = at(0.999);
+	result.max = all.back();
+	result.histogram.assign(gHistogram_buckets, 0);
+	for (long long ns : all) {
+		++result.histogram[size_t(bucketOf(ns))];
+	}
+	return result;
+}
+
+static void writeJson(FILE *out, const std::vector<Result> &results) {
+	fprintf(out, "{\n  \"suite\": \"alog_bench\",\n  \"version\": 1,\n  \"timestamp\": %lld,\n"
+		"  \"hardware_threads\": %u,\n  \"results\": [\n",
+		(long long)time(nullptr), std::thread::hardware_concurrency());
+	for (size_t i = 0; i < results.size(); i++) {
+		const Result &r = results[i];
+		double payload = double(r.messages) * double(r.c.size);
+		fprintf(out, "    {\"target\": \"%s\", \"mode\": \"%s\", \"style\": \"%s\", \"disabled\": %s, "
+			"\"threads\": %d, \"size\": %zu, \"messages\": %zu, \"seconds\": %.6f, \"call_seconds\": %.6f, "
+			"\"msgs_per_s\": %.0f, \"mb_per_s\": %.2f, "
+			"\"latency_ns\": {\"p50\": %lld, \"p99\": %lld, \"p999\": %lld, \"max\": %lld}, \"histogram_ns\": [",
+			targetName(r.c.target), r.c.async ? "async" : "sync", styleName(r.c.style),
+			r.c.disabled ? "true" : "false", r.c.threads, r.c.size, r.messages, r.seconds, r.callSeconds,
+			double(r.messages) / r.seconds, payload / r.seconds / 1e6, r.p50, r.p99, r.p999, r.max);
+		// the non-empty buckets as [upper bound, count].
+		bool first = true;
+		for (int b = 0; b < gHistogram_buckets; b++) {
+			if (r.histogram[size_t(b)] > 0) {
+				fprintf(out, "%s[%lld, %zu]", first ? "" : ", ", 1LL << (b + 1), r.histogram[size_t(b)]);
+				first = false;
+			}
+		}
+		fprintf(out, "]}%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+}
+
+template <typename T>
+static std::vector<T> parseList(const char *arg) {
+	std::vector<T> values;
+	for (const char *p = arg; *p != 0;) {
+		values.push_back(T(strtoull(p, nullptr, 10)));
+		const char *comma = strchr(p, ',');
+		if (comma == nullptr) {
+			break;
+		}
+		p = comma + 1;
+	}
+	return values;
+}
+
+int main(int argc, char **argv) {
+	Config config;
+	for (int i = 1; i < argc; i++) {
+		bool value = i + 1 < argc;
+		if (strcmp(argv[i], "--json") == 0 && value) {
+			config.json = argv[++i];
+		} else if (strcmp(argv[i], "--path") == 0 && value) {
+			config.path = argv[++i];
+		} else if (strcmp(argv[i], "--threads") == 0 && value) {
+			config.threads = parseList<int>(argv[++i]);
+		} else if (strcmp(argv[i], "--sizes") == 0 && value) {
+			config.sizes = parseList<size_t>(argv[++i]);
+		} else if (strcmp(argv[i], "--count") == 0 && value) {
+			config.count = size_t(strtoull(argv[++i], nullptr, 10));
+		} else if (strcmp(argv[i], "--quick") == 0) {
+			config.threads = { 1, 4 };
+			config.sizes = { 16, 256, 4096 };
+			config.count = 50000;
+		} else {
+			fprintf(stderr, "usage: alog_bench [--json file] [--path tmpfs folder] [--threads 1,2,4] "
+				"[--sizes 16,256] [--count messages per case] [--quick]\n");
+			return 1;
+		}
+	}
+	if (config.threads.empty() || config.sizes.empty() || config.count == 0) {
+		fprintf(stderr, "alog_bench: nothing to run\n");
+		return 1;
+	}
+	std::error_code ec;
+	std::filesystem::create_directories(config.path, ec);
+
+	// the matrix, and the calls below the level with the fewest and most threads.
+	std::vector<Case> cases;
+	for (eTarget target : { eTarget::tmpfsTarget, eTarget::nullTarget }) {
+		for (bool async : { false, true }) {
+			for (eStyle style : { eStyle::printfStyle, eStyle::braceStyle }) {
+				for (int threads : config.threads) {
+					for (size_t size : config.sizes) {
+						cases.push_back({ target, async, style, threads, size, false });
+					}
+				}
+			}
+		}
+	}
+	for (eStyle style : { eStyle::printfStyle, eStyle::braceStyle }) {
+		for (int threads : { config.threads.front(), config.threads.back() }) {
+			cases.push_back({ eTarget::tmpfsTarget, false, style, threads, config.sizes.front(), true });
+			if (config.threads.front() == config.threads.back()) {
+				break;
+			}
+		}
+	}
+
+	std::vector<Result> results;
+	for (const Case &c : cases) {
+		results.push_back(run(config, c));
+		const Result &r = results.back();
+		fprintf(stderr, "%-5s %-5s %-6s %-8s %2d threads %5zu B  %9.0f msgs/s %8.1f MB/s  "
+			"p50 %6lld  p99 %7lld  p99.9 %8lld  max %9lld ns\n",
+			targetName(c.target), c.async ? "async" : "sync", styleName(c.style), c.disabled ? "disabled" : "",
+			c.threads, c.size, double(r.messages) / r.seconds, double(r.messages) * double(c.size) / r.seconds / 1e6,
+			r.p50, r.p99, r.p999, r.max);
+	}
+
+	FILE *out = config.json.empty() ? stdout : fopen(config.json.c_str(), "w");
+	if (out == nullptr) {
+		fprintf(stderr, "alog_bench: can not create %s\n", config.json.c_str());
+		return 1;
+	}
+	writeJson(out, results);
+	if (out != stdout) {
+		fclose(out);
+	}
+	return 0;
+}
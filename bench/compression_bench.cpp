@@ -0,0 +1,84 @@
+/*
+ * compression benchmark: bytes written and CPU ms per MB of log lines, cut into
+ * independent frames as the compress stage does, for zstd and gzip at several
+ * levels and frame sizes.
+ *
+ * build: g++ -std=c++17 -O2 -I.. -DALOG_WITH_ZSTD -DALOG_WITH_ZLIB compression_bench.cpp -lzstd -lz
+ *        (drop the codec which is not installed)
+ * usage: compression_bench [MB of lines, default 64]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <vector>
+#include "log_compress.h"
+
+using namespace anet::log;
+
+// log like lines: time, level, source, a few varying fields.
+static std::string buildLines(size_t size) {
+	static const char *levels[] = { "debg", "info", "warn", "crit" };
+	static const char *words[] = { "login", "logout", "query", "update", "timeout", "retry" };
+	std::string lines;
+	lines.reserve(size + 256);
+	unsigned seed = 12345;
+	long long ms = 0;
+	char line[256];
+	while (lines.size() < size) {
+		seed = seed * 1103515245 + 12345;
+		ms += seed % 7;
+		int n = std::snprintf(line, sizeof(line),
+			"2026-10-18 12:%02lld:%02lld.%03lld [%s] server.cpp handle:%u %s uid=%u cost=%u.%02ums\n",
+			(ms / 60000) % 60, (ms / 1000) % 60, ms % 1000, levels[(seed >> 8) % 4], 100 + (seed >> 12) % 400,
+			words[(seed >> 4) % 6], (seed >> 3) % 100000, (seed >> 5) % 50, (seed >> 7) % 100);
+		lines.append(line, size_t(n));
+	}
+	return lines;
+}
+
+static void run(const std::string &lines, eCompression compression, int level, size_t frameSize) {
+	std::string out;
+	size_t written = 0;
+	std::clock_t begin = std::clock();
+	for (size_t pos = 0; pos < lines.size(); pos += frameSize) {
+		size_t len = lines.size() - pos < frameSize ? lines.size() - pos : frameSize;
+		if (!compressFrame(compression, level, lines.data() + pos, len, out)) {
+			printf("compress failed\n");
+			return;
+		}
+		written += out.size();
+	}
+	double cpuMs = double(std::clock() - begin) * 1000.0 / CLOCKS_PER_SEC;
+	double mb = double(lines.size()) / (1024.0 * 1024.0);
+	printf("%-5s level %2d frame %4zu KiB: %10zu bytes(%5.2f%%) %8.2f cpu ms/MB\n",
+		compressionSuffix(compression) + 1, level, frameSize / 1024, written,
+		100.0 * double(written) / double(lines.size()), cpuMs / mb);
+}
+
+int main(int argc, char **argv) {
+	size_t mb = argc > 1 ? size_t(atoi(argv[1])) : 64;
+	std::string lines = buildLines(mb * 1024 * 1024);
+	printf("%zu bytes of lines\n", lines.size());
+
+	struct Case {
+		eCompression compression;
+		std::vector<int> levels;
+	};
+	const Case cases[] = {
+		{ eCompression::zstdCompression, { 1, 3, 6, 9, 19 } },
+		{ eCompression::gzipCompression, { 1, 6, 9 } },
+	};
+	for (auto &c : cases) {
+		if (!compressionSupported(c.compression)) {
+			continue;
+		}
+		for (size_t frameSize : { size_t(64 * 1024), gCompress_frame_size, size_t(1024 * 1024) }) {
+			for (int level : c.levels) {
+				run(lines, c.compression, level, frameSize);
+			}
+		}
+	}
+	return 0;
+}
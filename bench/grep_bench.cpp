@@ -0,0 +1,107 @@
+/*
+ * grep benchmark: alog_grep against grep -F on a day of hourly log files in the
+ * initLog layout, with a rare and a common literal, single threaded and with
+ * all threads, and with an hour and a level, which alog_grep narrows before
+ * the search. the files are read once before, so both run from the page cache,
+ * and the counts of both are checked to be equal.
+ *
+ * build: g++ -std=c++17 -O2 -I.. grep_bench.cpp
+ * usage: grep_bench [alog_grep binary, default ../alog_grep] [MB per hour, default 64]
+ *                   [log path, default /dev/shm/alog_grep_bench]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+static constexpr int gHours = 24;
+
+// generate writes the hourly files of a day, with a request id in every line
+// and an error in every 10000th.
+static void generate(const std::string &path, size_t bytesPerHour) {
+	static const char *levels[] = { "debg", "info", "info", "info", "warn" };
+	std::error_code ec;
+	std::filesystem::create_directories(path + "/20261018", ec);
+	size_t record = 0;
+	for (int hour = 0; hour < gHours; hour++) {
+		char name[256];
+		std::snprintf(name, sizeof(name), "%s/20261018/bench20261018_%02d.log", path.c_str(), hour);
+		FILE *file = fopen(name, "wb");
+		size_t written = 0;
+		while (written < bytesPerHour) {
+			char line[256];
+			int ms = int(record % 3600000);
+			bool error = record % 10000 == 0;
+			int n = std::snprintf(line, sizeof(line),
+				"2026-10-18 %02d:%02d:%02d.%03d [%s] handler.cpp onRequest:%d request %zu from user %zu took %zu us%s\n",
+				hour, ms / 60000, ms / 1000 % 60, ms % 1000, error ? "crit" : levels[record % 5],
+				100 + int(record % 50), record, record % 7919, record % 997,
+				error ? " upstream timeout" : "");
+			fwrite(line, 1, size_t(n), file);
+			written += size_t(n);
+			record += 37;
+		}
+		fclose(file);
+	}
+}
+
+// run runs a command twice, returns the better time and the count it printed.
+static double run(const std::string &command, long &count) {
+	double best = 1e9;
+	for (int i = 0; i < 2; i++) {
+		auto begin = std::chrono::steady_clock::now();
+		FILE *pipe = popen(command.c_str(), "r");
+		if (pipe == nullptr || fscanf(pipe, "%ld", &count) != 1) {
+			count = -1;
+		}
+		if (pipe != nullptr) {
+			pclose(pipe);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		best = seconds < best ? seconds : best;
+	}
+	return best;
+}
+
+int main(int argc, char **argv) {
+	std::string tool = argc > 1 ? argv[1] : "../alog_grep";
+	size_t mb = argc > 2 ? size_t(atoi(argv[2])) : 64;
+	std::string path = argc > 3 ? argv[3] : "/dev/shm/alog_grep_bench";
+	std::error_code ec;
+	std::filesystem::remove_all(path, ec);
+	generate(path, mb << 20);
+	std::string files = path + "/20261018/*.log";
+	// into the page cache.
+	system(("cat " + files + " > /dev/null").c_str());
+
+	struct Case {
+		const char *name;
+		const char *literal;
+	};
+	const Case cases[] = { { "rare", "upstream timeout" }, { "common", "from user 7" } };
+	double total = double(mb) * gHours;
+	printf("%zu MB in %d files\n", size_t(total), gHours);
+	for (auto &c : cases) {
+		long grepCount = 0, oneCount = 0, allCount = 0;
+		// the matching lines of both are counted by wc.
+		double grep = run(std::string("grep -h -F '") + c.literal + "' " + files + " | wc -l", grepCount);
+		double one = run(tool + " -j 1 '" + c.literal + "' " + path + " 2>/dev/null | wc -l", oneCount);
+		double all = run(tool + " '" + c.literal + "' " + path + " 2>/dev/null | wc -l", allCount);
+		printf("%-7s grep -F %7.0f MB/s  alog_grep -j1 %7.0f MB/s(%.1fx)  alog_grep %7.0f MB/s(%.1fx)  %s\n",
+			c.name, total / grep, total / one, grep / one, total / all, grep / all,
+			grepCount == oneCount && grepCount == allCount ? "same counts" : "COUNTS DIFFER");
+	}
+
+	// an hour of crit records, which grep can only filter after the search.
+	long grepCount = 0, narrowCount = 0;
+	double grep = run(std::string("grep -h -F 'upstream timeout' ") + files +
+		" | grep '^2026-10-18 14:' | grep -F ' [crit] ' | wc -l", grepCount);
+	double narrow = run(tool + " -l crit -f 14:00:00 -t 14:59:59 'upstream timeout' " + path +
+		" 2>/dev/null | wc -l", narrowCount);
+	printf("hour    grep -F %7.0f MB/s  alog_grep -l crit -f -t %7.0f MB/s(%.1fx)  %s\n",
+		total / grep, total / narrow, grep / narrow, grepCount == narrowCount ? "same counts" : "COUNTS DIFFER");
+	return 0;
+}
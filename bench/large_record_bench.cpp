@@ -0,0 +1,81 @@
+/*
+ * large record benchmark: ns per call and ns per byte of the printf style
+ * Debug/ADebug for message sizes from 16 bytes to 1 MiB. messages under
+ * 256 bytes stay on the stack path, larger ones should cost linearly.
+ * the former Debug(two buffers formatting, date check, fputs and fflush) is
+ * measured for the small sizes.
+ *
+ * build: g++ -std=c++17 -O2 -I.. -I<anet utils> large_record_bench.cpp ../log.cpp -lpthread
+ * usage: large_record_bench [log path, default /dev/shm/alog_bench]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include "log.h"
+
+using namespace anet::log;
+
+// keep the result alive.
+static volatile int gSink = 0;
+
+// the former Debug: message and line in two stack buffers, then written.
+static FILE *gLegacyFile = nullptr;
+static void legacyDebug(const char *fmt, ...) {
+	char timeInfo[128];
+	buildCurrentTime(timeInfo);
+
+	char myPrintfBuf[gLog_data_size];
+	va_list args;
+	va_start(args, fmt);
+	int n = std::vsnprintf(myPrintfBuf, gLog_data_size - 1, fmt, args);
+	va_end(args);
+	if (n < 0) return;
+	if (n > gLog_data_size - 2) n = gLog_data_size - 2;
+	myPrintfBuf[n] = '\n';
+	myPrintfBuf[n + 1] = 0;
+
+	char allBuff[gLog_max_size];
+	gSink += std::snprintf(allBuff, sizeof(allBuff), gLog_out_format, timeInfo, "debg", myPrintfBuf);
+
+	// the date check and the file output.
+	auto s = getTimeInfo().first;
+	gSink += localtime(&s)->tm_hour;
+	fputs(allBuff, gLegacyFile);
+	fflush(gLegacyFile);
+}
+
+template <typename Func>
+static void runCase(const char *name, size_t size, int loops, Func &&func) {
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < loops; i++) {
+		func();
+	}
+	auto end = std::chrono::steady_clock::now();
+	double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()) / loops;
+	std::printf("%-16s %9zu B %12.1f ns/call %8.3f ns/B\n", name, size, ns, ns / double(size));
+}
+
+int main(int argc, char *argv[]) {
+	const char *path = argc > 1 ? argv[1] : "/dev/shm/alog_bench";
+	aLog log(path, "large", 10);
+	std::string legacyFile = std::string(path) + "/legacy.log";
+	gLegacyFile = fopen(legacyFile.c_str(), "a");
+	if (gLegacyFile == nullptr) {
+		std::printf("open %s fail\n", legacyFile.c_str());
+		return 1;
+	}
+
+	const size_t sizes[] = { 16, 64, 128, 255, 1024, 4096, 65536, 1 << 20 };
+	for (size_t size : sizes) {
+		std::string msg(size, 'x');
+		int loops = size <= 4096 ? 100000 : int((64u << 20) / size);
+		if (size < 256) {
+			runCase("legacy Debug", size, loops, [&]() { legacyDebug("%s", msg.c_str()); });
+		}
+		runCase("Debug", size, loops, [&]() { log.Debug("%s", msg.c_str()); });
+		runCase("ADebug", size, loops, [&]() { log.ADebug("%s", msg.c_str()); });
+	}
+	fclose(gLegacyFile);
+	return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * lazy argument benchmark: ns per debug call whose argument is an expensive
+ * dump of a state, passed evaluated against passed as a lambda(see lazy in
+ * format_spec.h). when the debug level is filtered out the lambda is never
+ * invoked, when the records are built(a null sink takes every level) both
+ * cost the dump and the formatting.
+ *
+ * build: g++ -std=c++17 -O2 -I.. -I<anet utils> lazy_arg_bench.cpp ../log.cpp -lpthread
+ * usage: lazy_arg_bench [calls, default 1000000] [log path, default /dev/shm/alog_lazy_arg_bench]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "log.h"
+
+using namespace anet::log;
+
+struct State {
+	std::vector<int> slots;
+	std::string name{ "room-0042" };
+
+	// dumpState renders the state, the kind of argument a debug line asks for.
+	std::string dumpState() const {
+		std::string out = name;
+		for (size_t i = 0; i < slots.size(); i++) {
+			out += ' ';
+			out += std::to_string(i);
+			out += '=';
+			out += std::to_string(slots[i]);
+		}
+		return out;
+	}
+};
+
+template <typename Fn>
+static double measure(int count, Fn &&fn) {
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; i++) {
+		fn(i);
+	}
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(end - begin).count() / count;
+}
+
+int main(int argc, char **argv) {
+	int count = argc > 1 ? atoi(argv[1]) : 1000000;
+	std::string path = argc > 2 ? argv[2] : "/dev/shm/alog_lazy_arg_bench";
+	std::error_code ec;
+	std::filesystem::remove_all(path, ec);
+	std::filesystem::create_directories(path, ec);
+
+	State state;
+	state.slots.assign(16, 7);
+	{
+		aLog log(path, "bench", 10);
+		log.setLevel(int(eLogLevel::infoLevel));
+		auto eager = [&](int i) { log.Adebug("move {} state {}", i, state.dumpState()); };
+		auto deferred = [&](int i) { log.Adebug("move {} state {}", i, [&state]() { return state.dumpState(); }); };
+
+		// the debug records are filtered out by the level.
+		double eagerFiltered = measure(count, eager);
+		double lazyFiltered = measure(count, deferred);
+
+		// the debug records are built, for a null sink.
+		log.setLevel(int(eLogLevel::critLevel));
+		log.addSink(std::make_shared<CallbackSink>([](eLogLevel, const char*, size_t) {}));
+		double eagerBuilt = measure(count, eager);
+		double lazyBuilt = measure(count, deferred);
+
+		printf("filtered: evaluated %.1f ns/call  lazy %.1f ns/call(%.1fx)\n",
+			eagerFiltered, lazyFiltered, eagerFiltered / lazyFiltered);
+		printf("built:    evaluated %.1f ns/call  lazy %.1f ns/call\n", eagerBuilt, lazyBuilt);
+	}
+	std::filesystem::remove_all(path, ec);
+	return 0;
+}
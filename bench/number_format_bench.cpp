@@ -0,0 +1,83 @@
+/*
+ * number formatting micro benchmark: ints, doubles and pointers rendered by
+ * the stream kernels against std::to_string and snprintf.
+ *
+ * build: g++ -std=c++17 -O2 -I.. number_format_bench.cpp -o number_format_bench
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "stream_string.h"
+
+// keep the result alive.
+static volatile int gSink = 0;
+
+template <typename Func>
+static void runCase(const char *name, int loops, Func &&func) {
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < loops; i++) {
+		gSink += func(i);
+	}
+	auto end = std::chrono::steady_clock::now();
+	double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+	std::printf("%-32s %8.2f ns/op\n", name, ns / loops);
+}
+
+int main(int argc, char *argv[]) {
+	int loops = argc > 1 ? atoi(argv[1]) : 2000000;
+
+	// inputs, a power of 2 size for cheap indexing.
+	const int inputSize = 1024;
+	std::vector<int> smallInts(inputSize);
+	std::vector<long long> largeInts(inputSize);
+	std::vector<double> doubles(inputSize);
+	std::vector<void*> pointers(inputSize);
+	srand(1);
+	for (int i = 0; i < inputSize; i++) {
+		smallInts[i] = rand() % 1000 - 500;
+		largeInts[i] = (long long)rand() * rand() * 1000003LL;
+		doubles[i] = double(rand()) / 7.0;
+		pointers[i] = &smallInts[i];
+	}
+
+	char buf[SStreamSpace::number_max_size];
+	runCase("int std::to_string", loops, [&](int i) {
+		return int(std::to_string(smallInts[i & (inputSize - 1)]).size());
+	});
+	runCase("int formatNumber", loops, [&](int i) {
+		return SStreamSpace::formatNumber(buf, smallInts[i & (inputSize - 1)]);
+	});
+	runCase("int64 std::to_string", loops, [&](int i) {
+		return int(std::to_string(largeInts[i & (inputSize - 1)]).size());
+	});
+	runCase("int64 formatNumber", loops, [&](int i) {
+		return SStreamSpace::formatNumber(buf, largeInts[i & (inputSize - 1)]);
+	});
+	runCase("double std::to_string(%f)", loops, [&](int i) {
+		return int(std::to_string(doubles[i & (inputSize - 1)]).size());
+	});
+	runCase("double snprintf(%.17g)", loops, [&](int i) {
+		return std::snprintf(buf, sizeof(buf), "%.17g", doubles[i & (inputSize - 1)]);
+	});
+	runCase("double formatNumber", loops, [&](int i) {
+		return SStreamSpace::formatNumber(buf, doubles[i & (inputSize - 1)]);
+	});
+	runCase("pointer snprintf(%p)", loops, [&](int i) {
+		return std::snprintf(buf, sizeof(buf), "%p", pointers[i & (inputSize - 1)]);
+	});
+	runCase("pointer formatPointer", loops, [&](int i) {
+		return SStreamSpace::formatPointer(buf, pointers[i & (inputSize - 1)]);
+	});
+
+	// through the stream operator.
+	runCase("StreamStringUnlimit << mixed", loops / 4, [&](int i) {
+		SStreamSpace::StreamStringUnlimit<256> ss;
+		ss << smallInts[i & (inputSize - 1)] << " " << largeInts[i & (inputSize - 1)]
+			<< " " << doubles[i & (inputSize - 1)] << " " << pointers[i & (inputSize - 1)];
+		return ss.len();
+	});
+	return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * placement benchmark: the producers' tail latency against where the writer
+ * thread runs. the cpus are split into two nodes, the real numa nodes if there
+ * are two, or the halves of the cpus otherwise(an emulated topology). the
+ * producers are pinned to the first node, one per cpu, and each iteration does
+ * some work and an asynchronous log call; the writer runs
+ *
+ *  - anywhere(the default),
+ *  - on the producers' cpus(the writer landing on the isolated cores),
+ *  - on the producers' cpus with SCHED_IDLE and nice 19,
+ *  - on the other node.
+ *
+ * build: g++ -std=c++17 -O2 -I.. -I<anet utils> placement_bench.cpp ../log.cpp -lpthread
+ * usage: placement_bench [iterations per producer, default 200000]
+ *                        [log path, default /dev/shm/alog_placement_bench]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log.h"
+
+using namespace anet::log;
+
+struct Case {
+	const char *name;
+	ThreadPlacement writer;
+};
+
+// work spins about ns, the producer's job besides the logging.
+static void work(long long ns) {
+	auto end = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+	while (std::chrono::steady_clock::now() < end) {
+	}
+}
+
+static void run(const Case &c, const std::vector<int> &producerCpus, const std::string &dir, int iterations) {
+	setLogThreadPlacement(c.writer);
+	std::vector<std::vector<long long>> samples(producerCpus.size());
+	{
+		aLog log(dir, "bench", 10);
+		std::atomic<size_t> ready{ 0 };
+		std::vector<std::thread> producers;
+		for (size_t p = 0; p < producerCpus.size(); p++) {
+			producers.emplace_back([&, p]() {
+				ThreadPlacement own;
+				own.cpus = { producerCpus[p] };
+				own.namePrefix = "bench";
+				placeCurrentThread(own, "producer");
+				auto &mine = samples[p];
+				mine.reserve(size_t(iterations));
+				++ready;
+				while (ready.load() < producerCpus.size()) {
+					std::this_thread::yield();
+				}
+				for (int i = 0; i < iterations; i++) {
+					auto start = std::chrono::steady_clock::now();
+					work(2000);
+					log.Ainfo("producer {} iteration {} of the placement benchmark", p, i);
+					mine.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+						std::chrono::steady_clock::now() - start).count());
+				}
+			});
+		}
+		for (auto &th : producers) {
+			th.join();
+		}
+	}
+
+	std::vector<long long> all;
+	for (auto &mine : samples) {
+		all.insert(all.end(), mine.begin(), mine.end());
+	}
+	std::sort(all.begin(), all.end());
+	auto at = [&all](double q) { return all[size_t(q * double(all.size() - 1))]; };
+	printf("%-28s p50 %7lld  p99 %8lld  p99.9 %9lld  max %10lld ns\n", c.name, at(0.5), at(0.99), at(0.999), all.back());
+}
+
+int main(int argc, char **argv) {
+	int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+	std::string path = argc > 2 ? argv[2] : "/dev/shm/alog_placement_bench";
+
+	// the two nodes, real or emulated.
+	std::vector<int> node0 = numaNodeCpus(0), node1 = numaNodeCpus(1);
+	const char *topology = "numa nodes";
+	if (node0.empty() || node1.empty()) {
+		topology = "emulated nodes";
+		std::vector<int> cpus;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		sched_getaffinity(0, sizeof(set), &set);
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, &set)) {
+				cpus.push_back(cpu);
+			}
+		}
+		size_t half = cpus.size() > 1 ? cpus.size() / 2 : 1;
+		node0.assign(cpus.begin(), cpus.begin() + long(half));
+		node1.assign(cpus.begin() + long(cpus.size() > 1 ? half : 0), cpus.end());
+	}
+	printf("%s: producers on %zu cpus, the other node has %zu cpus\n", topology, node0.size(), node1.size());
+
+	std::error_code ec;
+	std::filesystem::remove_all(path, ec);
+	std::filesystem::create_directories(path, ec);
+
+	std::vector<Case> cases(4);
+	cases[0].name = "writer anywhere";
+	cases[1].name = "writer on producers' cpus";
+	cases[1].writer.cpus = node0;
+	cases[2].name = "writer there, SCHED_IDLE";
+	cases[2].writer.cpus = node0;
+	cases[2].writer.policy = SCHED_IDLE;
+	cases[2].writer.nice = 19;
+	cases[3].name = "writer on the other node";
+	cases[3].writer.cpus = node1;
+	for (const Case &c : cases) {
+		run(c, node0, path + "/case", iterations);
+		std::filesystem::remove_all(path + "/case", ec);
+	}
+	std::filesystem::remove_all(path, ec);
+	return 0;
+}
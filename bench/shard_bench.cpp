@@ -0,0 +1,69 @@
+/*
+ * shard benchmark: aggregate records per second of N producer threads with the
+ * shared log file(synchronous lock, and the asynchronous queue with its writer
+ * thread, woken every 10 ms) against the per-thread shard files. the time runs
+ * until the log is released, so the queue's drain and the shards' last flush
+ * are counted.
+ * merge the shards with: alog_merge <log path>/shard
+ *
+ * build: g++ -std=c++17 -O2 -I.. -I<anet utils> shard_bench.cpp ../log.cpp -lpthread
+ * usage: shard_bench [threads, default 8] [records per thread, default 200000]
+ *                    [log path, default /dev/shm/alog_shard_bench]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log.h"
+
+using namespace anet::log;
+
+enum class eMode { syncShared, asyncShared, threadShard };
+
+static void run(const char *name, eMode mode, const std::string &dir, int threads, int count) {
+	auto begin = std::chrono::steady_clock::now();
+	{
+		aLog log(dir, "bench", 10);
+		if (mode == eMode::threadShard) {
+			log.enableThreadShards();
+		}
+		std::vector<std::thread> producers;
+		for (int t = 0; t < threads; t++) {
+			producers.emplace_back([&log, mode, t, count]() {
+				for (int i = 0; i < count; i++) {
+					if (mode == eMode::asyncShared) {
+						log.Ainfo("thread {} record {} payload of the shard benchmark", t, i);
+					} else {
+						log.info("thread {} record {} payload of the shard benchmark", t, i);
+					}
+				}
+			});
+		}
+		for (auto &th : producers) {
+			th.join();
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	double records = double(threads) * double(count);
+	printf("%-12s %2d threads  %8.0f krecords/s  %6.3f s\n", name, threads, records / seconds / 1000, seconds);
+}
+
+int main(int argc, char **argv) {
+	int threads = argc > 1 ? atoi(argv[1]) : 8;
+	int count = argc > 2 ? atoi(argv[2]) : 200000;
+	std::string path = argc > 3 ? argv[3] : "/dev/shm/alog_shard_bench";
+	std::error_code ec;
+	std::filesystem::remove_all(path, ec);
+	std::filesystem::create_directories(path, ec);
+
+	for (int n = 1; n <= threads; n *= 2) {
+		run("shared sync", eMode::syncShared, path + "/sync", n, count);
+		run("shared async", eMode::asyncShared, path + "/async", n, count);
+		run("shard", eMode::threadShard, path + "/shard", n, count);
+	}
+	return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * shared memory transport harness: forks a collector and several producer
+ * processes on one machine, each producer logs through its ring, then checks
+ * that every record arrived once(in the collector's log or in the producer's
+ * fallback file) and prints the throughput.
+ *
+ * build: g++ -std=c++17 -O2 -I.. -I<anet utils> shm_multiprocess_bench.cpp ../log.cpp -lpthread -lrt
+ * usage: shm_multiprocess_bench [producers, default 8] [records per producer, default 100000]
+ *                               [log path, default /dev/shm/alog_shm_bench]
+ */
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "log.h"
+
+using namespace anet::log;
+
+static const char *gName = "shmbench";
+static volatile sig_atomic_t gQuit = 0;
+
+static void onQuit(int) {
+	gQuit = 1;
+}
+
+// the collector process: as alog_collector does.
+static int runCollector(const std::string &path) {
+	signal(SIGTERM, onQuit);
+	aLog &log = aLog::instance();
+	if (!log.setLogInfo(path + "/collector", "collector", 100)) {
+		return 1;
+	}
+	ShmCollector collector(gName);
+	auto output = [&log](const char *batch, size_t len) { log.appendBatch(batch, len); };
+	while (!gQuit) {
+		if (collector.poll(output) == 0) {
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+	}
+	while (collector.poll(output) > 0) {
+	}
+	return 0;
+}
+
+// a producer process: waits until the collector beats, then logs.
+static int runProducer(const std::string &path, int index, int count) {
+	aLog &log = aLog::instance();
+	if (!log.setLogInfo(path + "/producer" + std::to_string(index), "producer", 100) ||
+		!log.enableSharedMemory(gName, 4 * 1024 * 1024)) {
+		return 1;
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	for (int i = 0; i < count; i++) {
+		log.Ainfo("producer {} record {} payload of the shared memory harness", index, i);
+	}
+	return 0;
+}
+
+// countLines counts the lines of all log files under dir.
+static size_t countLines(const std::string &dir) {
+	size_t lines = 0;
+	std::error_code ec;
+	for (std::filesystem::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+		if (!it->is_regular_file(ec)) {
+			continue;
+		}
+		std::ifstream in(it->path());
+		std::string line;
+		while (std::getline(in, line)) {
+			++lines;
+		}
+	}
+	return lines;
+}
+
+int main(int argc, char **argv) {
+	int producers = argc > 1 ? atoi(argv[1]) : 8;
+	int count = argc > 2 ? atoi(argv[2]) : 100000;
+	std::string path = argc > 3 ? argv[3] : "/dev/shm/alog_shm_bench";
+	std::error_code ec;
+	std::filesystem::remove_all(path, ec);
+	std::filesystem::create_directories(path, ec);
+
+	pid_t collector = fork();
+	if (collector == 0) {
+		_exit(runCollector(path));
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	std::vector<pid_t> pids;
+	for (int i = 0; i < producers; i++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			int ret = runProducer(path, i, count);
+			exit(ret);
+		}
+		pids.push_back(pid);
+	}
+	for (pid_t pid : pids) {
+		waitpid(pid, nullptr, 0);
+	}
+	auto produced = std::chrono::steady_clock::now();
+
+	// let the collector drain the closed rings.
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	kill(collector, SIGTERM);
+	waitpid(collector, nullptr, 0);
+
+	size_t collected = countLines(path + "/collector");
+	size_t total = countLines(path);
+	size_t expected = size_t(producers) * size_t(count);
+	double seconds = std::chrono::duration<double>(produced - begin).count() - 0.5;
+	printf("%d producers x %d records: collected %zu, fallback %zu, %s, %.0f records/s\n",
+		producers, count, collected, total - collected,
+		total == expected ? "all arrived" : "MISSING RECORDS", double(expected) / seconds);
+	return total == expected ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+/*
+ * sink fan-out benchmark: ns per ADebug call and the time until every sink
+ * got all records, with 1, 2 and 4 sinks besides the log file. the last case
+ * adds a slow sink which must not delay the fast ones.
+ *
+ * build: g++ -std=c++17 -O2 -I.. -I<anet utils> sink_fanout_bench.cpp ../log.cpp -lpthread
+ * usage: sink_fanout_bench [log path, default /dev/shm/alog_bench]
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log.h"
+
+using namespace anet::log;
+
+static constexpr int gCount = 200000;
+
+// counts the delivered records.
+class CountSink : public LogSink {
+public:
+	explicit CountSink(eRecordFormat format, int delayUs = 0) :
+		LogSink(eLogLevel::debugLevel, format), m_delayUs(delayUs) {}
+
+	void write(eLogLevel, const char*, size_t len) override {
+		m_bytes += len;
+		m_count.fetch_add(1, std::memory_order_release);
+	}
+	void flush() override {
+		if (m_delayUs > 0) {
+			std::this_thread::sleep_for(std::chrono::microseconds(m_delayUs));
+		}
+	}
+	int count() const {
+		return m_count.load(std::memory_order_acquire);
+	}
+
+private:
+	int m_delayUs;
+	size_t m_bytes{ 0 };
+	std::atomic<int> m_count{ 0 };
+};
+
+static void run(const std::string &path, int sinkCount, bool slowSink) {
+	aLog log(path, "fanout", 10);
+	std::vector<std::shared_ptr<CountSink>> sinks;
+	for (int i = 0; i < sinkCount; i++) {
+		// half text(shared bytes as they are), half json(rendered per sink).
+		auto sink = std::make_shared<CountSink>(i % 2 == 0 ? eRecordFormat::textFormat : eRecordFormat::jsonFormat);
+		sinks.push_back(sink);
+		log.addSink(sink);
+	}
+	std::shared_ptr<CountSink> slow;
+	if (slowSink) {
+		slow = std::make_shared<CountSink>(eRecordFormat::textFormat, 20000);
+		log.addSink(slow);
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < gCount; i++) {
+		log.Adebug("fan-out record {} of {}", i, gCount);
+	}
+	auto produced = std::chrono::steady_clock::now();
+
+	// wait for the fast sinks.
+	for (auto &sink : sinks) {
+		while (sink->count() < gCount) {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}
+	auto delivered = std::chrono::steady_clock::now();
+
+	double ns = std::chrono::duration<double, std::nano>(produced - begin).count() / gCount;
+	double ms = std::chrono::duration<double, std::milli>(delivered - begin).count();
+	printf("%d sinks%-12s %8.1f ns/call %9.1f ms delivered", sinkCount,
+		slowSink ? " + 1 slow" : "", ns, ms);
+	if (slow != nullptr) {
+		printf("  slow got %d, dropped %zu batches", slow->count(), slow->dropped());
+	}
+	printf("\n");
+}
+
+int main(int argc, char **argv) {
+	std::string path = argc > 1 ? argv[1] : "/dev/shm/alog_bench";
+	for (int sinkCount : { 1, 2, 4 }) {
+		run(path, sinkCount, false);
+	}
+	run(path, 4, true);
+	return 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * stream string benchmark: allocations per call and ns per call of
+ * StreamStringUnlimit against the former std::vector based stream.
+ *
+ * build: g++ -std=c++17 -O2 -I.. stream_string_bench.cpp -o stream_string_bench
+ * the allocation counter wraps glibc's malloc family.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "stream_string.h"
+
+extern "C" {
+	void* __libc_malloc(size_t size);
+	void* __libc_realloc(void *ptr, size_t size);
+	void* __libc_calloc(size_t n, size_t size);
+	void  __libc_free(void *ptr);
+}
+
+static thread_local long long gAllocCount = 0;
+
+extern "C" {
+	void* malloc(size_t size) { ++gAllocCount; return __libc_malloc(size); }
+	void* realloc(void *ptr, size_t size) { ++gAllocCount; return __libc_realloc(ptr, size); }
+	void* calloc(size_t n, size_t size) { ++gAllocCount; return __libc_calloc(n, size); }
+	void  free(void *ptr) { __libc_free(ptr); }
+}
+
+// the former stream: std::vector storage, zero filled, virtual To.
+template <size_t SIZE>
+class VectorStream {
+public:
+	VectorStream() : m_pos(0) {
+		m_vecBuffer.resize(alignSize(SIZE), 0);
+	}
+	virtual ~VectorStream() {}
+
+	const char* str() const { return &m_vecBuffer[0]; }
+	int len() const { return m_pos; }
+
+	template<typename T>
+	VectorStream &operator << (T data) {
+		auto &&value = std::to_string(data);
+		return this->To(value.c_str(), value.length());
+	}
+	VectorStream &operator << (const char* szData) {
+		return this->To(szData, strlen(szData));
+	}
+
+	virtual VectorStream &To(const char *data, size_t dataLen) {
+		if (m_pos + dataLen + 1 >= m_vecBuffer.size()) {
+			m_vecBuffer.resize(m_pos + alignSize(dataLen + 64), 0);
+		}
+		memcpy(&m_vecBuffer[m_pos], data, dataLen);
+		m_pos += dataLen;
+		return *this;
+	}
+
+private:
+	static size_t alignSize(size_t n) { return size_t(SStreamSpace::Align(int(n))); }
+	size_t m_pos;
+	std::vector<char> m_vecBuffer;
+};
+
+// keep the result alive.
+static volatile int gSink = 0;
+
+template <typename Stream>
+static void runCase(const char *name, const char *payload, int loops) {
+	gAllocCount = 0;
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < loops; i++) {
+		Stream ss;
+		ss << "user " << payload << " login from " << "10.0.0.1" << " count:" << 42;
+		gSink += ss.len() + ss.str()[0];
+	}
+	auto end = std::chrono::steady_clock::now();
+	double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+	std::printf("%-36s %10.2f ns/call %8.3f allocs/call\n", name, ns / loops, double(gAllocCount) / loops);
+}
+
+int main(int argc, char *argv[]) {
+	int loops = argc > 1 ? atoi(argv[1]) : 1000000;
+	std::string large(4096, 'x');
+
+	runCase<VectorStream<1024>>("vector<1024> small", "gavin", loops);
+	runCase<SStreamSpace::StreamStringUnlimit<1024>>("inline<1024> small", "gavin", loops);
+	runCase<VectorStream<64>>("vector<64> small", "gavin", loops);
+	runCase<SStreamSpace::StreamStringUnlimit<64>>("inline<64> small", "gavin", loops);
+	runCase<VectorStream<1024>>("vector<1024> 4KiB overflow", large.c_str(), loops / 10);
+	runCase<SStreamSpace::StreamStringUnlimit<1024>>("inline<1024> 4KiB overflow", large.c_str(), loops / 10);
+	return 0;
+}
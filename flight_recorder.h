@@ -0,0 +1,135 @@
+#pragma once
+
+/*
+ * flight recorder: a fixed size in-memory ring which always captures the
+ * records below the log level, and which is dumped to the log when something
+ * goes wrong(a crit record, on demand, or a fatal signal). it never touches
+ * the disk by itself.
+ *
+ * producers claim a slot with one atomic add, so there is no lock. a slot keeps
+ * the sequence of its record as a seqlock: the dump copies a slot and keeps the
+ * copy only if the sequence did not change meanwhile, so a torn slot is skipped.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <functional>
+
+namespace anet {
+	namespace log {
+		// default slot count and slot size(record longer than it is truncated).
+		static constexpr size_t gFlight_slot_count = 4096;
+		static constexpr size_t gFlight_slot_size = 256;
+		// the largest slot, the dump copies a slot on its stack.
+		static constexpr size_t gFlight_slot_max_size = 4096;
+
+		class FlightRecorder final {
+		public:
+			FlightRecorder(size_t slotCount, size_t slotSize) :
+				m_slotCount(slotCount > 0 ? slotCount : gFlight_slot_count),
+				m_slotSize(slotSize > 16 ? (slotSize < gFlight_slot_max_size ? slotSize : gFlight_slot_max_size) :
+					gFlight_slot_size) {
+				m_stride = (sizeof(Slot) + m_slotSize + 63) & ~size_t(63);
+				m_memory.reset(new char[m_stride * m_slotCount + 64]);
+				char *base = m_memory.get();
+				base += (64 - uintptr_t(base) % 64) % 64;
+				m_slots = base;
+				for (size_t i = 0; i < m_slotCount; i++) {
+					new (this->slotAt(i)) Slot();
+				}
+			}
+			~FlightRecorder() = default;
+			FlightRecorder(const FlightRecorder &rhs) = delete;
+			FlightRecorder& operator=(const FlightRecorder &rhs) = delete;
+
+		public:
+			// record copies a line into the ring, overwriting the oldest one.
+			void record(const char *data, size_t len) {
+				uint64_t seq = m_next.fetch_add(1, std::memory_order_relaxed) + 1;
+				Slot *slot = this->slotAt(size_t(seq % m_slotCount));
+
+				// a writer of the former cycle still holds it, or a later cycle already
+				// wrote it(this writer stalled): drop this record.
+				uint64_t old = slot->seq.load(std::memory_order_relaxed);
+				if (old == gBusy || old >= seq || !slot->seq.compare_exchange_strong(old, gBusy,
+					std::memory_order_acquire)) {
+					return;
+				}
+
+				if (len > m_slotSize) {
+					len = m_slotSize;
+				}
+				char *p = (char*)(slot + 1);
+				memcpy(p, data, len);
+				if (len > 0 && p[len - 1] != '\n') {
+					p[len - 1] = '\n';
+				}
+				slot->len.store(uint32_t(len), std::memory_order_relaxed);
+				slot->seq.store(seq, std::memory_order_release);
+			}
+
+			// dump calls output with the records which are not dumped yet, the oldest
+			// first. it allocates nothing, so it can be called in a signal handler if
+			// output does so.
+			template <typename Output>
+			size_t dump(Output &&output) {
+				uint64_t next = m_next.load(std::memory_order_acquire);
+				uint64_t dumped = m_dumped.exchange(next, std::memory_order_acq_rel);
+				char copy[gFlight_slot_max_size];
+				size_t count = 0;
+				for (size_t k = 1; k <= m_slotCount; k++) {
+					uint64_t seq = next + k;
+					Slot *slot = this->slotAt(size_t(seq % m_slotCount));
+					uint64_t slotSeq = slot->seq.load(std::memory_order_acquire);
+					if (slotSeq == gBusy || slotSeq == 0 || slotSeq <= dumped || slotSeq > next) {
+						continue;
+					}
+					size_t len = slot->len.load(std::memory_order_relaxed);
+					len = len < m_slotSize ? len : m_slotSize;
+					memcpy(copy, (const char*)(slot + 1), len);
+					// a writer took the slot while it was copied: the copy is torn.
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (slot->seq.load(std::memory_order_relaxed) != slotSeq) {
+						continue;
+					}
+					output((const char*)copy, len);
+					++count;
+				}
+				return count;
+			}
+
+			size_t slotCount() const {
+				return m_slotCount;
+			}
+			size_t slotSize() const {
+				return m_slotSize;
+			}
+
+		private:
+			// a slot: header followed by slotSize bytes.
+			struct Slot {
+				std::atomic<uint64_t> seq{ 0 };
+				std::atomic<uint32_t> len{ 0 };
+			};
+			static constexpr uint64_t gBusy = ~uint64_t(0);
+
+			Slot* slotAt(size_t index) const {
+				return (Slot*)(m_slots + index * m_stride);
+			}
+
+		private:
+			size_t m_slotCount;
+			size_t m_slotSize;
+			size_t m_stride{ 0 };
+			std::unique_ptr<char[]> m_memory;
+			char *m_slots{ nullptr };
+
+			// the last claimed sequence, and the last dumped one.
+			alignas(64) std::atomic<uint64_t> m_next{ 0 };
+			alignas(64) std::atomic<uint64_t> m_dumped{ 0 };
+		};
+	}
+}
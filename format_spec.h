@@ -0,0 +1,392 @@
+#pragma once
+
+/*
+ * format spec of the {} api, a subset of the fmt style:
+ *   {[:[[fill]align][+][#][0][width][.precision][type]]}
+ * where align is one of '<' '>' '^', and type is one of
+ *   d x X o b c(integers), f e g(floating points), s(strings), p(pointers),
+ *   hex hexdump(binary payloads and strings, see hex_dump.h).
+ * e.g. {:x} {:#010x} {:08d} {:.3f} {:>12} {:*^9s}.
+ *
+ * an argument may be a callable(a lambda, or lazy(f)), which is invoked only
+ * when its placeholder is rendered, i.e. when the record is really built:
+ *   log.debug("state {}", [&]() { return dumpState(); });
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "stream_string.h"
+
+namespace anet {
+	namespace log {
+		// max precision and width, larger ones are clamped.
+		static constexpr int gFormat_max_precision = 64;
+		static constexpr int gFormat_max_width = 256;
+
+		// one placeholder's spec.
+		struct FormatSpec {
+			char fill{ ' ' };
+			char align{ 0 };
+			char sign{ 0 };
+			char type{ 0 };
+			bool alternate{ false };
+			bool zeroPad{ false };
+			short width{ 0 };
+			short precision{ -1 };
+
+			constexpr bool plain() const {
+				return align == 0 && sign == 0 && type == 0 && !alternate &&
+					!zeroPad && width == 0 && precision < 0;
+			}
+		};
+
+		constexpr bool isFormatAlign(char c) {
+			return c == '<' || c == '>' || c == '^';
+		}
+		constexpr bool isFormatType(char c) {
+			return c == 'd' || c == 'x' || c == 'X' || c == 'o' || c == 'b' || c == 'c' ||
+				c == 'f' || c == 'e' || c == 'g' || c == 's' || c == 'p';
+		}
+
+		// parseFormatSpec parses a placeholder starting at p(which points to '{').
+		// it returns the pointer after '}', or nullptr if p is not a valid placeholder,
+		// in which case the '{' is just literal text.
+		constexpr const char* parseFormatSpec(const char *p, FormatSpec &spec) {
+			if (*p != '{') {
+				return nullptr;
+			}
+			++p;
+			if (*p == '}') {
+				return p + 1;
+			}
+			if (*p != ':') {
+				return nullptr;
+			}
+			++p;
+
+			// [[fill]align]
+			if (*p != 0 && *p != '}' && isFormatAlign(p[1])) {
+				spec.fill = p[0];
+				spec.align = p[1];
+				p += 2;
+			} else if (isFormatAlign(*p)) {
+				spec.align = *p++;
+			}
+			// [+]
+			if (*p == '+' || *p == ' ') {
+				spec.sign = *p++;
+			}
+			// [#]
+			if (*p == '#') {
+				spec.alternate = true;
+				++p;
+			}
+			// [0]
+			if (*p == '0') {
+				spec.zeroPad = true;
+				++p;
+			}
+			// [width]
+			int width = 0;
+			while (*p >= '0' && *p <= '9') {
+				width = width * 10 + (*p++ - '0');
+				if (width > gFormat_max_width) width = gFormat_max_width;
+			}
+			spec.width = short(width);
+			// [.precision]
+			if (*p == '.') {
+				++p;
+				int precision = 0;
+				bool any = false;
+				while (*p >= '0' && *p <= '9') {
+					precision = precision * 10 + (*p++ - '0');
+					if (precision > gFormat_max_precision) precision = gFormat_max_precision;
+					any = true;
+				}
+				if (!any) {
+					return nullptr;
+				}
+				spec.precision = short(precision);
+			}
+			// [type]
+			if (p[0] == 'h' && p[1] == 'e' && p[2] == 'x') {
+				bool dump = p[3] == 'd' && p[4] == 'u' && p[5] == 'm' && p[6] == 'p';
+				spec.type = dump ? 'H' : 'h';
+				p += dump ? 7 : 3;
+			} else if (isFormatType(*p)) {
+				spec.type = *p++;
+			}
+			if (*p != '}') {
+				return nullptr;
+			}
+			return p + 1;
+		}
+
+		// findPlaceholder finds the next valid placeholder from p,
+		// returns its position or the tail 0.
+		constexpr const char* findPlaceholder(const char *p, FormatSpec &spec, const char *&after) {
+			for (; *p != 0; ++p) {
+				if (*p != '{') {
+					continue;
+				}
+				FormatSpec tmp{};
+				const char *next = parseFormatSpec(p, tmp);
+				if (next != nullptr) {
+					spec = tmp;
+					after = next;
+					return p;
+				}
+			}
+			after = p;
+			return p;
+		}
+
+		// countPlaceholders returns the count of valid placeholders.
+		constexpr size_t countPlaceholders(const char *p) {
+			size_t count = 0;
+			for (;;) {
+				FormatSpec spec{};
+				const char *after = nullptr;
+				const char *pos = findPlaceholder(p, spec, after);
+				if (*pos == 0) {
+					return count;
+				}
+				++count;
+				p = after;
+			}
+		}
+
+		// render string bytes as hex, defined in hex_dump.h.
+		template <typename Stream>
+		void formatBytesAsHex(Stream &ss, const char *data, size_t len, bool dump);
+
+		/* ============================================================== */
+		// padding the rendered [start, ss.len()) with spec's width in place.
+		// numeric values with zero padding put the zeros after the sign and 0x prefix.
+		template <typename Stream>
+		inline void padFormatted(Stream &ss, int start, const FormatSpec &spec, bool numeric) {
+			int n = ss.len() - start;
+			if (spec.width <= n) {
+				return;
+			}
+			int pad = spec.width - n;
+			char *base = ss.prepare(pad) - n;
+			if (numeric && spec.zeroPad && spec.align == 0) {
+				int prefix = 0;
+				if (n > 0 && (base[0] == '-' || base[0] == '+' || base[0] == ' ')) {
+					prefix = 1;
+				}
+				if (n > prefix + 1 && base[prefix] == '0' &&
+					(base[prefix + 1] == 'x' || base[prefix + 1] == 'X' ||
+					 base[prefix + 1] == 'b' || base[prefix + 1] == 'o')) {
+					prefix += 2;
+				}
+				memmove(base + prefix + pad, base + prefix, size_t(n - prefix));
+				memset(base + prefix, '0', size_t(pad));
+			} else {
+				char align = spec.align != 0 ? spec.align : (numeric ? '>' : '<');
+				int left = align == '>' ? pad : (align == '^' ? pad / 2 : 0);
+				int right = pad - left;
+				if (left > 0) {
+					memmove(base + left, base, size_t(n));
+					memset(base, spec.fill, size_t(left));
+				}
+				if (right > 0) {
+					memset(base + left + n, spec.fill, size_t(right));
+				}
+			}
+			ss.commit(pad);
+		}
+
+		// render an integer value.
+		template <typename Stream, typename T>
+		inline void formatInteger(Stream &ss, const FormatSpec &spec, T value) {
+			if (spec.type == 'c') {
+				char c = char(value);
+				ss.To(&c, 1);
+				return;
+			}
+			using uType = typename std::make_unsigned<T>::type;
+			bool negative = false;
+			uint64_t uValue = uint64_t(uType(value));
+			if constexpr (std::is_signed<T>::value) {
+				if (value < 0) {
+					negative = true;
+					uValue = 0 - uint64_t(int64_t(value));
+				}
+			}
+
+			// sign + prefix + 64 binary digits.
+			char *p = ss.prepare(72);
+			char *begin = p;
+			if (negative) {
+				*p++ = '-';
+			} else if (spec.sign != 0) {
+				*p++ = spec.sign;
+			}
+			switch (spec.type) {
+			case 'x':
+			case 'X': {
+				if (spec.alternate) { *p++ = '0'; *p++ = spec.type; }
+				int n = SStreamSpace::formatHex(p, uValue);
+				if (spec.type == 'X') {
+					for (int i = 0; i < n; i++) {
+						if (p[i] >= 'a') p[i] = char(p[i] - 'a' + 'A');
+					}
+				}
+				p += n;
+				break;
+			}
+			case 'o':
+			case 'b': {
+				if (spec.alternate) { *p++ = '0'; *p++ = spec.type; }
+				int shift = spec.type == 'o' ? 3 : 1;
+				uint64_t mask = spec.type == 'o' ? 7 : 1;
+				char szTmp[72];
+				int n = 0;
+				do {
+					szTmp[n++] = char('0' + (uValue & mask));
+					uValue >>= shift;
+				} while (uValue != 0);
+				while (n > 0) {
+					*p++ = szTmp[--n];
+				}
+				break;
+			}
+			default:
+				p += SStreamSpace::formatUnsigned(p, uValue);
+				break;
+			}
+			ss.commit(int(p - begin));
+		}
+
+		// render a floating point value.
+		template <typename Stream, typename T>
+		inline void formatFloating(Stream &ss, const FormatSpec &spec, T value) {
+			if (spec.precision < 0 && (spec.type == 0 || spec.type == 'g')) {
+				// shortest round-trip form.
+				char *p = ss.prepare(SStreamSpace::number_max_size + 1);
+				int n = 0;
+				if (spec.sign != 0 && !(value < 0)) {
+					p[n++] = spec.sign;
+				}
+				n += SStreamSpace::formatNumber(p + n, value);
+				ss.commit(n);
+				return;
+			}
+
+			// fixed: the integer part of a double has 309 digits at most.
+			int precision = spec.precision < 0 ? 6 : spec.precision;
+			int maxSize = 320 + precision;
+			char *p = ss.prepare(maxSize);
+			int n = 0;
+			if (spec.sign != 0 && !(value < 0)) {
+				p[n++] = spec.sign;
+			}
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+			std::chars_format chars = std::chars_format::fixed;
+			if (spec.type == 'e') chars = std::chars_format::scientific;
+			else if (spec.type == 'g' || spec.type == 0) chars = std::chars_format::general;
+			auto ret = std::to_chars(p + n, p + maxSize, double(value), chars, precision);
+			if (ret.ec == std::errc()) {
+				ss.commit(int(ret.ptr - p));
+				return;
+			}
+#endif
+			const char *format = spec.type == 'e' ? "%.*e" : (spec.type == 'f' ? "%.*f" : "%.*g");
+			int len = std::snprintf(p + n, size_t(maxSize - n), format, precision, double(value));
+			ss.commit(len > 0 ? n + len : n);
+		}
+
+		// render a string value, precision truncates it.
+		template <typename Stream>
+		inline void formatText(Stream &ss, const FormatSpec &spec, const char *data, size_t len) {
+			if (spec.precision >= 0 && size_t(spec.precision) < len) {
+				len = size_t(spec.precision);
+			}
+			if (spec.type == 'h' || spec.type == 'H') {
+				formatBytesAsHex(ss, data, len, spec.type == 'H');
+				return;
+			}
+			ss.To(data, len);
+		}
+
+		// lazy argument: func is invoked when the argument is rendered.
+		template <typename Func>
+		struct LazyArg {
+			Func func;
+		};
+		template <typename Func>
+		inline LazyArg<std::decay_t<Func>> lazy(Func &&func) {
+			return LazyArg<std::decay_t<Func>>{ std::forward<Func>(func) };
+		}
+
+		template <typename T>
+		struct isLazyArg : std::false_type {};
+		template <typename Func>
+		struct isLazyArg<LazyArg<Func>> : std::true_type {};
+
+		// a LazyArg, or a class callable with no argument(a lambda, a std::function).
+		template <typename T>
+		static constexpr bool isLazyArgument = isLazyArg<T>::value ||
+			(std::is_class<T>::value && std::is_invocable<const T&>::value);
+
+		// lazyValue invokes a lazy argument.
+		template <typename T>
+		inline decltype(auto) lazyValue(const T &value) {
+			if constexpr (isLazyArg<T>::value) {
+				static_assert(!std::is_void<decltype(value.func())>::value, "a lazy argument returns its value");
+				return value.func();
+			} else {
+				static_assert(!std::is_void<decltype(value())>::value, "a lazy argument returns its value");
+				return value();
+			}
+		}
+
+		// formatValue renders one value with its spec.
+		// user types without spec support go to its stream operator.
+		template <typename Stream, typename T>
+		inline void formatValue(Stream &ss, const FormatSpec &spec, const T &value) {
+			if (spec.plain()) {
+				ss << value;
+				return;
+			}
+
+			int start = ss.len();
+			bool numeric = false;
+			if constexpr (std::is_same<T, bool>::value) {
+				formatInteger(ss, spec, int(value));
+				numeric = true;
+			} else if constexpr (std::is_integral<T>::value) {
+				formatInteger(ss, spec, value);
+				numeric = spec.type != 'c';
+			} else if constexpr (std::is_floating_point<T>::value) {
+				formatFloating(ss, spec, value);
+				numeric = true;
+			} else if constexpr (std::is_same<T, std::string>::value) {
+				formatText(ss, spec, value.data(), value.size());
+			} else if constexpr (std::is_convertible<const T&, const char*>::value) {
+				const char *data = value;
+				if (data == nullptr) data = "null";
+				formatText(ss, spec, data, strlen(data));
+			} else {
+				ss << value;
+			}
+			padFormatted(ss, start, spec, numeric);
+		}
+
+		// formatArg renders one argument with its spec, a lazy one is invoked first.
+		template <typename Stream, typename T>
+		inline void formatArg(Stream &ss, const FormatSpec &spec, const T &value) {
+			if constexpr (isLazyArgument<T>) {
+				formatArg(ss, spec, lazyValue(value));
+			} else {
+				formatValue(ss, spec, value);
+			}
+		}
+		/*===============================================================*/
+	}
+}
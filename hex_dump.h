@@ -0,0 +1,221 @@
+#pragma once
+
+/*
+ * hex rendering of binary payloads: compact hex("deadbeef") or the classic
+ * offset/hex/ascii dump. the nibble to ascii kernels use AVX2 or SSE2 when the
+ * target supports them, with a scalar fallback.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "format_spec.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ALOG_HEX_SSE2 1
+#endif
+
+namespace anet {
+	namespace log {
+		// bytes per line of the hex dump.
+		static constexpr size_t gHexDump_line_bytes = 16;
+		// one dump line: "00000000  xx xx xx xx xx xx xx xx  xx xx xx xx xx xx xx xx  |................|\n"
+		static constexpr size_t gHexDump_line_size = 10 + gHexDump_line_bytes * 3 + 1 + 1 + gHexDump_line_bytes + 2 + 1;
+		// a payload renders this size at most, so it fits the stream's int sizes,
+		// the rest is cut and marked with "...".
+		static constexpr size_t gHex_max_render_size = 1024 * 1024 * 1024;
+
+		// binary payload argument, see hex() and hexdump().
+		struct HexView {
+			const uint8_t *data{ nullptr };
+			size_t len{ 0 };
+			bool dump{ false };
+		};
+
+		// compact hex argument: "{}" renders as "deadbeef".
+		inline HexView hex(const void *data, size_t len) {
+			return HexView{ (const uint8_t*)data, data != nullptr ? len : 0, false };
+		}
+		inline HexView hex(const std::string &data) {
+			return hex(data.data(), data.size());
+		}
+
+		// classic dump argument: "{}" renders as offset/hex/ascii lines.
+		inline HexView hexdump(const void *data, size_t len) {
+			return HexView{ (const uint8_t*)data, data != nullptr ? len : 0, true };
+		}
+		inline HexView hexdump(const std::string &data) {
+			return hexdump(data.data(), data.size());
+		}
+
+		/* ============================================================== */
+		// scalar kernel: out must have 2 * len bytes.
+		inline void encodeHexScalar(char *out, const uint8_t *in, size_t len) {
+			static constexpr char hexDigits[] = "0123456789abcdef";
+			for (size_t i = 0; i < len; i++) {
+				out[2 * i] = hexDigits[in[i] >> 4];
+				out[2 * i + 1] = hexDigits[in[i] & 0x0f];
+			}
+		}
+
+#if defined(__AVX2__)
+		// nibbles(0~15) to '0'~'9','a'~'f'.
+		inline __m256i nibbleToAscii(__m256i nibble) {
+			const __m256i nine = _mm256_set1_epi8(9);
+			const __m256i letterOffset = _mm256_set1_epi8('a' - '0' - 10);
+			__m256i isLetter = _mm256_cmpgt_epi8(nibble, nine);
+			__m256i ascii = _mm256_add_epi8(nibble, _mm256_set1_epi8('0'));
+			return _mm256_add_epi8(ascii, _mm256_and_si256(isLetter, letterOffset));
+		}
+
+		// AVX2 kernel, 32 bytes to 64 characters a time.
+		inline void encodeHex(char *out, const uint8_t *in, size_t len) {
+			const __m256i mask = _mm256_set1_epi8(0x0f);
+			size_t i = 0;
+			for (; i + 32 <= len; i += 32) {
+				__m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+				__m256i hi = nibbleToAscii(_mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+				__m256i lo = nibbleToAscii(_mm256_and_si256(v, mask));
+				// unpack works in 128 bits lanes, permute them back in order.
+				__m256i a = _mm256_unpacklo_epi8(hi, lo);
+				__m256i b = _mm256_unpackhi_epi8(hi, lo);
+				_mm256_storeu_si256((__m256i*)(out + 2 * i), _mm256_permute2x128_si256(a, b, 0x20));
+				_mm256_storeu_si256((__m256i*)(out + 2 * i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+			}
+			encodeHexScalar(out + 2 * i, in + i, len - i);
+		}
+#elif defined(ALOG_HEX_SSE2)
+		inline __m128i nibbleToAscii(__m128i nibble) {
+			const __m128i nine = _mm_set1_epi8(9);
+			const __m128i letterOffset = _mm_set1_epi8('a' - '0' - 10);
+			__m128i isLetter = _mm_cmpgt_epi8(nibble, nine);
+			__m128i ascii = _mm_add_epi8(nibble, _mm_set1_epi8('0'));
+			return _mm_add_epi8(ascii, _mm_and_si128(isLetter, letterOffset));
+		}
+
+		// SSE2 kernel, 16 bytes to 32 characters a time.
+		inline void encodeHex(char *out, const uint8_t *in, size_t len) {
+			const __m128i mask = _mm_set1_epi8(0x0f);
+			size_t i = 0;
+			for (; i + 16 <= len; i += 16) {
+				__m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+				__m128i hi = nibbleToAscii(_mm_and_si128(_mm_srli_epi16(v, 4), mask));
+				__m128i lo = nibbleToAscii(_mm_and_si128(v, mask));
+				_mm_storeu_si128((__m128i*)(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+				_mm_storeu_si128((__m128i*)(out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+			}
+			encodeHexScalar(out + 2 * i, in + i, len - i);
+		}
+#else
+		inline void encodeHex(char *out, const uint8_t *in, size_t len) {
+			encodeHexScalar(out, in, len);
+		}
+#endif
+
+		// hexRenderBytes returns the bytes of a payload which are rendered.
+		inline size_t hexRenderBytes(const HexView &view) {
+			size_t max = view.dump ? gHex_max_render_size / gHexDump_line_size * gHexDump_line_bytes :
+				gHex_max_render_size / 2;
+			return view.len < max ? view.len : max;
+		}
+
+		// the rendered size of a payload, see hexRenderBytes.
+		inline size_t hexRenderSize(const HexView &view) {
+			if (!view.dump) {
+				return view.len * 2;
+			}
+			size_t lines = (view.len + gHexDump_line_bytes - 1) / gHexDump_line_bytes;
+			return lines * gHexDump_line_size;
+		}
+
+		// renderHexDump writes the classic dump to out, returns the written size.
+		inline size_t renderHexDump(char *out, const uint8_t *data, size_t len) {
+			char *p = out;
+			char szHex[gHexDump_line_bytes * 2];
+			for (size_t offset = 0; offset < len; offset += gHexDump_line_bytes) {
+				size_t n = len - offset < gHexDump_line_bytes ? len - offset : gHexDump_line_bytes;
+				encodeHex(szHex, data + offset, n);
+
+				// offset.
+				uint32_t off = uint32_t(offset);
+				for (int i = 7; i >= 0; i--) {
+					p[i] = "0123456789abcdef"[off & 0x0f];
+					off >>= 4;
+				}
+				p += 8;
+				*p++ = ' ';
+				*p++ = ' ';
+
+				// hex columns, an extra space in the middle.
+				for (size_t i = 0; i < gHexDump_line_bytes; i++) {
+					if (i < n) {
+						*p++ = szHex[2 * i];
+						*p++ = szHex[2 * i + 1];
+					} else {
+						*p++ = ' ';
+						*p++ = ' ';
+					}
+					*p++ = ' ';
+					if (i == gHexDump_line_bytes / 2 - 1) {
+						*p++ = ' ';
+					}
+				}
+
+				// ascii column.
+				*p++ = ' ';
+				*p++ = '|';
+				for (size_t i = 0; i < n; i++) {
+					uint8_t c = data[offset + i];
+					*p++ = (c >= 0x20 && c < 0x7f) ? char(c) : '.';
+				}
+				*p++ = '|';
+				*p++ = '\n';
+			}
+			return size_t(p - out);
+		}
+
+		// render a payload straight into the stream.
+		template <typename Stream>
+		inline void formatHexView(Stream &ss, const HexView &view) {
+			if (view.len == 0) {
+				return;
+			}
+			HexView v = view;
+			v.len = hexRenderBytes(view);
+			char *p = ss.prepare(int(hexRenderSize(v)));
+			if (v.dump) {
+				ss.commit(int(renderHexDump(p, v.data, v.len)));
+			} else {
+				encodeHex(p, v.data, v.len);
+				ss.commit(int(v.len * 2));
+			}
+			if (v.len < view.len) {
+				ss.To("...", 3);
+			}
+		}
+
+		// strings with {:hex} or {:hexdump}.
+		template <typename Stream>
+		inline void formatBytesAsHex(Stream &ss, const char *data, size_t len, bool dump) {
+			formatHexView(ss, HexView{ (const uint8_t*)data, len, dump });
+		}
+
+		// {} renders as the view's mode, {:hex} and {:hexdump} select the mode.
+		template <typename Stream>
+		inline void formatArg(Stream &ss, const FormatSpec &spec, const HexView &view) {
+			HexView v = view;
+			if (spec.type == 'h') {
+				v.dump = false;
+			} else if (spec.type == 'H') {
+				v.dump = true;
+			}
+			int start = ss.len();
+			formatHexView(ss, v);
+			padFormatted(ss, start, spec, false);
+		}
+		/*===============================================================*/
+	}
+}
@@ -0,0 +1,448 @@
+#pragma once
+
+/*
+ * structured key/value records, encoded straight into the record buffer as
+ * json lines or logfmt, or as the text line with key=value pairs.
+ * the asynchronous path packs the fields in a binary form, and the writer
+ * thread encodes them.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include "format_spec.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ALOG_KV_SSE2 1
+#endif
+
+namespace anet {
+	namespace log {
+		// record output format of an aLog instance.
+		enum class eRecordFormat : int {
+			textFormat = 0,
+			jsonFormat,
+			logfmtFormat,
+		};
+
+		// escape table: 0 for the bytes copied as they are, 'u' for \u00XX,
+		// or the character after '\'.
+		struct JsonEscapeTable {
+			char table[256]{};
+			constexpr JsonEscapeTable() {
+				for (int i = 0; i < 0x20; i++) {
+					table[i] = 'u';
+				}
+				table[int('"')] = '"';
+				table[int('\\')] = '\\';
+				table[int('\b')] = 'b';
+				table[int('\f')] = 'f';
+				table[int('\n')] = 'n';
+				table[int('\r')] = 'r';
+				table[int('\t')] = 't';
+			}
+		};
+		static constexpr JsonEscapeTable gJsonEscape{};
+
+		// index of the lowest set bit, mask is not 0.
+		inline int lowestBit(unsigned mask) {
+#if defined(_MSC_VER)
+			unsigned long index = 0;
+			_BitScanForward(&index, mask);
+			return int(index);
+#else
+			return __builtin_ctz(mask);
+#endif
+		}
+
+		// scanSafe returns the size of the leading bytes which need no escape.
+		inline size_t scanSafe(const char *data, size_t len) {
+			size_t i = 0;
+#if defined(ALOG_KV_SSE2)
+			const __m128i quote = _mm_set1_epi8('"');
+			const __m128i slash = _mm_set1_epi8('\\');
+			for (; i + 16 <= len; i += 16) {
+				__m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+				// bytes < 0x20: min_epu8(v, 0x1f) == v.
+				__m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1f)), v);
+				__m128i hit = _mm_or_si128(ctrl, _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash)));
+				int mask = _mm_movemask_epi8(hit);
+				if (mask != 0) {
+					return i + size_t(lowestBit(unsigned(mask)));
+				}
+			}
+#endif
+			for (; i < len; i++) {
+				if (gJsonEscape.table[uint8_t(data[i])] != 0) {
+					break;
+				}
+			}
+			return i;
+		}
+
+		// appendEscaped writes data with json escaping, without quotes.
+		template <typename Stream>
+		inline void appendEscaped(Stream &ss, const char *data, size_t len) {
+			static constexpr char hexDigits[] = "0123456789abcdef";
+			while (len > 0) {
+				size_t safe = scanSafe(data, len);
+				ss.To(data, safe);
+				data += safe;
+				len -= safe;
+				if (len == 0) {
+					break;
+				}
+				char esc = gJsonEscape.table[uint8_t(*data)];
+				if (esc == 'u') {
+					char szEsc[6] = { '\\', 'u', '0', '0', hexDigits[uint8_t(*data) >> 4], hexDigits[*data & 0x0f] };
+					ss.To(szEsc, sizeof(szEsc));
+				} else {
+					char szEsc[2] = { '\\', esc };
+					ss.To(szEsc, sizeof(szEsc));
+				}
+				++data;
+				--len;
+			}
+		}
+
+		// logfmt quotes just the values with space, '=', '"' or control bytes.
+		inline bool logfmtQuoted(const char *data, size_t len) {
+			for (size_t i = 0; i < len; i++) {
+				if (data[i] == ' ' || data[i] == '=' || gJsonEscape.table[uint8_t(data[i])] != 0) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// appendString writes a string value of the format.
+		template <typename Stream>
+		inline void appendString(Stream &ss, eRecordFormat format, const char *data, size_t len) {
+			if (format == eRecordFormat::textFormat ||
+				(format == eRecordFormat::logfmtFormat && len > 0 && !logfmtQuoted(data, len))) {
+				ss.To(data, len);
+				return;
+			}
+			ss.To("\"", 1);
+			appendEscaped(ss, data, len);
+			ss.To("\"", 1);
+		}
+
+		// appendString writes the string value head + data, without joining them.
+		template <typename Stream>
+		inline void appendString(Stream &ss, eRecordFormat format, const char *head, size_t headLen,
+			const char *data, size_t len) {
+			if (format == eRecordFormat::textFormat || (format == eRecordFormat::logfmtFormat &&
+				headLen + len > 0 && !logfmtQuoted(head, headLen) && !logfmtQuoted(data, len))) {
+				ss.To(head, headLen);
+				ss.To(data, len);
+				return;
+			}
+			ss.To("\"", 1);
+			appendEscaped(ss, head, headLen);
+			appendEscaped(ss, data, len);
+			ss.To("\"", 1);
+		}
+
+		// appendKey writes the separator and key of a field.
+		template <typename Stream>
+		inline void appendKey(Stream &ss, eRecordFormat format, const char *key, size_t len) {
+			if (format == eRecordFormat::jsonFormat) {
+				ss.To(",\"", 2);
+				appendEscaped(ss, key, len);
+				ss.To("\":", 2);
+			} else {
+				ss.To(" ", 1);
+				ss.To(key, len);
+				ss.To("=", 1);
+			}
+		}
+
+		// appendDouble writes a double, json has no nan or inf.
+		template <typename Stream>
+		inline void appendDouble(Stream &ss, eRecordFormat format, double value) {
+			if (format == eRecordFormat::jsonFormat && !(value - value == 0)) {
+				ss.To("null", 4);
+				return;
+			}
+			ss << value;
+		}
+
+		// encodeKvValue writes one value.
+		template <typename Stream, typename T>
+		inline void encodeKvValue(Stream &ss, eRecordFormat format, const T &value) {
+			if constexpr (isLazyArgument<T>) {
+				encodeKvValue(ss, format, lazyValue(value));
+			} else if constexpr (std::is_same<T, bool>::value) {
+				if (value) ss.To("true", 4); else ss.To("false", 5);
+			} else if constexpr (std::is_integral<T>::value) {
+				ss << value;
+			} else if constexpr (std::is_floating_point<T>::value) {
+				appendDouble(ss, format, double(value));
+			} else if constexpr (std::is_same<T, std::string>::value) {
+				appendString(ss, format, value.data(), value.size());
+			} else if constexpr (std::is_convertible<const T&, const char*>::value) {
+				const char *data = value;
+				if (data == nullptr) data = "null";
+				appendString(ss, format, data, strlen(data));
+			} else {
+				// other types render with their {} form, then as a string.
+				SStreamSpace::StreamStringUnlimit<256> tmp;
+				formatArg(tmp, FormatSpec{}, value);
+				appendString(ss, format, tmp.str(), size_t(tmp.len()));
+			}
+		}
+
+		// key/value pairs.
+		template <typename Stream>
+		inline void encodeKvPairs(Stream &ss, eRecordFormat format) {
+			(void)ss;
+			(void)format;
+		}
+		template <typename Stream, typename K, typename V, typename... Args>
+		inline void encodeKvPairs(Stream &ss, eRecordFormat format, const K &key, const V &value, Args&&... rest) {
+			const char *k = key;
+			appendKey(ss, format, k, strlen(k));
+			encodeKvValue(ss, format, value);
+			encodeKvPairs(ss, format, std::forward<Args>(rest)...);
+		}
+
+		// the fixed part of a record: time, level, message and source. the
+		// context(see log_context.h) goes before the message.
+		struct KvRecordInfo {
+			const char *timeInfo{ "" };
+			const char *levelInfo{ "" };
+			const char *context{ "" };
+			size_t contextLen{ 0 };
+			const char *msg{ "" };
+			const char *file{ "" };
+			const char *func{ "" };
+			int line{ 0 };
+		};
+
+		template <typename Stream>
+		inline void encodeKvBegin(Stream &ss, eRecordFormat format, const KvRecordInfo &info) {
+			switch (format) {
+			case eRecordFormat::jsonFormat:
+				ss.To("{\"ts\":\"", 7);
+				ss << info.timeInfo;
+				ss.To("\",\"level\":\"", 11);
+				ss << info.levelInfo;
+				ss.To("\",\"src\":\"", 9);
+				appendEscaped(ss, info.file, strlen(info.file));
+				ss.To(" ", 1);
+				appendEscaped(ss, info.func, strlen(info.func));
+				ss.To(":", 1);
+				ss << info.line;
+				ss.To("\",\"msg\":", 8);
+				appendString(ss, format, info.context, info.contextLen, info.msg, strlen(info.msg));
+				break;
+			case eRecordFormat::logfmtFormat:
+				ss.To("ts=\"", 4);
+				ss << info.timeInfo;
+				ss.To("\" level=", 8);
+				ss << info.levelInfo;
+				ss.To(" src=", 5);
+				ss << info.file;
+				ss.To(":", 1);
+				ss << info.func;
+				ss.To(":", 1);
+				ss << info.line;
+				ss.To(" msg=", 5);
+				appendString(ss, format, info.context, info.contextLen, info.msg, strlen(info.msg));
+				break;
+			default:
+				// the text line, as gLog_out_format.
+				ss << info.timeInfo;
+				ss.To(" [", 2);
+				ss << info.levelInfo;
+				ss.To("] ", 2);
+				ss << info.file;
+				ss.To(" ", 1);
+				ss << info.func;
+				ss.To(":", 1);
+				ss << info.line;
+				ss.To(" ", 1);
+				ss.To(info.context, info.contextLen);
+				ss << info.msg;
+				break;
+			}
+		}
+
+		template <typename Stream>
+		inline void encodeKvEnd(Stream &ss, eRecordFormat format) {
+			if (format == eRecordFormat::jsonFormat) {
+				ss.To("}\n", 2);
+			} else {
+				ss.To("\n", 1);
+			}
+		}
+
+		/* ============================================================== */
+		// the binary form of the asynchronous path:
+		// KvPackedHead, then tagged items: msg, file, func and key/value pairs.
+		struct KvPackedHead {
+			int64_t second{ 0 };
+			int32_t millisecond{ 0 };
+			int32_t line{ 0 };
+		};
+
+		enum eKvTag : uint8_t {
+			kvTagString = 0,
+			kvTagInt,
+			kvTagUint,
+			kvTagDouble,
+			kvTagBool,
+		};
+
+		template <typename Stream>
+		inline void packKvString(Stream &ss, const char *data, size_t len) {
+			char *p = ss.prepare(int(1 + sizeof(uint32_t) + len));
+			p[0] = char(kvTagString);
+			uint32_t n = uint32_t(len);
+			memcpy(p + 1, &n, sizeof(n));
+			memcpy(p + 1 + sizeof(n), data, len);
+			ss.commit(int(1 + sizeof(n) + len));
+		}
+		// packKvString packs head + data as one string.
+		template <typename Stream>
+		inline void packKvString(Stream &ss, const char *head, size_t headLen, const char *data, size_t len) {
+			char *p = ss.prepare(int(1 + sizeof(uint32_t) + headLen + len));
+			p[0] = char(kvTagString);
+			uint32_t n = uint32_t(headLen + len);
+			memcpy(p + 1, &n, sizeof(n));
+			memcpy(p + 1 + sizeof(n), head, headLen);
+			memcpy(p + 1 + sizeof(n) + headLen, data, len);
+			ss.commit(int(1 + sizeof(n) + n));
+		}
+
+		template <typename Stream, typename T>
+		inline void packKvScalar(Stream &ss, eKvTag tag, const T &value) {
+			char *p = ss.prepare(int(1 + sizeof(T)));
+			p[0] = char(tag);
+			memcpy(p + 1, &value, sizeof(T));
+			ss.commit(int(1 + sizeof(T)));
+		}
+
+		template <typename Stream, typename T>
+		inline void packKvValue(Stream &ss, const T &value) {
+			if constexpr (isLazyArgument<T>) {
+				packKvValue(ss, lazyValue(value));
+			} else if constexpr (std::is_same<T, bool>::value) {
+				packKvScalar(ss, kvTagBool, uint8_t(value ? 1 : 0));
+			} else if constexpr (std::is_integral<T>::value && std::is_signed<T>::value) {
+				packKvScalar(ss, kvTagInt, int64_t(value));
+			} else if constexpr (std::is_integral<T>::value) {
+				packKvScalar(ss, kvTagUint, uint64_t(value));
+			} else if constexpr (std::is_floating_point<T>::value) {
+				packKvScalar(ss, kvTagDouble, double(value));
+			} else if constexpr (std::is_same<T, std::string>::value) {
+				packKvString(ss, value.data(), value.size());
+			} else if constexpr (std::is_convertible<const T&, const char*>::value) {
+				const char *data = value;
+				if (data == nullptr) data = "null";
+				packKvString(ss, data, strlen(data));
+			} else {
+				SStreamSpace::StreamStringUnlimit<256> tmp;
+				formatArg(tmp, FormatSpec{}, value);
+				packKvString(ss, tmp.str(), size_t(tmp.len()));
+			}
+		}
+
+		template <typename Stream>
+		inline void packKvPairs(Stream &ss) {
+			(void)ss;
+		}
+		template <typename Stream, typename K, typename V, typename... Args>
+		inline void packKvPairs(Stream &ss, const K &key, const V &value, Args&&... rest) {
+			const char *k = key;
+			packKvString(ss, k, strlen(k));
+			packKvValue(ss, value);
+			packKvPairs(ss, std::forward<Args>(rest)...);
+		}
+
+		// reader of the packed items.
+		class KvPackedReader {
+		public:
+			KvPackedReader(const char *data, size_t len) : m_pos(data), m_end(data + len) {}
+
+			bool empty() const {
+				return m_pos >= m_end;
+			}
+
+			// readString reads a string item.
+			bool readString(const char *&data, size_t &len) {
+				if (m_pos + 1 + sizeof(uint32_t) > m_end || uint8_t(*m_pos) != kvTagString) {
+					return false;
+				}
+				uint32_t n = 0;
+				memcpy(&n, m_pos + 1, sizeof(n));
+				data = m_pos + 1 + sizeof(n);
+				len = n;
+				m_pos = data + n;
+				return m_pos <= m_end;
+			}
+
+			// encodeValue encodes the next value item of any type.
+			template <typename Stream>
+			bool encodeValue(Stream &ss, eRecordFormat format) {
+				if (m_pos >= m_end) {
+					return false;
+				}
+				switch (uint8_t(*m_pos)) {
+				case kvTagString: {
+					const char *data = nullptr;
+					size_t len = 0;
+					if (!this->readString(data, len)) return false;
+					appendString(ss, format, data, len);
+					return true;
+				}
+				case kvTagInt: {
+					int64_t value = 0;
+					if (!this->readScalar(value)) return false;
+					ss << value;
+					return true;
+				}
+				case kvTagUint: {
+					uint64_t value = 0;
+					if (!this->readScalar(value)) return false;
+					ss << value;
+					return true;
+				}
+				case kvTagDouble: {
+					double value = 0;
+					if (!this->readScalar(value)) return false;
+					appendDouble(ss, format, value);
+					return true;
+				}
+				case kvTagBool: {
+					uint8_t value = 0;
+					if (!this->readScalar(value)) return false;
+					if (value) ss.To("true", 4); else ss.To("false", 5);
+					return true;
+				}
+				default:
+					return false;
+				}
+			}
+
+		private:
+			template <typename T>
+			bool readScalar(T &value) {
+				if (m_pos + 1 + sizeof(T) > m_end) {
+					return false;
+				}
+				memcpy(&value, m_pos + 1, sizeof(T));
+				m_pos += 1 + sizeof(T);
+				return true;
+			}
+
+		private:
+			const char *m_pos;
+			const char *m_end;
+		};
+		/*===============================================================*/
+	}
+}
@@ -10,7 +10,9 @@
 *    http://www.boost.org/LICENSE_1_0.txt)
 */
 
+#include <atomic>
 #include <memory>
+#include <new>
 #include <thread>
 #include <functional>
 #include <string>
@@ -20,7 +22,27 @@
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <cstdint>
 #include "variable_parameter_build.h"
+#include "log_record.h"
+#include "kv_encode.h"
+#include "flight_recorder.h"
+#include "log_sink.h"
+#include "log_socket.h"
+#include "log_compress.h"
+#include "log_rotate.h"
+#include "shm_ring.h"
+#include "log_shard.h"
+#include "log_index.h"
+#include "log_metrics.h"
+#include "log_profile.h"
+#include "log_drain.h"
+#include "log_thread.h"
+#include "log_context.h"
+#include "log_timer.h"
+#include "log_process.h"
 #include "semaphore.hpp"
 #include "time.hpp"
 
@@ -71,6 +93,13 @@ namespace anet {
 		// log's asynchronous queue size.
 		static constexpr int gQueueSize = 1024;
 
+		// batches of the synchronous records to the sinks which are reused, and the
+		// buffer a reused batch keeps at most.
+		static constexpr size_t gSync_batch_pool = 4;
+		static constexpr size_t gSync_batch_max_size = 64 * 1024;
+		// the thread local buffer of the large records which is kept at most.
+		static constexpr size_t gLarge_record_keep_size = 64 * 1024;
+
 		// separate the long file to short one.
 		inline const char* shortFileName(const std::string &file) {
 			// compatible for windows and Linux fold separator.
@@ -103,12 +132,9 @@ namespace anet {
 			return data;
 		}
 
-		// get current time.
+		// get the time of {second, millisecond}.
 		template <size_t N>
-		inline const char* buildCurrentTime(char(&timeInfo)[N]) {
-			auto timePair = getTimeInfo();
-			auto ms = timePair.second;
-			auto s = timePair.first;
+		inline const char* buildTime(char(&timeInfo)[N], time_t s, int ms) {
 			auto tm = localtime(&s);
 			int n = std::snprintf(timeInfo, sizeof(timeInfo),
 				"%d-%02d-%02d %02d:%02d:%02d.%03d",
@@ -119,6 +145,13 @@ namespace anet {
 			return timeInfo;
 		}
 
+		// get current time.
+		template <size_t N>
+		inline const char* buildCurrentTime(char(&timeInfo)[N]) {
+			auto timePair = getTimeInfo();
+			return buildTime(timeInfo, timePair.first, timePair.second);
+		}
+
 		// create directory.
 		inline int createDir(const char *dirPath) {
 			int pathLen = int(strlen(dirPath));
@@ -149,15 +182,6 @@ namespace anet {
 			return 0;
 		}
 
-		// log level enum.
-		enum class eLogLevel : int {
-			debugLevel = 0,
-			infoLevel,
-			warnLevel,
-			critLevel,
-			allLevelSize,
-		};
-
 		// file format 
 		static const char *gLog_out_format = "%s [%s] %s";
 
@@ -201,76 +225,509 @@ namespace anet {
 				using streamType = SStreamSpace::StreamStringUnlimit<64>;
 				streamType oss;
 				oss << t;
-				this->debug("%s", oss.str());
+				this->Debug("%s", oss.str());
 				return *this;
 			}
 
 		public:
-			// build variable parameters.
+			// build variable parameters: the whole line is built in ss,
+			// so the message is not truncated as the printf style.
             #define BuildVariableFunc(fmt,level,args,ss) {        \
-               if (!checkLevel(level)) {                          \
+               if (!enabled(level)) {                             \
 			       return;                                        \
                }                                                  \
+			   buildLinePrefix(ss, level);                        \
 		       variable_log(ss, fmt, std::forward<Args>(args)...);\
+			   if (ss.len() == 0 || ss.str()[ss.len() - 1] != '\n') {\
+			       ss.To("\n", 1);                                \
+			   }                                                  \
 		    }
 
-			// support {} as parameter.
+			// output the {} format message with level, synchronously or asynchronously.
+			template <typename Format, typename... Args>
+			void output(eLogLevel level, bool async, const Format &fmt, Args&&... args) {
+				uint64_t start = m_metrics != nullptr ? metricsNow() : 0;
+				SStreamType ss;
+				BuildVariableFunc(fmt, level, args, ss);
+				uint64_t built = start != 0 ? metricsNow() : 0;
+				this->emit(level, async, ss.str(), size_t(ss.len()));
+				this->countProducer(start, built);
+			}
+
+			// support {} and {:spec} as parameter, fmt is a const char* or
+			// a CompiledFormat(see ALOG_FORMAT) parsed at compile time.
+			// an argument may be a callable(see lazy in format_spec.h), invoked only
+			// if the level is enabled, when the record is built.
 			// synchronous and asynchronous mode.
-			template <typename... Args>
-			void debug(const char *fmt, Args&&... args) {
-				SStreamType ss;                        
-				BuildVariableFunc(fmt, eLogLevel::debugLevel, args, ss);
-				this->Debug(ss.str());
+			template <typename Format, typename... Args>
+			void debug(const Format &fmt, Args&&... args) {
+				this->output(eLogLevel::debugLevel, false, fmt, std::forward<Args>(args)...);
 			}
-			template <typename... Args>
-			void Adebug(const char *fmt, Args&&... args) {
-				SStreamType ss;
-				BuildVariableFunc(fmt, eLogLevel::debugLevel, args, ss);
-				this->ADebug(ss.str());
+			template <typename Format, typename... Args>
+			void Adebug(const Format &fmt, Args&&... args) {
+				this->output(eLogLevel::debugLevel, true, fmt, std::forward<Args>(args)...);
 			}
 			// warn
-			template <typename... Args>
-			void warn(const char *fmt, Args&&... args) {
-				SStreamType ss;
-				BuildVariableFunc(fmt, eLogLevel::warnLevel, args, ss);
-				this->Warn(ss.str());
+			template <typename Format, typename... Args>
+			void warn(const Format &fmt, Args&&... args) {
+				this->output(eLogLevel::warnLevel, false, fmt, std::forward<Args>(args)...);
 			}
-			template <typename... Args>
-			void Awarn(const char *fmt, Args&&... args) {
-				SStreamType ss;
-				BuildVariableFunc(fmt, eLogLevel::warnLevel, args, ss);
-				this->AWarn(ss.str());
+			template <typename Format, typename... Args>
+			void Awarn(const Format &fmt, Args&&... args) {
+				this->output(eLogLevel::warnLevel, true, fmt, std::forward<Args>(args)...);
 			}
 
 			// info
-			template <typename... Args>
-			void info(const char *fmt, Args&&... args) {
-				SStreamType ss;
-				BuildVariableFunc(fmt, eLogLevel::infoLevel, args, ss);
-				this->Info(ss.str());
+			template <typename Format, typename... Args>
+			void info(const Format &fmt, Args&&... args) {
+				this->output(eLogLevel::infoLevel, false, fmt, std::forward<Args>(args)...);
 			}
-			template <typename... Args>
-			void Ainfo(const char *fmt, Args&&... args) {
-				SStreamType ss;
-				BuildVariableFunc(fmt, eLogLevel::infoLevel, args, ss);
-				this->AInfo(ss.str());
+			template <typename Format, typename... Args>
+			void Ainfo(const Format &fmt, Args&&... args) {
+				this->output(eLogLevel::infoLevel, true, fmt, std::forward<Args>(args)...);
 			}
 
 			// crit
-			template <typename... Args>
-			void crit(const char *fmt, Args&&... args) {
-				SStreamType ss;
-				BuildVariableFunc(fmt, eLogLevel::critLevel, args, ss);
-				this->Crit(ss.str());
+			template <typename Format, typename... Args>
+			void crit(const Format &fmt, Args&&... args) {
+				this->output(eLogLevel::critLevel, false, fmt, std::forward<Args>(args)...);
+			}
+			template <typename Format, typename... Args>
+			void Acrit(const Format &fmt, Args&&... args) {
+				this->output(eLogLevel::critLevel, true, fmt, std::forward<Args>(args)...);
 			}
+
+			// structured key/value record, args are key, value pairs, a value may be
+			// lazy as the {} arguments.
+			// synchronous records are encoded in place with the instance's format, and
+			// asynchronous ones are packed, then encoded by the writer thread.
 			template <typename... Args>
-			void Acrit(const char *fmt, Args&&... args) {
+			void kv(eLogLevel level, bool async, const char *file, const char *func, int line,
+				const char *msg, Args&&... args) {
+				static_assert(sizeof...(Args) % 2 == 0, "key, value pairs are expected");
+				if (!enabled(level)) {
+					return;
+				}
+				uint64_t start = m_metrics != nullptr ? metricsNow() : 0;
+
+				// the thread's context goes before the message.
+				const LogContextView &context = logContextView();
+				const char *contextData = context.len > 0 ? context.data : "";
+
+				// packed if it goes to the writer thread or to the sinks, which encode it
+				// with their own format.
 				SStreamType ss;
-				BuildVariableFunc(fmt, eLogLevel::critLevel, args, ss);
-				this->ACrit(ss.str());
+				bool routed = checkLevel(level) || sinkLevel(level);
+				if (routed && (async || m_sinks != nullptr) && m_shards == nullptr) {
+					auto timePair = getTimeInfo();
+					KvPackedHead head;
+					head.second = int64_t(timePair.first);
+					head.millisecond = timePair.second;
+					head.line = line;
+					ss.To((const char*)&head, sizeof(head));
+					packKvString(ss, contextData, context.len, msg, strlen(msg));
+					packKvString(ss, file, strlen(file));
+					packKvString(ss, func, strlen(func));
+					packKvPairs(ss, std::forward<Args>(args)...);
+					uint64_t built = start != 0 ? metricsNow() : 0;
+					this->countRecord(level, size_t(ss.len()));
+					if (async) {
+						this->pushQueue(ss.str(), size_t(ss.len()), level, gRecordFlag_kv);
+					} else {
+						this->write(ss.str(), size_t(ss.len()), level, gRecordFlag_kv);
+						this->checkCrit(level);
+					}
+					this->countProducer(start, built);
+				} else {
+					char timeInfo[128];
+					KvRecordInfo info;
+					info.timeInfo = buildCurrentTime(timeInfo);
+					info.levelInfo = getLevelInfo(level);
+					info.context = contextData;
+					info.contextLen = context.len;
+					info.msg = msg;
+					info.file = file;
+					info.func = func;
+					info.line = line;
+					encodeKvBegin(ss, m_recordFormat, info);
+					encodeKvPairs(ss, m_recordFormat, std::forward<Args>(args)...);
+					encodeKvEnd(ss, m_recordFormat);
+					uint64_t built = start != 0 ? metricsNow() : 0;
+					this->emit(level, false, ss.str(), size_t(ss.len()));
+					this->countProducer(start, built);
+				}
+			}
+
+			// binary payload as the classic hex dump, cut only past gHex_max_render_size.
+			void Hex(eLogLevel level, const void *data, size_t len) {
+				this->output(level, false, "{} bytes\n{}", len, hexdump(data, len));
+			}
+			void AHex(eLogLevel level, const void *data, size_t len) {
+				this->output(level, true, "{} bytes\n{}", len, hexdump(data, len));
 			}
 
 		public:
+			// enableFlightRecorder keeps the records of captureLevel and above, which are
+			// below the log level, in an in-memory ring of slotCount slots(slotSize bytes,
+			// gFlight_slot_max_size at most).
+			// the ring is dumped to the log when a crit record is logged if dumpOnCrit,
+			// on dumpFlightRecorder(), or on a fatal signal(see installFatalSignalDump).
+			// call it before logging starts.
+			void enableFlightRecorder(eLogLevel captureLevel = eLogLevel::debugLevel,
+				size_t slotCount = gFlight_slot_count, size_t slotSize = gFlight_slot_size,
+				bool dumpOnCrit = true) {
+				m_recorder = std::make_unique<FlightRecorder>(slotCount, slotSize);
+				m_captureLevel = captureLevel;
+				m_dumpOnCrit = dumpOnCrit;
+			}
+
+			// dump the flight recorder to a side file instead of the current log file.
+			void setFlightRecorderDumpFile(const std::string &path) {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				m_flightDumpPath = path;
+			}
+
+			// dumpFlightRecorder writes the records captured since the last dump,
+			// returns the record count.
+			size_t dumpFlightRecorder() {
+				if (m_recorder == nullptr) {
+					return 0;
+				}
+
+				std::lock_guard<std::mutex> guard(m_mutex);
+				FILE *file = nullptr;
+				if (!m_flightDumpPath.empty()) {
+					file = fopen(m_flightDumpPath.c_str(), "a");
+				} else if (this->prepareFile()) {
+					file = m_fileStream;
+				}
+				if (file == nullptr) {
+					return 0;
+				}
+
+				// the log file goes through writeContent, as it may be compressed(or rotated).
+				bool toLog = file == m_fileStream;
+				auto output = [this, file, toLog](const char *data, size_t len) {
+					if (toLog) {
+						this->writeContent(data, len);
+					} else {
+						fwrite(data, 1, len, file);
+					}
+				};
+				static const char begin[] = "---- flight recorder begin ----\n";
+				output(begin, sizeof(begin) - 1);
+				size_t count = m_recorder->dump(output);
+				char end[64];
+				int n = std::snprintf(end, sizeof(end), "---- flight recorder end: %zu records ----\n", count);
+				output(end, size_t(n));
+				if (!toLog) {
+					fclose(file);
+				} else {
+					this->flushFile();
+				}
+				return count;
+			}
+
+			// dumpFlightRecorderOnSignal dumps with write(2) only, as a signal handler may.
+			// a compressed log file can not take raw bytes, so it is skipped.
+			void dumpFlightRecorderOnSignal() {
+				if (m_recorder == nullptr || m_fileStream == nullptr || m_compress != nullptr) {
+					return;
+				}
+            #if defined(_WIN32)
+				int fd = _fileno(m_fileStream);
+				auto output = [fd](const char *data, size_t len) { _write(fd, data, unsigned(len)); };
+            #else
+				int fd = fileno(m_fileStream);
+				auto output = [fd](const char *data, size_t len) {
+					while (len > 0) {
+						ssize_t n = ::write(fd, data, len);
+						if (n <= 0) break;
+						data += n;
+						len -= size_t(n);
+					}
+				};
+            #endif
+				static const char begin[] = "---- flight recorder begin(fatal signal) ----\n";
+				static const char end[] = "---- flight recorder end ----\n";
+				output(begin, sizeof(begin) - 1);
+				m_recorder->dump(output);
+				output(end, sizeof(end) - 1);
+			}
+
+			// enableCompression compresses the log file(<name>.log.zst or .log.gz) in
+			// independent frames of frameSize bytes or frameMs, on a worker thread.
+			// zstd falls back to gzip if it is not built in, returns false if no
+			// compression is built in, or if the atomic append is enabled. call it
+			// before initLog, or the current file is switched to the compressed one.
+			bool enableCompression(eCompression compression = eCompression::zstdCompression,
+				int level = 3, size_t frameSize = gCompress_frame_size, int frameMs = gCompress_frame_ms) {
+				compression = resolveCompression(compression);
+				if (compression == eCompression::noneCompression) {
+					return false;
+				}
+
+				std::lock_guard<std::mutex> guard(m_mutex);
+				if (m_compress != nullptr) {
+					return m_compress->compression() == compression;
+				}
+				// the processes appending to the file can not share compressed frames.
+				if (m_appender != nullptr) {
+					return false;
+				}
+				if (m_fileStream != nullptr) {
+					fclose(m_fileStream);
+					m_fileStream = nullptr;
+				}
+				m_compress = std::make_unique<CompressStage>(compression, level, frameSize, frameMs);
+				return m_logFilePath.empty() || this->createFile();
+			}
+
+			// enableSharedMemory sends the records to a collector process(see
+			// alog_collector.cpp) through a shared memory ring of capacity bytes,
+			// named "/alog.<name>.<pid>". the local file is used while no collector
+			// is alive. posix only, returns false if the ring can not be created.
+			bool enableSharedMemory(const std::string &name, size_t capacity = gShm_ring_size) {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				if (m_ring != nullptr) {
+					return true;
+				}
+				m_ring = ShmRing::create(name, capacity);
+				return m_ring != nullptr;
+			}
+
+			// enableThreadShards makes every producer thread write its own shard file
+			// next to the log file, <prefix>YYYYMMDD_HH.t<tid>.log, with no lock or
+			// queue shared by the threads(see log_shard.h). the records of the log
+			// level go to the shards only: the asynchronous queue, the ring and the
+			// sinks are bypassed, and alog_merge merges the shards in time order.
+			// call it after setLogInfo, returns false if the log path is not set.
+			bool enableThreadShards() {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				if (m_logFilePath.empty()) {
+					return false;
+				}
+				if (m_shards == nullptr) {
+					m_shards = std::make_unique<ThreadShards>(m_logFilePath, m_prefix, &aLog::openLogFile);
+				}
+				return true;
+			}
+
+			// enableTimeIndex writes a sidecar index <log file>.idx beside every log
+			// file, which maps the seconds to byte offsets(an entry at least every
+			// intervalBytes), so alog_query reads a time range without scanning the
+			// file. compressed files are not indexed.
+			void enableTimeIndex(size_t intervalBytes = gIndex_interval_size) {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				m_indexInterval = intervalBytes > 0 ? intervalBytes : gIndex_interval_size;
+				if (m_fileStream != nullptr && m_compress == nullptr && m_index == nullptr) {
+					m_index = TimeIndexWriter::open(m_filePath, m_indexInterval);
+				}
+			}
+
+			// enableMetrics counts what the log costs(see LogMetrics), per thread so
+			// the producers do not contend, read with metrics(). with reportSeconds,
+			// the writer thread logs a metrics line at info level that often. call it
+			// before logging starts.
+			void enableMetrics(int reportSeconds = 0) {
+				if (m_metrics == nullptr) {
+					m_metrics = std::make_unique<MetricsRegistry>();
+				}
+				m_lastReportMs = GetNowMSTime();
+				m_metricsReportMs = reportSeconds > 0 ? reportSeconds * 1000 : 0;
+			}
+
+			// enableScopeTimerReport makes the writer thread log the summary line of the
+			// LOG_SCOPE_TIMER_STATS sites every reportSeconds(0 stops it).
+			void enableScopeTimerReport(int reportSeconds) {
+				tscNsPerTick();
+				m_lastTimerReportMs = GetNowMSTime();
+				m_timerReportMs = reportSeconds > 0 ? reportSeconds * 1000 : 0;
+			}
+
+			// metrics returns a snapshot of the metrics, the counters are zero if they
+			// are not enabled.
+			LogMetrics metrics() const {
+				LogMetrics metrics;
+				if (m_metrics != nullptr) {
+					m_metrics->collect(metrics);
+				}
+				{
+					std::lock_guard<std::mutex> guard(m_asyncMutex);
+					metrics.queueDepth = m_queue.size();
+					metrics.queueHighWater = m_queueHighWater;
+				}
+				if (m_sinks != nullptr) {
+					metrics.sinkDropped = m_sinks->dropped();
+					metrics.sinkPending = m_sinks->pendingSize();
+				}
+				std::lock_guard<std::mutex> guard(m_mutex);
+				if (m_ring != nullptr) {
+					metrics.ringFallbacks = m_ring->dropped();
+				}
+				return metrics;
+			}
+
+			// dumpSiteProfile logs the table of the topN call sites of the most
+			// producer's time at info level(see log_profile.h), returns the sites.
+			size_t dumpSiteProfile(size_t topN = 20) {
+				auto profiles = SiteProfiler::instance().top(topN);
+				this->output(eLogLevel::infoLevel, false, "alog call sites, top {}\n{}", profiles.size(),
+					formatSiteProfile(profiles));
+				return profiles.size();
+			}
+
+			// appendBatch appends framed records(see log_record.h) to the asynchronous
+			// queue as they are, it is how the collector writes the drained rings.
+			void appendBatch(const char *batch, size_t len) {
+				m_asyncMutex.lock();
+				bool wasEmpty = m_queue.empty();
+				m_queue.append(batch, len);
+				this->markQueue();
+				m_asyncMutex.unlock();
+				this->wakeWriter(wasEmpty);
+			}
+
+			// enableAtomicAppend makes the processes which append to the same log file
+			// interleave whole records only: the records are written in batches of
+			// maxWrite bytes at most with one write(2) each(see log_process.h), with no
+			// lock across the processes. the time index is not kept then, as the
+			// offsets are not known. posix only, uncompressed files only.
+			bool enableAtomicAppend(size_t maxWrite = gAtomic_write_size) {
+        #if defined(_WIN32)
+				(void)maxWrite;
+				return false;
+        #else
+				std::lock_guard<std::mutex> guard(m_mutex);
+				if (m_compress != nullptr) {
+					return false;
+				}
+				if (m_fileStream != nullptr) {
+					fflush(m_fileStream);
+				}
+				m_appender = std::make_unique<AtomicAppender>(maxWrite);
+				m_index.reset();
+				return true;
+        #endif
+			}
+
+			// enableExternalDrain leaves the asynchronous queue to the application's
+			// event loop, no writer thread is started: poll the returned fd(-1 on
+			// windows) for reading, and call drain when it is readable, and at least
+			// every asyncWriteTime ms(the compressed frames are sealed by the time).
+			// call it before initLog.
+			int enableExternalDrain() {
+				if (m_th == nullptr && m_drain == nullptr) {
+					m_drain = std::make_unique<DrainNotifier>();
+				}
+				return m_drain != nullptr ? m_drain->fd() : -1;
+			}
+			int drainFd() const {
+				return m_drain != nullptr ? m_drain->fd() : -1;
+			}
+
+			// drain writes the queued records of about maxBytes at most(whole records,
+			// one at least), in steps of gDrain_step_size until the deadline, returns
+			// the bytes drained. the fd is cleared once the queue is empty. call it
+			// from one thread.
+			size_t drain(size_t maxBytes = SIZE_MAX,
+				std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) {
+				if (m_drain == nullptr) {
+					return 0;
+				}
+				size_t drained = 0;
+				while (drained < maxBytes) {
+					if (m_drainOffset >= m_drainBuffer.size()) {
+						m_drainBuffer.clear();
+						m_drainOffset = 0;
+						std::lock_guard<std::mutex> lg(m_asyncMutex);
+						if (m_queue.empty()) {
+							m_drain->clear();
+							break;
+						}
+						m_queue.swap(m_drainBuffer);
+						if (m_queue.capacity() == 0) {
+							m_queue.reserve(gQueueSize);
+						}
+					}
+
+					// a step of whole records.
+					size_t step = maxBytes - drained < gDrain_step_size ? maxBytes - drained : gDrain_step_size;
+					size_t end = m_drainOffset;
+					while (end + sizeof(RecordHeader) <= m_drainBuffer.size()) {
+						RecordHeader header;
+						memcpy(&header, &m_drainBuffer[end], sizeof(header));
+						size_t next = end + sizeof(header) + header.len;
+						if (next > m_drainBuffer.size() || (end > m_drainOffset && next - m_drainOffset > step)) {
+							break;
+						}
+						end = next;
+					}
+					if (end == m_drainOffset) {
+						// a torn tail, which can not be.
+						m_drainOffset = m_drainBuffer.size();
+						continue;
+					}
+					if (m_metrics != nullptr) {
+						m_metrics->batch(end - m_drainOffset);
+					}
+					drained += end - m_drainOffset;
+					if (m_drainOffset == 0 && end == m_drainBuffer.size()) {
+						this->doWriteLog(m_drainBuffer);
+						m_drainBuffer.clear();
+					} else {
+						this->doWriteLog(&m_drainBuffer[m_drainOffset], end - m_drainOffset);
+					}
+					m_drainOffset = end;
+					if (std::chrono::steady_clock::now() >= deadline) {
+						break;
+					}
+				}
+				if (drained == 0) {
+					// seal the compressed frame which is due.
+					this->tickCompress();
+				}
+				this->tickWriter(GetNowMSTime());
+				return drained;
+			}
+
+			// setRotation rotates the log file by size besides the hour, and deletes
+			// the oldest files beyond the retention limits(see RotatePolicy). a helper
+			// thread opens and preallocates the next files ahead and deletes the old
+			// ones, so the writer never blocks on the file system at the boundary.
+			// the size is counted before compression.
+			void setRotation(const RotatePolicy &policy) {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				m_preparer = std::make_unique<FilePreparer>(policy, &aLog::openLogFile);
+				if (m_fileStream != nullptr) {
+					this->prepareNext(getTimeInfo().first);
+				}
+			}
+
+			// addSink adds a sink besides the log file, which gets the records of its
+			// own level(even below the log level) in its own format. every sink drains
+			// the shared record batches on its own thread, so a slow one does not
+			// block the file or the other sinks. call it before logging starts.
+			void addSink(std::shared_ptr<LogSink> sink) {
+				if (sink == nullptr) {
+					return;
+				}
+				if (m_sinks == nullptr) {
+					m_sinks = std::make_unique<SinkDispatcher>([this](SStreamType &ss, eRecordFormat format,
+						eLogLevel level, const char *data, size_t len) {
+						return this->encodeKvRecord(ss, format, level, data, len);
+					});
+				}
+				m_sinks->addSink(std::move(sink));
+				m_sinkLevel = m_sinks->minLevel();
+			}
+
+			// whether a record of the level is written, delivered to a sink or captured
+			// by the flight recorder.
+			inline bool enabled(eLogLevel level) const {
+				return checkLevel(level) || sinkLevel(level) || captureLevel(level);
+			}
+
 			bool setLevel(int level) {
 				if (level > int(eLogLevel::critLevel) || level < int(eLogLevel::debugLevel)) {
 					return false;
@@ -282,55 +739,34 @@ namespace anet {
 				return int(m_logLevel);
 			}
 
-			// build variadic parameter macro, adding "\n" at tail.
-        #define buildFuncParameter(fmt,myPrintfBuf,myBufferSize) {\
-			va_list args;                                \
-			va_start(args,fmt);                          \
-			int n = std::vsnprintf(myPrintfBuf,(myBufferSize)-1,fmt,args);\
-            if (n < 0 || n > myBufferSize) return ;      \
-                                                         \
-			if (n <= int((myBufferSize) - 2)) {          \
-				(myPrintfBuf)[n] = '\n';                 \
-				(myPrintfBuf)[n+1] = 0;                  \
-			} else {                                     \
-				(myPrintfBuf)[(myBufferSize) - 2] = '\n';\
-				(myPrintfBuf)[(myBufferSize) - 1] = 0;   \
-			}                                            \
-			va_end(args);                                \
-		  } // end of macro.
-
-			  // output message with level and time information synchronously.
+			// record format of the key/value records.
+			void setRecordFormat(eRecordFormat format) {
+				m_recordFormat = format;
+			}
+			eRecordFormat getRecordFormat() const {
+				return m_recordFormat;
+			}
+
+			// output message with level and time information synchronously.
         #define LevelOutput(fmt,level) {        \
-            if (!checkLevel(level)) {           \
+            if (!enabled(level)) {              \
 			    return;                         \
             }                                   \
-			                                    \
-		    char timeInfo[128];                 \
-		    buildCurrentTime(timeInfo);         \
-				                                \
-		    char myPrintfBuf[gLog_data_size];   \
-		    buildFuncParameter(fmt, myPrintfBuf, gLog_data_size);\
-				                                \
-		    char allBuff[gLog_max_size];        \
-		    std::snprintf(allBuff, sizeof(allBuff), gLog_out_format, timeInfo, getLevelInfo(level), myPrintfBuf); \
-		    this->write(allBuff);               \
+			va_list args;                       \
+			va_start(args, fmt);                \
+			this->vOutput(level, false, fmt, args);\
+			va_end(args);                       \
           }
 
 			// output message with level and time information asynchronously.
         #define ALevelOutput(fmt,level) {       \
-            if (!checkLevel(level)) {           \
+            if (!enabled(level)) {              \
 			    return;                         \
             }                                   \
-			                                    \
-		    char timeInfo[128];                 \
-		    buildCurrentTime(timeInfo);         \
-				                                \
-		    char myPrintfBuf[gLog_data_size];   \
-		    buildFuncParameter(fmt, myPrintfBuf, gLog_data_size);\
-				                                \
-		    char allBuff[gLog_max_size];        \
-		    std::snprintf(allBuff, sizeof(allBuff)-1, gLog_out_format, timeInfo, getLevelInfo(level), myPrintfBuf); \
-		    this->pushQueue(allBuff);           \
+			va_list args;                       \
+			va_start(args, fmt);                \
+			this->vOutput(level, true, fmt, args);\
+			va_end(args);                       \
           }
 
 		public:
@@ -363,24 +799,146 @@ namespace anet {
 			}
 
 		protected:
+			// vOutput formats the printf style message with its line prefix.
+			// the size is measured first: lines which fit gLog_max_size are built on
+			// the stack, and larger ones in a thread local buffer, once.
+			void vOutput(eLogLevel level, bool async, const char *fmt, va_list args) {
+				uint64_t start = m_metrics != nullptr ? metricsNow() : 0;
+				char allBuff[gLog_max_size];
+				int prefixLen = buildLinePrefix(allBuff, level);
+
+				va_list measureArgs;
+				va_copy(measureArgs, args);
+				int n = std::vsnprintf(allBuff + prefixLen, sizeof(allBuff) - prefixLen, fmt, measureArgs);
+				va_end(measureArgs);
+				if (n < 0) {
+					return;
+				}
+
+				// the common small case, and the flight recorder which keeps the head.
+				size_t total = size_t(prefixLen) + size_t(n) + 1;
+				if (total < sizeof(allBuff) || !(checkLevel(level) || sinkLevel(level))) {
+					if (total > sizeof(allBuff)) {
+						total = sizeof(allBuff);
+					}
+					allBuff[total - 1] = '\n';
+					uint64_t built = start != 0 ? metricsNow() : 0;
+					this->emit(level, async, allBuff, total);
+					this->countProducer(start, built);
+					return;
+				}
+
+				// large record, formatted into a thread local buffer out of the queue's
+				// lock, which is held for the copy only(see pushQueue). the buffer is
+				// released after a record beyond gLarge_record_keep_size.
+				static thread_local std::string largeBuff;
+				if (largeBuff.size() < total) {
+					largeBuff.resize(total);
+				}
+				char *record = &largeBuff[0];
+				memcpy(record, allBuff, size_t(prefixLen));
+				std::vsnprintf(record + prefixLen, size_t(n) + 1, fmt, args);
+				record[total - 1] = '\n';
+				uint64_t built = start != 0 ? metricsNow() : 0;
+				this->emit(level, async, record, total);
+				this->countProducer(start, built);
+				if (largeBuff.size() > gLarge_record_keep_size) {
+					std::string().swap(largeBuff);
+				}
+			}
+
+			// emit hands a built line to the queue or the file(and the sinks), or to
+			// the thread's shard, or to the flight recorder if it is below the log level.
+			void emit(eLogLevel level, bool async, const char *data, size_t len) {
+				if (!checkLevel(level) && captureLevel(level)) {
+					m_recorder->record(data, len);
+				}
+				if (!checkLevel(level) && !sinkLevel(level)) {
+					return;
+				}
+				this->countRecord(level, len);
+				if (m_shards != nullptr) {
+					if (checkLevel(level)) {
+						m_shards->write(level, data, len);
+					}
+				} else if (async) {
+					this->pushQueue(data, len, level);
+				} else {
+					this->write(data, len, level);
+				}
+				this->checkCrit(level);
+			}
+
+			// metrics of the producer: the records, and the time building and handing over.
+			inline void countRecord(eLogLevel level, size_t len) {
+				if (m_metrics != nullptr) {
+					m_metrics->record(level, len);
+				}
+        #if defined(ALOG_PROFILE_SITES)
+				siteRecordBytes() += len;
+        #endif
+			}
+			inline void countProducer(uint64_t start, uint64_t built) {
+				if (start != 0) {
+					m_metrics->produce(built - start, metricsNow() - built);
+				}
+			}
+
+			// wakeWriter wakes the writer thread, or makes the drain fd readable when
+			// the queue turns non-empty.
+			inline void wakeWriter(bool wasEmpty) {
+				if (m_drain == nullptr) {
+					m_sem.signal();
+				} else if (wasEmpty) {
+					m_drain->notify();
+				}
+			}
+
+			// markQueue keeps the queue's high water mark, m_asyncMutex must be held.
+			inline void markQueue() {
+				if (m_queue.size() > m_queueHighWater) {
+					m_queueHighWater = m_queue.size();
+				}
+			}
+
+			// dump the flight recorder when a crit record is logged.
+			inline void checkCrit(eLogLevel level) {
+				if (level == eLogLevel::critLevel && m_dumpOnCrit && m_recorder != nullptr) {
+					this->dumpFlightRecorder();
+				}
+			}
+
 			// pushQueue pushes log message to the asynchronous queue.
-			void pushQueue(const std::string &msg) {
+			void pushQueue(const std::string &msg, eLogLevel level) {
+				this->pushQueue(msg.c_str(), msg.size(), level);
+			}
+			void pushQueue(const char *msg, size_t len, eLogLevel level, uint8_t flags = 0) {
+				RecordHeader header;
+				header.len = uint32_t(len);
+				header.level = uint8_t(level);
+				header.flags = flags;
 				m_asyncMutex.lock();
-				m_queue.append(msg);
+				bool wasEmpty = m_queue.empty();
+				m_queue.append((const char*)&header, sizeof(header));
+				m_queue.append(msg, len);
+				this->markQueue();
 				m_asyncMutex.unlock();
 
 				// signal that the semaphore is ready.
-				m_sem.signal();
+				this->wakeWriter(wasEmpty);
 			}
 
 			// thread function to write the queue's message to the local file.
 			void threadFunc() {
+				uint64_t placed = ~uint64_t(0);
+				placeLogThread("writer", placed);
 				std::string swapQueue;
 				swapQueue.reserve(gQueueSize);
 				long long lastLogTime = GetNowMSTime();
 				while (!m_quit) {
 					// wait for notify or time out after the delayTime time.
 					m_sem.wait_for(std::chrono::milliseconds(m_asyncToFileMs));
+					placeLogThread("writer", placed);
 	
 					// real time check.
 					auto nowTime = GetNowMSTime();
@@ -391,27 +949,135 @@ namespace anet {
 
 					// do write log.
 					this->tryToWrite(swapQueue);
+					this->tickWriter(nowTime);
 				}
 
 				// try to write all log messages if the thread exits.
 				this->tryToWrite(swapQueue);
 			}
+			// tickWriter does the writer's periodic work besides the queue.
+			void tickWriter(long long nowMs) {
+				this->reportMetrics(nowMs);
+				this->reportScopeTimers(nowMs);
+				if (SiteProfiler::instance().takeDumpRequest()) {
+					this->dumpSiteProfile();
+				}
+			}
 			inline void tryToWrite(std::string& swapQueue) {
 				{// swap queue lock.
 					std::lock_guard<std::mutex> lg(m_asyncMutex);
-					if (m_queue.empty()) {
-						return ;
+					if (!m_queue.empty()) {
+						m_queue.swap(swapQueue);
 					}
-					m_queue.swap(swapQueue);
+				}
+				if (swapQueue.empty()) {
+					// seal the compressed frame which is due.
+					this->tickCompress();
+					return ;
 				}
 
 				// write to log file.
+				if (m_metrics != nullptr) {
+					m_metrics->batch(swapQueue.size());
+				}
 				this->doWriteLog(swapQueue);
 				swapQueue.clear();
+				if (swapQueue.capacity() == 0) {
+					swapQueue.reserve(gQueueSize);
+				}
+			}
+
+			// doWriteLog writes all framed records of the log level with one lock and
+			// one flush, then hands the batch over to the sinks(allMsg is moved).
+			inline void doWriteLog(std::string &allMsg) {
+				this->writeBatch(allMsg.data(), allMsg.size());
+				if (m_sinks != nullptr) {
+					m_sinks->publish(std::make_shared<const std::string>(std::move(allMsg)));
+				}
+			}
+			// doWriteLog of a slice of whole framed records, which is copied for the
+			// sinks only.
+			inline void doWriteLog(const char *batch, size_t len) {
+				this->writeBatch(batch, len);
+				if (m_sinks != nullptr) {
+					m_sinks->publish(std::make_shared<const std::string>(batch, len));
+				}
+			}
+
+			// writeBatch writes the framed records of a batch, see doWriteLog.
+			void writeBatch(const char *batch, size_t len) {
+				// records go to the collector's ring while it is alive, and to the
+				// local file otherwise(or if the ring is full).
+				std::lock_guard<std::mutex> guard(m_mutex);
+				bool toRing = m_ring != nullptr && m_ring->collectorAlive();
+				bool fileReady = !toRing && this->prepareFile();
+				bool written = false;
+				if (toRing || fileReady) {
+					forEachRecord(batch, len, [&](const RecordHeader &header, const char *data) {
+						written = this->writeRecord(eLogLevel(header.level), header.flags, data, header.len,
+							toRing, fileReady) || written;
+					});
+				}
+				if (written) {
+					this->flushFile();
+				}
+			}
+
+			// writeRecord writes a record of the log level to the collector's ring, or
+			// to the local file if the ring is off or full, returns whether the file is
+			// written. m_mutex must be held.
+			bool writeRecord(eLogLevel level, uint8_t flags, const char *data, size_t len,
+				bool toRing, bool &fileReady) {
+				if (!checkLevel(level)) {
+					return false;
+				}
+				if (toRing && this->pushRing(level, flags, data, len)) {
+					return false;
+				}
+				if (!fileReady && !(fileReady = this->prepareFile())) {
+					return false;
+				}
+				if ((flags & gRecordFlag_kv) != 0) {
+					this->writeKvRecord(level, data, len);
+				} else {
+					this->writeContent(data, len);
+				}
+				return true;
+			}
+
+			// syncBatch returns a batch for a synchronous record to the sinks: a batch
+			// of the pool which all sinks have drained is reused with its buffer, so a
+			// record costs no allocation. m_mutex must be held.
+			std::shared_ptr<std::string> syncBatch() {
+				for (auto &batch : m_syncBatches) {
+					if (batch.use_count() == 1) {
+						// pairs with the release of the sinks' references.
+						std::atomic_thread_fence(std::memory_order_acquire);
+						batch->clear();
+						if (batch->capacity() > gSync_batch_max_size) {
+							batch->shrink_to_fit();
+						}
+						return batch;
+					}
+				}
+				auto batch = std::make_shared<std::string>();
+				if (m_syncBatches.size() < gSync_batch_pool) {
+					m_syncBatches.push_back(batch);
+				}
+				return batch;
 			}
 
-			inline void doWriteLog(const std::string &allMsg) {
-				this->write(allMsg.c_str());
+			// pushRing pushes a record to the collector's ring, key/value records are
+			// encoded first. m_mutex must be held.
+			bool pushRing(eLogLevel level, uint8_t flags, const char *data, size_t len) {
+				if ((flags & gRecordFlag_kv) == 0) {
+					return m_ring->push(level, data, len);
+				}
+				SStreamType ss;
+				if (!this->encodeKvRecord(ss, m_recordFormat, level, data, len)) {
+					return true;
+				}
+				return m_ring->push(level, ss.str(), size_t(ss.len()));
 			}
 
 			// whether is the same (year,month,day,hour) date.
@@ -425,52 +1091,304 @@ namespace anet {
 					m_hour == tm->tm_hour;
 			}
 
-			// write content to log file synchronously.
-			void write(const char *content) {
+			// write content to log file(and the sinks) synchronously.
+			void write(const char *content, eLogLevel level) {
 				if (content == nullptr) {
 					return;
 				}
+				this->write(content, strlen(content), level);
+			}
+			void write(const char *content, size_t len, eLogLevel level, uint8_t flags = 0) {
+				std::shared_ptr<std::string> batch;
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					bool toRing = m_ring != nullptr && m_ring->collectorAlive();
+					bool fileReady = !toRing && this->prepareFile();
+					if ((toRing || fileReady) && this->writeRecord(level, flags, content, len, toRing, fileReady)) {
+						this->flushFile();
+					}
 
-				std::lock_guard<std::mutex> guard(m_mutex);
+					// the sinks share a batch of the one record.
+					if (m_sinks != nullptr) {
+						RecordHeader header;
+						header.len = uint32_t(len);
+						header.level = uint8_t(level);
+						header.flags = flags;
+						batch = this->syncBatch();
+						batch->reserve(sizeof(header) + len);
+						batch->append((const char*)&header, sizeof(header));
+						batch->append(content, len);
+					}
+				}
+				if (batch != nullptr) {
+					m_sinks->publish(std::move(batch));
+				}
+			}
 
-				// check whether the date is changed.
+			// prepareFile checks whether the date is changed, and switches to the
+			// new file if so. m_mutex must be held.
+			bool prepareFile() {
 				if (!isTheSameDate()) {
-					// close before file.
-					if (m_fileStream != nullptr) {
-						fclose(m_fileStream);
-						m_fileStream = nullptr;
+					if (!this->switchFile(true)) {
+						return false;
 					}
+				}
+				assert(m_fileStream != nullptr && "file stream is nullptr");
+				return m_fileStream != nullptr;
+			}
 
-					// create subFold;
-					char data[gLog_data_size];
-					auto &&subFold = m_logFilePath + "/" + getDateInfo(data);
-					if (createDir(subFold.c_str()) < 0) {
-						return;
+			// switchFile switches to the file of the current hour(index 0 if the hour is
+			// changed, or the next index), which is just a pointer swap if the helper
+			// has prepared it. the former file is closed by the helper, or by the compress
+			// worker if it is compressed. m_mutex must be held.
+			bool switchFile(bool timeSwitch) {
+				uint64_t start = m_metrics != nullptr && m_fileStream != nullptr ? metricsNow() : 0;
+				auto s = getTimeInfo().first;
+				struct tm t = *localtime(&s);
+				int index = timeSwitch || m_fileStream == nullptr ? 0 : m_fileIndex + 1;
+				std::string path = this->buildFileName(t, index);
+
+				FILE *file = m_preparer != nullptr ? m_preparer->take(path) : nullptr;
+				if (file == nullptr) {
+					file = openLogFile(path);
+					if (file == nullptr) {
+						return false;
 					}
+				}
 
-					// create a log file.
-					if (!createFile()) {
-						return;
+				// close before file, a compressed file is closed by the compress worker.
+				if (m_fileStream != nullptr) {
+					if (m_compress != nullptr) {
+						m_compress->retire(m_fileStream);
+					} else {
+						this->finishFile();
+						if (m_preparer != nullptr) {
+							// flushed here, so the files' write times keep their order.
+							fflush(m_fileStream);
+							m_preparer->retire(m_fileStream);
+						} else {
+							fclose(m_fileStream);
+						}
 					}
 				}
+				m_fileStream = file;
+				m_filePath = std::move(path);
+				m_fileIndex = index;
+				m_fileSize = fileSize(file);
+
+				// the index of the new file.
+				m_index.reset();
+				if (m_indexInterval > 0 && m_compress == nullptr && m_appender == nullptr) {
+					m_index = TimeIndexWriter::open(m_filePath, m_indexInterval);
+				}
+
+				// record time info.
+				m_year = t.tm_year;
+				m_month = t.tm_mon;
+				m_day = t.tm_mday;
+				m_hour = t.tm_hour;
+
+				this->prepareNext(s);
+				if (start != 0) {
+					m_metrics->rotate(metricsNow() - start);
+				}
+				return true;
+			}
+
+			// prepareNext asks the helper to open the next size rotated file and the
+			// next hour's file ahead, and to apply the retention limits.
+			void prepareNext(time_t now) {
+				if (m_preparer == nullptr) {
+					return;
+				}
+				std::vector<std::string> paths;
+				struct tm t = *localtime(&now);
+				if (m_preparer->policy().maxFileSize > 0) {
+					paths.push_back(this->buildFileName(t, m_fileIndex + 1));
+				}
+				time_t nextHour = now - t.tm_min * 60 - t.tm_sec + 3600;
+				t = *localtime(&nextHour);
+				paths.push_back(this->buildFileName(t, 0));
+				m_preparer->prepare(std::move(paths));
+				m_preparer->retain(m_logFilePath, m_prefix, m_filePath);
+			}
+
+			// buildFileName builds <path>/<YYYYMMDD>/<prefix>YYYYMMDD_HH[.index].log,
+			// see buildLogFileName.
+			std::string buildFileName(const struct tm &t, int index) const {
+				return buildLogFileName(m_logFilePath, m_prefix, t, index,
+					m_compress != nullptr ? compressionSuffix(m_compress->compression()) : "");
+			}
+
+			// openLogFile creates the date folder and opens the file for appending,
+			// compressed files are binary.
+			static FILE* openLogFile(const std::string &path) {
+				auto pos = path.rfind('/');
+				if (pos != std::string::npos && createDir(path.substr(0, pos).c_str()) < 0) {
+					return nullptr;
+				}
+				bool text = path.size() >= 4 && path.compare(path.size() - 4, 4, ".log") == 0;
+				return fopen(path.c_str(), text ? "a+" : "ab");
+			}
+
+			// writeKvRecord encodes a packed key/value record and writes it.
+			void writeKvRecord(eLogLevel level, const char *data, size_t len) {
+				SStreamType ss;
+				if (this->encodeKvRecord(ss, m_recordFormat, level, data, len)) {
+					this->writeContent(ss.str(), size_t(ss.len()));
+				}
+			}
+
+			// encodeKvRecord encodes a packed key/value record with the format.
+			template <typename Stream>
+			bool encodeKvRecord(Stream &ss, eRecordFormat format, eLogLevel level,
+				const char *data, size_t len) const {
+				KvPackedHead head;
+				if (len < sizeof(head)) {
+					return false;
+				}
+				memcpy(&head, data, sizeof(head));
+				KvPackedReader reader(data + sizeof(head), len - sizeof(head));
 
+				const char *msg = nullptr, *file = nullptr, *func = nullptr;
+				size_t msgLen = 0, fileLen = 0, funcLen = 0;
+				if (!reader.readString(msg, msgLen) || !reader.readString(file, fileLen) ||
+					!reader.readString(func, funcLen)) {
+					return false;
+				}
+
+				// the packed strings are not 0 terminated.
+				SStreamSpace::StreamStringUnlimit<256> names;
+				names.To(msg, msgLen).AddZero();
+				names.To(file, fileLen).AddZero();
+				names.To(func, funcLen).AddZero();
+
+				char timeInfo[128];
+				KvRecordInfo info;
+				info.timeInfo = buildTime(timeInfo, time_t(head.second), head.millisecond);
+				info.levelInfo = getLevelInfo(level);
+				info.msg = names.str();
+				info.file = info.msg + msgLen + 1;
+				info.func = info.file + fileLen + 1;
+				info.line = head.line;
+
+				encodeKvBegin(ss, format, info);
+				while (!reader.empty()) {
+					const char *key = nullptr;
+					size_t keyLen = 0;
+					if (!reader.readString(key, keyLen)) {
+						break;
+					}
+					appendKey(ss, format, key, keyLen);
+					if (!reader.encodeValue(ss, format)) {
+						break;
+					}
+				}
+				encodeKvEnd(ss, format);
+				return true;
+			}
+
+			// writeContent writes to the file without flushing, m_mutex must be held.
+			void writeContent(const char *content, size_t len) {
 				// window's output
                 #ifdef _WIN32
-				  printf("%s", content);
+				  printf("%.*s", int(len), content);
                 #endif
 
-				assert(m_fileStream != nullptr && "file stream is nullptr");
-				if (m_fileStream != nullptr) {
-					// log file output
-					fputs(content, m_fileStream);
+				// size rotation, the former file is kept if the switch fails.
+				if (m_preparer != nullptr && m_preparer->policy().maxFileSize > 0 &&
+					m_fileSize >= m_preparer->policy().maxFileSize) {
+					this->switchFile(false);
+				}
+
+				// log file output
+				if (m_index != nullptr) {
+					m_index->record(content, len, m_fileSize);
+				}
+				uint64_t start = m_metrics != nullptr ? metricsNow() : 0;
+				m_fileSize += len;
+				if (m_compress != nullptr) {
+					m_compress->write(m_fileStream, content, len);
+				} else if (m_appender != nullptr) {
+					m_appender->append(fileno(m_fileStream), content, len);
+				} else {
+					fwrite(content, 1, len, m_fileStream);
+				}
+				if (start != 0) {
+					m_metrics->write(metricsNow() - start);
+				}
+			}
+
+			// flushFile flushes the file, or seals the compressed frame which is due.
+			// m_mutex must be held.
+			void flushFile() {
+				uint64_t start = m_metrics != nullptr ? metricsNow() : 0;
+				if (m_compress != nullptr) {
+					m_compress->tick(m_fileStream);
+				} else if (m_appender != nullptr) {
+					// the other processes' appends count for the size rotation.
+					m_appender->flush(fileno(m_fileStream));
+					m_fileSize = fileSize(m_fileStream);
+				} else {
 					fflush(m_fileStream);
 				}
+				if (m_index != nullptr) {
+					m_index->flush();
+				}
+				if (start != 0) {
+					m_metrics->flush(metricsNow() - start);
+				}
+			}
+			void tickCompress() {
+				if (m_compress != nullptr) {
+					std::lock_guard<std::mutex> guard(m_mutex);
+					if (m_fileStream != nullptr) {
+						m_compress->tick(m_fileStream);
+					}
+				}
+			}
+
+			// finishFile writes the atomic appender's batch before the file is closed.
+			// m_mutex must be held.
+			void finishFile() {
+				if (m_appender != nullptr) {
+					m_appender->flush(fileno(m_fileStream));
+				}
 			}
 
 			inline const char* getLevelInfo(eLogLevel level) const {
 				return m_levels[int(level)];
 			}
 
+			// build the line prefix "time [level] " as gLog_out_format, and the
+			// thread's rendered context(see log_context.h), returns its size. the
+			// context takes half of the buffer at most.
+			inline int buildLinePrefix(char(&buff)[gLog_max_size], eLogLevel level) const {
+				char timeInfo[128];
+				int n = std::snprintf(buff, sizeof(buff), gLog_out_format,
+					buildCurrentTime(timeInfo), getLevelInfo(level), "");
+				n = n > 0 ? n : 0;
+				const LogContextView &context = logContextView();
+				if (context.len > 0) {
+					size_t len = context.len < sizeof(buff) / 2 ? context.len : sizeof(buff) / 2;
+					memcpy(buff + n, context.data, len);
+					n += int(len);
+				}
+				return n;
+			}
+			template <typename Stream>
+			inline void buildLinePrefix(Stream &ss, eLogLevel level) const {
+				char timeInfo[128];
+				ss << buildCurrentTime(timeInfo);
+				ss.To(" [", 2);
+				ss << getLevelInfo(level);
+				ss.To("] ", 2);
+				const LogContextView &context = logContextView();
+				if (context.len > 0) {
+					ss.To(context.data, context.len);
+				}
+			}
+
 			// initLog initializes the log module.
 			bool initLog() {
 				// create directory
@@ -485,63 +1403,209 @@ namespace anet {
 					return false;
 				}
 
-				// create the log file.
+				// the tick of the scope timers is measured here, not on a timed thread.
+				tscNsPerTick();
+
+				// create the log file, the queue is drained by the writer thread or the
+				// application(see enableExternalDrain).
 				if (createFile()) {
-					m_th = std::make_unique<std::thread>(std::bind(&aLog::threadFunc, this));
+					if (m_drain == nullptr) {
+						m_th = std::make_unique<std::thread>(std::bind(&aLog::threadFunc, this));
+					}
+					ForkRegistry::instance().add(this, &aLog::onFork);
 					return true;
 				} else {
 					return false;
 				}
 			}
 
-			// create file.
-			bool createFile() {
-				char fileName[gPath_max_size];
+			// onFork keeps the log usable across fork(see ForkRegistry): the locks(and
+			// the thread shards') are held over it and the files are flushed, so the
+			// child inherits neither a held lock nor buffered bytes. the child drops the
+			// parent's queued records, which the parent writes, and restarts its writer.
+			// the helper threads do not survive the fork, so the child logs without the
+			// parent's sinks, rotation helper, compression(into the plain file of the
+			// hour), ring and time index, and gets its own drain fd.
+			static void onFork(void *owner, eForkStage stage) {
+				aLog *log = static_cast<aLog*>(owner);
+				if (stage == eForkStage::prepareFork) {
+					log->m_asyncMutex.lock();
+					log->m_mutex.lock();
+					if (log->m_fileStream != nullptr) {
+						if (log->m_appender != nullptr) {
+							log->m_appender->flush(fileno(log->m_fileStream));
+						}
+						fflush(log->m_fileStream);
+					}
+					if (log->m_shards != nullptr) {
+						log->m_shards->prepareFork();
+					}
+					return;
+				}
+				if (log->m_shards != nullptr) {
+					log->m_shards->afterFork();
+				}
+				if (stage == eForkStage::childFork) {
+					log->resetInChild();
+				}
+				log->m_mutex.unlock();
+				log->m_asyncMutex.unlock();
+			}
 
-				// save time.
-				auto s = getTimeInfo().first;
-				auto tm = localtime(&s);
+			// resetInChild drops what the child inherits of the parent's threads, both
+			// locks are held. the former objects are leaked: their threads are gone, so
+			// they can be neither joined nor destroyed.
+			void resetInChild() {
+				m_queue.clear();
+				m_drainBuffer.clear();
+				m_drainOffset = 0;
+				if (m_appender != nullptr) {
+					m_appender->drop();
+				}
+				if (m_drain != nullptr) {
+					m_drain = std::make_unique<DrainNotifier>();
+				}
+				// a thread of the parent may have held the semaphore's lock.
+				new (&m_sem) anet::utils::CSemaphore();
+				if (m_sinks != nullptr) {
+					m_sinks.release();
+					m_sinkLevel = eLogLevel::allLevelSize;
+				}
+				// the leaked sinks hold the batches for good.
+				m_syncBatches.clear();
+				m_preparer.release();
+				m_ring.release();
+				// the child's threads write shards of their own tids, the inherited ones
+				// are flushed and closed.
+				if (m_shards != nullptr) {
+					m_shards->close();
+					m_shards = std::make_unique<ThreadShards>(m_logFilePath, m_prefix, &aLog::openLogFile);
+				}
+				m_index.reset();
+				m_indexInterval = 0;
+				if (m_compress != nullptr) {
+					m_compress.release();
+					if (m_fileStream != nullptr) {
+						fclose(m_fileStream);
+						m_fileStream = nullptr;
+					}
+					this->switchFile(true);
+				}
+				bool running = m_th != nullptr;
+				m_th.release();
+				if (running) {
+					m_th = std::make_unique<std::thread>(std::bind(&aLog::threadFunc, this));
+				}
+			}
 
-				// record time info.
-				m_year = tm->tm_year;
-				m_month = tm->tm_mon;
-				m_day = tm->tm_mday;
-				m_hour = tm->tm_hour;
-
-				/* file name */
-				char data[gLog_data_size];
-				int n = std::snprintf(fileName,
-					sizeof(fileName),
-					"%s/%s/%s%04d%02d%02d_%02d.log",
-					m_logFilePath.c_str(),
-					getDateInfo(data),
-					m_prefix.c_str(),
-					1900 + tm->tm_year, tm->tm_mon + 1, tm->tm_mday,
-					tm->tm_hour
-				);
-				assert(n > 0 && n <= int(sizeof(fileName)));
-				m_fileStream = fopen(fileName, "a+");
-				return m_fileStream != nullptr;
+			// reportScopeTimers logs the scope timers' summary line when it is due, in
+			// the writer thread.
+			void reportScopeTimers(long long nowMs) {
+				if (m_timerReportMs <= 0 || nowMs - m_lastTimerReportMs < m_timerReportMs) {
+					return;
+				}
+				m_lastTimerReportMs = nowMs;
+				std::string summary = ScopeTimerRegistry::instance().summary();
+				if (!summary.empty()) {
+					this->output(eLogLevel::infoLevel, false, "alog timers: {}", summary);
+				}
+			}
+
+			// reportMetrics logs the metrics line when it is due, in the writer thread.
+			void reportMetrics(long long nowMs) {
+				if (m_metricsReportMs <= 0 || nowMs - m_lastReportMs < m_metricsReportMs) {
+					return;
+				}
+				m_lastReportMs = nowMs;
+				LogMetrics metrics = this->metrics();
+				uint64_t records = 0, bytes = 0;
+				for (int l = 0; l < int(eLogLevel::allLevelSize); l++) {
+					records += metrics.records[l];
+					bytes += metrics.bytes[l];
+				}
+				char line[gLog_max_size];
+				int n = buildLinePrefix(line, eLogLevel::infoLevel);
+				int m = std::snprintf(line + n, sizeof(line) - size_t(n),
+					"alog metrics: records %llu bytes %llu queue %llu high %llu sink dropped %llu "
+					"batches %llu flushes %llu write p99 %llu ns flush p99 %llu ns rotations %llu max %llu ns "
+					"format %llu us enqueue %llu us\n",
+					(unsigned long long)records, (unsigned long long)bytes,
+					(unsigned long long)metrics.queueDepth, (unsigned long long)metrics.queueHighWater,
+					(unsigned long long)metrics.sinkDropped, (unsigned long long)metrics.batches,
+					(unsigned long long)metrics.flushes, (unsigned long long)metrics.writeNs.percentile(0.99),
+					(unsigned long long)metrics.flushNs.percentile(0.99), (unsigned long long)metrics.rotations,
+					(unsigned long long)metrics.rotationMaxNs, (unsigned long long)(metrics.formatNs / 1000),
+					(unsigned long long)(metrics.enqueueNs / 1000));
+				if (m > 0) {
+					size_t len = size_t(n + m) < sizeof(line) ? size_t(n + m) : sizeof(line) - 1;
+					this->emit(eLogLevel::infoLevel, false, line, len);
+				}
+			}
+
+			// create file.
+			bool createFile() {
+				return this->switchFile(true);
 			}
 
 			// release me
 			void release_log() {
+				ForkRegistry::instance().remove(this);
+
 				// let's the logging thread exit first.
 				m_quit = true;
-				m_th->join();
+				if (m_th != nullptr && m_th->joinable()) {
+					m_th->join();
+				}
+				if (m_drain != nullptr) {
+					this->drain();
+				}
+
+				// then drain the sinks.
+				if (m_sinks != nullptr) {
+					m_sinks->stop();
+				}
 
 				// then close file handler.
 				m_mutex.lock();
 				if (m_fileStream != nullptr) {
-					fclose(m_fileStream);
+					if (m_compress != nullptr) {
+						// the last frames are written and the file is closed by the worker.
+						m_compress->finish(m_fileStream);
+					} else {
+						this->finishFile();
+						fclose(m_fileStream);
+					}
 					m_fileStream = nullptr;
 				}
+				m_index.reset();
 				m_mutex.unlock();
+
+				// the shards of the live threads.
+				if (m_shards != nullptr) {
+					m_shards->close();
+				}
+
+				// the collector removes the ring once it is drained.
+				if (m_ring != nullptr) {
+					m_ring->close();
+					m_ring.reset();
+				}
+
+				// the helper closes the retired files.
+				if (m_preparer != nullptr) {
+					m_preparer->stop();
+				}
 			}
 
 			inline bool checkLevel(eLogLevel level) const {
 				return m_logLevel <= level;
 			}
+			inline bool captureLevel(eLogLevel level) const {
+				return m_recorder != nullptr && m_captureLevel <= level;
+			}
+			inline bool sinkLevel(eLogLevel level) const {
+				return m_sinks != nullptr && m_sinkLevel <= level;
+			}
 
 		private:
 			// file handle and its mutex.
@@ -551,6 +1615,53 @@ namespace anet {
 			// log level info.
 			const char* m_levels[int(eLogLevel::allLevelSize)] = { "debg","info","warn","crit" };
 			eLogLevel m_logLevel{ eLogLevel::debugLevel };
+			eRecordFormat m_recordFormat{ eRecordFormat::textFormat };
+
+			// flight recorder of the records below the log level.
+			std::unique_ptr<FlightRecorder> m_recorder;
+			eLogLevel m_captureLevel{ eLogLevel::allLevelSize };
+			bool m_dumpOnCrit{ true };
+			std::string m_flightDumpPath;
+
+			// current file's path, rotation index and size.
+			std::string m_filePath;
+			int m_fileIndex{ 0 };
+			uint64_t m_fileSize{ 0 };
+
+			// time index of the current file, and its interval(0 if it is disabled).
+			std::unique_ptr<TimeIndexWriter> m_index;
+			size_t m_indexInterval{ 0 };
+
+			// ring to the collector process, nullptr if it is not enabled.
+			std::unique_ptr<ShmRing> m_ring;
+
+			// per-thread shard files, nullptr if the threads share the log file.
+			std::unique_ptr<ThreadShards> m_shards;
+
+			// self metrics, nullptr if they are not enabled, and the report interval.
+			std::unique_ptr<MetricsRegistry> m_metrics;
+			int m_metricsReportMs{ 0 };
+			long long m_lastReportMs{ 0 };
+
+			// the scope timers' report interval, 0 if they are not reported.
+			int m_timerReportMs{ 0 };
+			long long m_lastTimerReportMs{ 0 };
+
+			// atomic append of the processes sharing the file, nullptr if it is written
+			// through stdio.
+			std::unique_ptr<AtomicAppender> m_appender;
+
+			// rotation helper, nullptr if the file is rotated hourly only.
+			std::unique_ptr<FilePreparer> m_preparer;
+
+			// compress stage of the log file, nullptr if it is not compressed.
+			std::unique_ptr<CompressStage> m_compress;
+
+			// sinks besides the log file, and their lowest level.
+			std::unique_ptr<SinkDispatcher> m_sinks;
+			eLogLevel m_sinkLevel{ eLogLevel::allLevelSize };
+			// the pool of syncBatch, m_mutex guards it.
+			std::vector<std::shared_ptr<std::string>> m_syncBatches;
 
 			// log time info(year,month,day,hour).
 			int m_year;
@@ -565,8 +1676,15 @@ namespace anet {
 			anet::utils::CSemaphore m_sem;
 			mutable std::mutex m_asyncMutex;
 			std::string m_queue;
+			size_t m_queueHighWater{ 0 };
 			bool m_quit{ false };
 
+			// the application's drain of the queue, nullptr if the writer thread
+			// drains it, and the batch being drained.
+			std::unique_ptr<DrainNotifier> m_drain;
+			std::string m_drainBuffer;
+			size_t m_drainOffset{ 0 };
+
 			// the frequency(unit:ms) to write message to file handler.
 			int m_asyncToFileMs{ gAsyncLogWriteFrequency };
 		}; // end of aLog class
@@ -586,11 +1704,164 @@ namespace anet {
 			return aLog::instance().setLevel(int(level));
 		}
 
+		// enableAtomicAppend makes the processes which append to the same log file
+		// interleave whole records only, see aLog::enableAtomicAppend.
+		inline bool enableAtomicAppend(size_t maxWrite = gAtomic_write_size) {
+			return aLog::instance().enableAtomicAppend(maxWrite);
+		}
+
+		// enableExternalDrain leaves the asynchronous queue to the application's
+		// event loop, returns the fd to poll. call it before initLog.
+		inline int enableExternalDrain() {
+			return aLog::instance().enableExternalDrain();
+		}
+
+		// drainLog writes the queued records of about maxBytes at most, until the
+		// deadline, see aLog::drain.
+		inline size_t drainLog(size_t maxBytes = SIZE_MAX,
+			std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) {
+			return aLog::instance().drain(maxBytes, deadline);
+		}
+
 		// setLogLevel sets log level
 		inline bool setLogLevel(eLogLevel level) {
 			return aLog::instance().setLevel(int(level));
 		}
 
+		// addSink adds a sink(console, memory, callback, rotating file...) to the log.
+		inline void addSink(std::shared_ptr<LogSink> sink) {
+			aLog::instance().addSink(std::move(sink));
+		}
+
+		// enableSharedMemory sends the records to the collector process.
+		inline bool enableSharedMemory(const std::string &name, size_t capacity = gShm_ring_size) {
+			return aLog::instance().enableSharedMemory(name, capacity);
+		}
+
+		// enableThreadShards makes every thread write its own shard file.
+		inline bool enableThreadShards() {
+			return aLog::instance().enableThreadShards();
+		}
+
+		// enableTimeIndex writes a sidecar time index beside every log file.
+		inline void enableTimeIndex(size_t intervalBytes = gIndex_interval_size) {
+			aLog::instance().enableTimeIndex(intervalBytes);
+		}
+
+		// enableMetrics counts what the log costs, see aLog::metrics.
+		inline void enableMetrics(int reportSeconds = 0) {
+			aLog::instance().enableMetrics(reportSeconds);
+		}
+
+		// logMetrics returns a snapshot of the log's metrics.
+		inline LogMetrics logMetrics() {
+			return aLog::instance().metrics();
+		}
+
+		// ScopeTimer times its scope for a LOG_SCOPE_TIMER site, see log_timer.h.
+		class ScopeTimer final {
+		public:
+			explicit ScopeTimer(ScopeTimerSite &site) : m_site(site), m_start(siteTicks()) {}
+			~ScopeTimer() {
+				uint64_t ticks = siteTicks() - m_start;
+				bool over = m_site.over(ticks);
+				if (!over && !m_site.stats()) {
+					return;
+				}
+				uint64_t ns = uint64_t(double(ticks) * tscNsPerTick());
+				if (m_site.stats()) {
+					m_site.observe(ns);
+				}
+				if (over && aLog::instance().enabled(eLogLevel::warnLevel)) {
+					static constexpr auto format = ALOG_FORMAT("{} {}:{} scope {} took {:.3f} us, over {} us");
+					aLog::instance().Awarn(format, shortFileName(m_site.file), m_site.func, m_site.line,
+						m_site.name, double(ns) / 1e3, m_site.thresholdUs);
+				}
+			}
+			ScopeTimer(const ScopeTimer &rhs) = delete;
+			ScopeTimer& operator=(const ScopeTimer &rhs) = delete;
+
+		private:
+			ScopeTimerSite &m_site;
+			uint64_t m_start;
+		};
+
+		// enableScopeTimerReport logs the scope timers' summary every reportSeconds.
+		inline void enableScopeTimerReport(int reportSeconds) {
+			aLog::instance().enableScopeTimerReport(reportSeconds);
+		}
+
+		// enableSiteProfiler profiles the log macros' call sites, which are
+		// compiled in with ALOG_PROFILE_SITES. one call in 2^sampleShift is timed.
+		inline void enableSiteProfiler(bool on = true, unsigned sampleShift = gSite_sample_shift) {
+			SiteProfiler::instance().enable(on, sampleShift);
+		}
+
+		// siteProfile returns the topN call sites of the most producer's time.
+		inline std::vector<SiteProfile> siteProfile(size_t topN = 20) {
+			return SiteProfiler::instance().top(topN);
+		}
+
+		// dumpSiteProfile logs the table of the topN call sites.
+		inline size_t dumpSiteProfile(size_t topN = 20) {
+			return aLog::instance().dumpSiteProfile(topN);
+		}
+
+		// installSiteProfileDump logs the call sites' table on sig(SIGUSR2 by
+		// default), the handler only flags it and the writer thread logs it.
+		inline void siteProfileSignal(int) {
+			SiteProfiler::instance().requestDump();
+		}
+		inline void installSiteProfileDump(int sig = 0) {
+			SiteProfiler::instance();
+        #if !defined(_WIN32)
+			sig = sig == 0 ? SIGUSR2 : sig;
+        #endif
+			if (sig != 0) {
+				signal(sig, siteProfileSignal);
+			}
+		}
+
+		// setRotation rotates the log file by size and applies retention limits.
+		inline void setRotation(const RotatePolicy &policy) {
+			aLog::instance().setRotation(policy);
+		}
+
+		// enableCompression compresses the log file in independent frames.
+		inline bool enableCompression(eCompression compression = eCompression::zstdCompression,
+			int level = 3, size_t frameSize = gCompress_frame_size, int frameMs = gCompress_frame_ms) {
+			return aLog::instance().enableCompression(compression, level, frameSize, frameMs);
+		}
+
+		// enableFlightRecorder keeps the records below the log level in memory.
+		inline void enableFlightRecorder(eLogLevel captureLevel = eLogLevel::debugLevel,
+			size_t slotCount = gFlight_slot_count, size_t slotSize = gFlight_slot_size) {
+			aLog::instance().enableFlightRecorder(captureLevel, slotCount, slotSize);
+		}
+
+		// dumpFlightRecorder dumps the flight recorder to the log.
+		inline size_t dumpFlightRecorder() {
+			return aLog::instance().dumpFlightRecorder();
+		}
+
+		// installFatalSignalDump dumps the flight recorder on a fatal signal,
+		// then the signal's default action goes on.
+		inline void fatalSignalDump(int sig) {
+			aLog::instance().dumpFlightRecorderOnSignal();
+			signal(sig, SIG_DFL);
+			raise(sig);
+		}
+		inline void installFatalSignalDump() {
+			const int signals[] = { SIGSEGV, SIGFPE, SIGILL, SIGABRT
+        #if !defined(_WIN32)
+				, SIGBUS
+        #endif
+			};
+			for (int sig : signals) {
+				signal(sig, fatalSignalDump);
+			}
+		}
+
 		// releaseLog releases log module.
 		inline void releaseLog() {}
              ///////////////////////////////////////////////////////
@@ -599,74 +1870,161 @@ namespace anet {
                ///////////////////////////////////////////////////
              ///////////////////////////////////////////////////////
 #define LoggerDebug(log,fmt,...) { \
-      if (log != nullptr && log->getLevel() <= int(anet::log::eLogLevel::debugLevel)) \
-        log->Debug("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}
+      if (log != nullptr && log->enabled(anet::log::eLogLevel::debugLevel)) { \
+        ALOG_SITE_SCOPE(LoggerDebug); \
+        log->Debug("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 #define LoggerWarn(log,fmt,...) { \
-      if (log != nullptr && log->getLevel() <= int(anet::log::eLogLevel::warnLevel)) \
-	    log->Warn("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__); }
-#define LoggerInfo(fmt,...) { \
-      if (log != nullptr && log->.getLevel() <= int(anet::log::eLogLevel::infoLevel)) \
-        log->Info("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__); }
+      if (log != nullptr && log->enabled(anet::log::eLogLevel::warnLevel)) { \
+        ALOG_SITE_SCOPE(LoggerWarn); \
+	    log->Warn("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
+#define LoggerInfo(log,fmt,...) { \
+      if (log != nullptr && log->enabled(anet::log::eLogLevel::infoLevel)) { \
+        ALOG_SITE_SCOPE(LoggerInfo); \
+        log->Info("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 #define LoggerCrit(log,fmt,...) { \
-      if (log != nullptr && log->getLevel() <= int(anet::log::eLogLevel::critLevel)) \
-        log->Crit("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__); }
+      if (log != nullptr && log->enabled(anet::log::eLogLevel::critLevel)) { \
+        ALOG_SITE_SCOPE(LoggerCrit); \
+        log->Crit("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 
       // traditional form
 #define LogDebug(fmt,...) { \
-      if (anet::log::aLog::instance().getLevel() <= int(anet::log::eLogLevel::debugLevel)) \
-        anet::log::aLog::instance().Debug("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::debugLevel)) { \
+        ALOG_SITE_SCOPE(LogDebug); \
+        anet::log::aLog::instance().Debug("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 #define LogWarn(fmt,...) { \
-      if (anet::log::aLog::instance().getLevel() <= int(anet::log::eLogLevel::warnLevel)) \
-	    anet::log::aLog::instance().Warn("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__); }
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::warnLevel)) { \
+        ALOG_SITE_SCOPE(LogWarn); \
+	    anet::log::aLog::instance().Warn("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 #define LogInfo(fmt,...) { \
-      if (anet::log::aLog::instance().getLevel() <= int(anet::log::eLogLevel::infoLevel)) \
-        anet::log::aLog::instance().Info("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__); }
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::infoLevel)) { \
+        ALOG_SITE_SCOPE(LogInfo); \
+        anet::log::aLog::instance().Info("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 #define LogCrit(fmt,...) { \
-      if (anet::log::aLog::instance().getLevel() <= int(anet::log::eLogLevel::critLevel)) \
-        anet::log::aLog::instance().Crit("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__); }
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::critLevel)) { \
+        ALOG_SITE_SCOPE(LogCrit); \
+        anet::log::aLog::instance().Crit("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 
 	  // ==asynchronous mode ==
 #define LogADebug(fmt,...) { \
-      if (anet::log::aLog::instance().getLevel() <= int(anet::log::eLogLevel::debugLevel)) \
-        anet::log::aLog::instance().ADebug("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__); }
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::debugLevel)) { \
+        ALOG_SITE_SCOPE(LogADebug); \
+        anet::log::aLog::instance().ADebug("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 #define LogAWarn(fmt,...) { \
-      if (anet::log::aLog::instance().getLevel() <= int(anet::log::eLogLevel::warnLevel)) \
-        anet::log::aLog::instance().AWarn("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__); }
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::warnLevel)) { \
+        ALOG_SITE_SCOPE(LogAWarn); \
+        anet::log::aLog::instance().AWarn("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 #define LogAInfo(fmt,...) { \
-      if (anet::log::aLog::instance().getLevel() <= int(anet::log::eLogLevel::infoLevel)) \
-        anet::log::aLog::instance().AInfo("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__); }
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::infoLevel)) { \
+        ALOG_SITE_SCOPE(LogAInfo); \
+        anet::log::aLog::instance().AInfo("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 #define LogACrit(fmt,...) { \
-      if (anet::log::aLog::instance().getLevel() <= int(anet::log::eLogLevel::critLevel)) \
-        anet::log::aLog::instance().ACrit("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__); }
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::critLevel)) { \
+        ALOG_SITE_SCOPE(LogACrit); \
+        anet::log::aLog::instance().ACrit("%s %s:%d " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 
 	  // === {} format ===
 	  /*synchronous mode*/
 #define Logdebug(fmt,...) { \
-      if (anet::log::aLog::instance().getLevel() <= int(anet::log::eLogLevel::debugLevel)) \
-        anet::log::aLog::instance().debug("{} {}:{} " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::debugLevel)) { \
+        ALOG_SITE_SCOPE(Logdebug); \
+        static constexpr auto _alogFormat = ALOG_FORMAT("{} {}:{} " fmt); \
+        anet::log::aLog::instance().debug(_alogFormat, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 #define Logwarn(fmt,...) { \
-      if (anet::log::aLog::instance().getLevel() <= int(anet::log::eLogLevel::warnLevel)) \
-        anet::log::aLog::instance().warn("{} {}:{} " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::warnLevel)) { \
+        ALOG_SITE_SCOPE(Logwarn); \
+        static constexpr auto _alogFormat = ALOG_FORMAT("{} {}:{} " fmt); \
+        anet::log::aLog::instance().warn(_alogFormat, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 #define Loginfo(fmt,...) { \
-      if (anet::log::aLog::instance().getLevel() <= int(anet::log::eLogLevel::infoLevel)) \
-        anet::log::aLog::instance().info("{} {}:{} " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::infoLevel)) { \
+        ALOG_SITE_SCOPE(Loginfo); \
+        static constexpr auto _alogFormat = ALOG_FORMAT("{} {}:{} " fmt); \
+        anet::log::aLog::instance().info(_alogFormat, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 #define Logcrit(fmt,...) { \
-      if (anet::log::aLog::instance().getLevel() <= int(anet::log::eLogLevel::critLevel)) \
-        anet::log::aLog::instance().crit("{} {}:{} " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::critLevel)) { \
+        ALOG_SITE_SCOPE(Logcrit); \
+        static constexpr auto _alogFormat = ALOG_FORMAT("{} {}:{} " fmt); \
+        anet::log::aLog::instance().crit(_alogFormat, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 
 	  /*asynchronous mode*/
 #define LogAdebug(fmt,...) { \
-      if (anet::log::aLog::instance().getLevel() <= int(anet::log::eLogLevel::debugLevel)) \
-        anet::log::aLog::instance().Adebug("{} {}:{} " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::debugLevel)) { \
+        ALOG_SITE_SCOPE(LogAdebug); \
+        static constexpr auto _alogFormat = ALOG_FORMAT("{} {}:{} " fmt); \
+        anet::log::aLog::instance().Adebug(_alogFormat, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 #define LogAwarn(fmt,...) { \
-      if (anet::log::aLog::instance().getLevel() <= int(anet::log::eLogLevel::warnLevel)) \
-        anet::log::aLog::instance().Awarn("{} {}:{} " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::warnLevel)) { \
+        ALOG_SITE_SCOPE(LogAwarn); \
+        static constexpr auto _alogFormat = ALOG_FORMAT("{} {}:{} " fmt); \
+        anet::log::aLog::instance().Awarn(_alogFormat, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 #define LogAinfo(fmt,...) { \
-      if (anet::log::aLog::instance().getLevel() <= int(anet::log::eLogLevel::infoLevel)) \
-        anet::log::aLog::instance().Ainfo("{} {}:{} " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::infoLevel)) { \
+        ALOG_SITE_SCOPE(LogAinfo); \
+        static constexpr auto _alogFormat = ALOG_FORMAT("{} {}:{} " fmt); \
+        anet::log::aLog::instance().Ainfo(_alogFormat, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
 #define LogAcrit(fmt,...) { \
-      if (anet::log::aLog::instance().getLevel() <= int(anet::log::eLogLevel::critLevel)) \
-        anet::log::aLog::instance().Acrit("{} {}:{} " fmt, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::critLevel)) { \
+        ALOG_SITE_SCOPE(LogAcrit); \
+        static constexpr auto _alogFormat = ALOG_FORMAT("{} {}:{} " fmt); \
+        anet::log::aLog::instance().Acrit(_alogFormat, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, ##__VA_ARGS__);}}
+
+	  /* structured key/value records: msg, then key, value pairs */
+#define Logdebug_kv(msg,...) { \
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::debugLevel)) { \
+        ALOG_SITE_SCOPE(Logdebug_kv); \
+        anet::log::aLog::instance().kv(anet::log::eLogLevel::debugLevel, false, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, msg, ##__VA_ARGS__);}}
+#define Logwarn_kv(msg,...) { \
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::warnLevel)) { \
+        ALOG_SITE_SCOPE(Logwarn_kv); \
+        anet::log::aLog::instance().kv(anet::log::eLogLevel::warnLevel, false, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, msg, ##__VA_ARGS__);}}
+#define Loginfo_kv(msg,...) { \
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::infoLevel)) { \
+        ALOG_SITE_SCOPE(Loginfo_kv); \
+        anet::log::aLog::instance().kv(anet::log::eLogLevel::infoLevel, false, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, msg, ##__VA_ARGS__);}}
+#define Logcrit_kv(msg,...) { \
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::critLevel)) { \
+        ALOG_SITE_SCOPE(Logcrit_kv); \
+        anet::log::aLog::instance().kv(anet::log::eLogLevel::critLevel, false, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, msg, ##__VA_ARGS__);}}
+#define LogAdebug_kv(msg,...) { \
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::debugLevel)) { \
+        ALOG_SITE_SCOPE(LogAdebug_kv); \
+        anet::log::aLog::instance().kv(anet::log::eLogLevel::debugLevel, true, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, msg, ##__VA_ARGS__);}}
+#define LogAwarn_kv(msg,...) { \
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::warnLevel)) { \
+        ALOG_SITE_SCOPE(LogAwarn_kv); \
+        anet::log::aLog::instance().kv(anet::log::eLogLevel::warnLevel, true, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, msg, ##__VA_ARGS__);}}
+#define LogAinfo_kv(msg,...) { \
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::infoLevel)) { \
+        ALOG_SITE_SCOPE(LogAinfo_kv); \
+        anet::log::aLog::instance().kv(anet::log::eLogLevel::infoLevel, true, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, msg, ##__VA_ARGS__);}}
+#define LogAcrit_kv(msg,...) { \
+      if (anet::log::aLog::instance().enabled(anet::log::eLogLevel::critLevel)) { \
+        ALOG_SITE_SCOPE(LogAcrit_kv); \
+        anet::log::aLog::instance().kv(anet::log::eLogLevel::critLevel, true, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, msg, ##__VA_ARGS__);}}
+
+	  /* scope timers: the rest of the scope is timed, and logged at warn level when
+	     it takes longer than thresholdUs(never if it is 0). the _STATS form also
+	     aggregates the site's durations, see enableScopeTimerReport. */
+#define ALOG_TIMER_CONCAT_(a,b) a##b
+#define ALOG_TIMER_CONCAT(a,b) ALOG_TIMER_CONCAT_(a,b)
+#define ALOG_SCOPE_TIMER_ID(name,thresholdUs,stats,id) \
+      static anet::log::ScopeTimerSite ALOG_TIMER_CONCAT(_alogTimerSite,id)( \
+        name, __FILE__, __FUNCTION__, __LINE__, (thresholdUs), stats); \
+      anet::log::ScopeTimer ALOG_TIMER_CONCAT(_alogTimer,id)(ALOG_TIMER_CONCAT(_alogTimerSite,id))
+#define ALOG_SCOPE_TIMER_(name,thresholdUs,stats) ALOG_SCOPE_TIMER_ID(name, thresholdUs, stats, __COUNTER__)
+#define LOG_SCOPE_TIMER(name,thresholdUs) ALOG_SCOPE_TIMER_(name, thresholdUs, false)
+#define LOG_SCOPE_TIMER_STATS(name,thresholdUs) ALOG_SCOPE_TIMER_(name, thresholdUs, true)
+
+	  /* binary payload as hex dump*/
+#define LogHex(level,ptr,len) { \
+      if (anet::log::aLog::instance().enabled(level)) { \
+        ALOG_SITE_SCOPE(LogHex); \
+        static constexpr auto _alogFormat = ALOG_FORMAT("{} {}:{} {} bytes\n{}"); \
+        anet::log::aLog::instance().output(level, false, _alogFormat, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, size_t(len), anet::log::hexdump((ptr), size_t(len)));}}
+#define LogAHex(level,ptr,len) { \
+      if (anet::log::aLog::instance().enabled(level)) { \
+        ALOG_SITE_SCOPE(LogAHex); \
+        static constexpr auto _alogFormat = ALOG_FORMAT("{} {}:{} {} bytes\n{}"); \
+        anet::log::aLog::instance().output(level, true, _alogFormat, anet::log::shortFileName(__FILE__), __FUNCTION__, __LINE__, size_t(len), anet::log::hexdump((ptr), size_t(len)));}}
 	
     } // end of the log namespace.
 } // end of anet namespace
@@ -0,0 +1,637 @@
+#pragma once
+
+/*
+ * columnar archive of a log file(<log file>.alar, see alog_archive.cpp), for
+ * the analytics which load weeks of logs: the records are cut into blocks of
+ * gArchive_block_records records or gArchive_block_size bytes of bodies, and a
+ * block stores its records by column:
+ *
+ *  - time: ms since the epoch of the local time, zigzag varint deltas.
+ *  - level: 2 bits per record.
+ *  - site: the "file func:line " of the macros, varint ids of a dictionary of
+ *    the block's sites("" is id 0).
+ *  - body: the rest of the record, varint lengths, and the bodies compressed as
+ *    one frame(zstd or gzip, see compressFrame).
+ *
+ * a record which does not start with the "time [level] " prefix(a json or a
+ * logfmt record, or the bytes before the first record), or whose time is out
+ * of range(02-30, second 60, which its ms does not format back), is kept whole
+ * as its body, at the time of its prefix or ts field or of the record before,
+ * at the level of its prefix or level field or info, and its row is listed in
+ * the raw column. a record is rebuilt byte for byte.
+ *
+ * the file is "ALOGARC1" and the blocks, a block is its ArchiveBlockHeader and
+ * its columns in the order above, in native byte order. the header carries the
+ * time range and the records per level, so ArchiveReader::scan skips a block
+ * out of a query by its header, and decodes the time and the level columns of
+ * the others only: the bodies are decompressed when a record's text is asked.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "log_compress.h"
+#include "log_index.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace anet {
+	namespace log {
+		static constexpr char gArchive_suffix[] = ".alar";
+		static constexpr char gArchive_magic[] = "ALOGARC1";
+		static constexpr size_t gArchive_magic_size = 8;
+		// records, and bytes of bodies, of a block at most.
+		static constexpr size_t gArchive_block_records = 64 * 1024;
+		static constexpr size_t gArchive_block_size = 4 * 1024 * 1024;
+		// "YYYY-MM-DD hh:mm:ss.mmm [info] "
+		static constexpr size_t gArchive_prefix_size = gRecord_time_size + 8;
+		// the longest "file func:line " taken as a site.
+		static constexpr size_t gArchive_site_size = 256;
+
+		static const char *gArchiveLevels[] = { "debg", "info", "warn", "crit" };
+		static constexpr int gArchive_raw_level = 1;
+
+		struct ArchiveBlockHeader {
+			uint32_t records;
+			uint32_t codec;           // eCompression of the bodies
+			int64_t firstMs;          // time of the first record, the deltas' base
+			int64_t minMs;
+			int64_t maxMs;
+			uint32_t levels[4];       // records per level
+			uint32_t timeSize;        // bytes of the columns
+			uint32_t levelSize;
+			uint32_t siteSize;
+			uint32_t dictSize;
+			uint32_t rawSize;
+			uint32_t lengthSize;
+			uint32_t bodySize;        // compressed
+			uint32_t bodyRawSize;
+		};
+
+		// a record found by ArchiveReader::scan.
+		struct ArchiveRow {
+			uint32_t block;
+			uint32_t row;
+			int64_t timeMs;
+			int level;
+		};
+
+		inline void putVarint(std::string &out, uint64_t v) {
+			while (v >= 0x80) {
+				out.push_back(char(uint8_t(v) | 0x80));
+				v >>= 7;
+			}
+			out.push_back(char(v));
+		}
+		// getVarint reads a varint at p, returns 0 past end.
+		inline uint64_t getVarint(const char *&p, const char *end) {
+			uint64_t v = 0;
+			for (int shift = 0; p < end && shift < 64; shift += 7) {
+				uint8_t b = uint8_t(*p++);
+				v |= uint64_t(b & 0x7f) << shift;
+				if ((b & 0x80) == 0) {
+					break;
+				}
+			}
+			return v;
+		}
+		inline uint64_t zigzag(int64_t v) {
+			return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+		}
+		inline int64_t unzigzag(uint64_t v) {
+			return int64_t(v >> 1) ^ -int64_t(v & 1);
+		}
+
+		// recordMs converts a record time(see isRecordTime) to its ms.
+		inline int64_t recordMs(const char *p) {
+			return timeSecond(p) * 1000 + (p[20] - '0') * 100 + (p[21] - '0') * 10 + (p[22] - '0');
+		}
+		// formatRecordMs writes the "YYYY-MM-DD hh:mm:ss.mmm" of a ms to out.
+		inline void formatRecordMs(int64_t ms, char(&out)[gRecord_time_size + 1]) {
+			int64_t seconds = ms >= 0 ? ms / 1000 : (ms - 999) / 1000;
+			int64_t days = seconds >= 0 ? seconds / 86400 : (seconds - 86399) / 86400;
+			int64_t rest = seconds - days * 86400;
+			// civil from days, see howard hinnant's date algorithms.
+			int64_t z = days + 719468;
+			int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+			int64_t doe = z - era * 146097;
+			int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+			int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+			int64_t mp = (5 * doy + 2) / 153;
+			int day = int(doy - (153 * mp + 2) / 5 + 1);
+			int month = int(mp < 10 ? mp + 3 : mp - 9);
+			int64_t year = yoe + era * 400 + (month <= 2);
+			auto put = [&out](int at, int n, int64_t v) {
+				for (int i = n - 1; i >= 0; i--) {
+					out[at + i] = char('0' + v % 10);
+					v /= 10;
+				}
+			};
+			memcpy(out, "0000-00-00 00:00:00.000", sizeof(out));
+			put(0, 4, year);
+			put(5, 2, month);
+			put(8, 2, day);
+			put(11, 2, rest / 3600);
+			put(14, 2, rest / 60 % 60);
+			put(17, 2, rest % 60);
+			put(20, 3, ms - seconds * 1000);
+		}
+
+		// fieldLevel returns the level of the level field which follows the time of
+		// a json or a logfmt record(see recordTime), -1 if none.
+		inline int fieldLevel(const char *record, const char *time, const char *end) {
+			const char *p = time + gRecord_time_size;
+			if (time - record == 7 && end - p >= 11 + 4 && memcmp(p, "\",\"level\":\"", 11) == 0) {
+				p += 11;
+			} else if (time - record == 4 && end - p >= 8 + 4 && memcmp(p, "\" level=", 8) == 0) {
+				p += 8;
+			} else {
+				return -1;
+			}
+			for (int l = 0; l < 4; l++) {
+				if (memcmp(p, gArchiveLevels[l], 4) == 0) {
+					return l;
+				}
+			}
+			return -1;
+		}
+
+		// parseSite returns the length of the "file func:line " at p, 0 if none.
+		inline size_t parseSite(const char *p, const char *end) {
+			size_t max = size_t(end - p) < gArchive_site_size ? size_t(end - p) : gArchive_site_size;
+			const char *space = static_cast<const char*>(memchr(p, ' ', max));
+			if (space == nullptr || space == p) {
+				return 0;
+			}
+			const char *func = space + 1;
+			const char *next = static_cast<const char*>(memchr(func, ' ', max - size_t(func - p)));
+			if (next == nullptr) {
+				return 0;
+			}
+			const char *digits = next;
+			while (digits > func && digits[-1] >= '0' && digits[-1] <= '9') {
+				--digits;
+			}
+			if (digits == next || digits - 1 <= func || digits[-1] != ':' ||
+				memchr(p, '\n', size_t(next - p)) != nullptr) {
+				return 0;
+			}
+			return size_t(next + 1 - p);
+		}
+
+		// ArchiveWriter cuts the records of a log file into blocks.
+		class ArchiveWriter final {
+		public:
+			ArchiveWriter(FILE *file, eCompression compression, int level) : m_file(file),
+				m_compression(resolveCompression(compression)), m_level(level) {
+				fwrite(gArchive_magic, 1, gArchive_magic_size, m_file);
+				this->reset();
+			}
+			~ArchiveWriter() {
+				this->finish();
+			}
+			ArchiveWriter(const ArchiveWriter &rhs) = delete;
+			ArchiveWriter& operator=(const ArchiveWriter &rhs) = delete;
+
+		public:
+			// add adds a record, see recordEnd.
+			void add(const char *record, size_t len) {
+				const char *end = record + len;
+				const char *body = record;
+				int level = -1;
+				int64_t ms = m_lastMs;
+				size_t site = 0;
+				if (len >= gArchive_prefix_size && isRecordTime(record, end) &&
+					memcmp(record + gRecord_time_size, " [", 2) == 0 &&
+					memcmp(record + gArchive_prefix_size - 2, "] ", 2) == 0) {
+					for (int l = 0; l < 4; l++) {
+						if (memcmp(record + gRecord_time_size + 2, gArchiveLevels[l], 4) == 0) {
+							level = l;
+						}
+					}
+				}
+				// a time out of range(02-30, 24:00, second 60) does not come back from
+				// its ms, such a record is kept raw, at its level.
+				bool prefixed = false;
+				if (level >= 0) {
+					char time[gRecord_time_size + 1];
+					ms = recordMs(record);
+					formatRecordMs(ms, time);
+					prefixed = memcmp(time, record, gRecord_time_size) == 0;
+				}
+				if (prefixed) {
+					body = record + gArchive_prefix_size;
+					site = parseSite(body, end);
+				} else {
+					const char *time = recordTime(record, end);
+					if (level < 0 && time != nullptr) {
+						ms = recordMs(time);
+						level = fieldLevel(record, time, end);
+					}
+					level = level >= 0 ? level : gArchive_raw_level;
+					putVarint(m_raw, m_header.records - m_lastRaw);
+					m_lastRaw = m_header.records;
+					++m_rawCount;
+				}
+
+				// time and level.
+				if (m_header.records == 0) {
+					m_header.firstMs = m_header.minMs = m_header.maxMs = ms;
+					m_prevMs = ms;
+				}
+				putVarint(m_time, zigzag(ms - m_prevMs));
+				m_prevMs = m_lastMs = ms;
+				m_header.minMs = ms < m_header.minMs ? ms : m_header.minMs;
+				m_header.maxMs = ms > m_header.maxMs ? ms : m_header.maxMs;
+				if (m_header.records % 4 == 0) {
+					m_levels.push_back(0);
+				}
+				m_levels.back() = char(uint8_t(m_levels.back()) | uint8_t(level << (m_header.records % 4 * 2)));
+				++m_header.levels[level];
+
+				// site and body.
+				uint32_t id = 0;
+				if (site > 0) {
+					auto it = m_siteIds.find(std::string(body, site));
+					if (it == m_siteIds.end()) {
+						id = uint32_t(m_siteIds.size() + 1);
+						m_siteIds.emplace(std::string(body, site), id);
+						putVarint(m_dict, site);
+						m_dict.append(body, site);
+					} else {
+						id = it->second;
+					}
+					body += site;
+				}
+				putVarint(m_sites, id);
+				putVarint(m_lengths, uint64_t(end - body));
+				m_bodies.append(body, size_t(end - body));
+
+				++m_header.records;
+				++m_records;
+				if (m_header.records >= gArchive_block_records || m_bodies.size() >= gArchive_block_size) {
+					this->seal();
+				}
+			}
+
+			// finish writes the last block.
+			void finish() {
+				if (m_header.records > 0) {
+					this->seal();
+				}
+				fflush(m_file);
+			}
+
+			size_t records() const {
+				return m_records;
+			}
+
+		private:
+			void reset() {
+				memset(&m_header, 0, sizeof(m_header));
+				m_time.clear();
+				m_levels.clear();
+				m_sites.clear();
+				m_dict.clear();
+				m_raw.clear();
+				m_lengths.clear();
+				m_bodies.clear();
+				m_siteIds.clear();
+				m_rawCount = 0;
+				m_lastRaw = 0;
+			}
+
+			void seal() {
+				std::string dict, raw;
+				putVarint(dict, m_siteIds.size());
+				dict.append(m_dict);
+				putVarint(raw, m_rawCount);
+				raw.append(m_raw);
+				eCompression codec = m_compression;
+				if (!compressFrame(codec, m_level, m_bodies.data(), m_bodies.size(), m_compressed)) {
+					codec = eCompression::noneCompression;
+					m_compressed = m_bodies;
+				}
+
+				m_header.codec = uint32_t(codec);
+				m_header.timeSize = uint32_t(m_time.size());
+				m_header.levelSize = uint32_t(m_levels.size());
+				m_header.siteSize = uint32_t(m_sites.size());
+				m_header.dictSize = uint32_t(dict.size());
+				m_header.rawSize = uint32_t(raw.size());
+				m_header.lengthSize = uint32_t(m_lengths.size());
+				m_header.bodySize = uint32_t(m_compressed.size());
+				m_header.bodyRawSize = uint32_t(m_bodies.size());
+				fwrite(&m_header, sizeof(m_header), 1, m_file);
+				for (const std::string *column : { &m_time, &m_levels, &m_sites, &dict, &raw, &m_lengths, &m_compressed }) {
+					fwrite(column->data(), 1, column->size(), m_file);
+				}
+				this->reset();
+			}
+
+		private:
+			FILE *m_file;
+			eCompression m_compression;
+			int m_level;
+			ArchiveBlockHeader m_header;
+			std::string m_time;
+			std::string m_levels;
+			std::string m_sites;
+			std::string m_dict;
+			std::string m_raw;
+			std::string m_lengths;
+			std::string m_bodies;
+			std::string m_compressed;
+			std::unordered_map<std::string, uint32_t> m_siteIds;
+			uint32_t m_rawCount{ 0 };
+			uint32_t m_lastRaw{ 0 };
+			int64_t m_prevMs{ 0 };
+			int64_t m_lastMs{ 0 };
+			size_t m_records{ 0 };
+		};
+
+		// archiveLogFile converts a log file to an archive, returns its records or -1.
+		inline long long archiveLogFile(const std::string &logPath, const std::string &archivePath,
+			eCompression compression = eCompression::zstdCompression, int level = 3) {
+        #if defined(_WIN32)
+			(void)logPath;
+			(void)archivePath;
+			(void)compression;
+			(void)level;
+			return -1;
+        #else
+			int fd = ::open(logPath.c_str(), O_RDONLY);
+			struct stat st;
+			if (fd < 0 || fstat(fd, &st) != 0) {
+				if (fd >= 0) {
+					::close(fd);
+				}
+				return -1;
+			}
+			size_t size = size_t(st.st_size);
+			const char *data = nullptr;
+			if (size > 0) {
+				void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+				data = mapped != MAP_FAILED ? static_cast<const char*>(mapped) : nullptr;
+			}
+			::close(fd);
+			if (size > 0 && data == nullptr) {
+				return -1;
+			}
+			FILE *out = fopen(archivePath.c_str(), "wb");
+			if (out == nullptr) {
+				if (data != nullptr) {
+					munmap(const_cast<char*>(data), size);
+				}
+				return -1;
+			}
+
+			long long records = 0;
+			{
+				ArchiveWriter writer(out, compression, level);
+				if (data != nullptr) {
+					madvise(const_cast<char*>(data), size, MADV_SEQUENTIAL);
+					// the bytes before the first record are a record of their own.
+					for (const char *p = data, *end = data + size; p < end;) {
+						const char *next = recordEnd(p, end);
+						writer.add(p, size_t(next - p));
+						p = next;
+					}
+					munmap(const_cast<char*>(data), size);
+				}
+				writer.finish();
+				records = (long long)writer.records();
+			}
+			bool ok = ferror(out) == 0;
+			ok = fclose(out) == 0 && ok;
+			return ok ? records : -1;
+        #endif
+		}
+
+		// ArchiveReader reads an archive, mapped.
+		class ArchiveReader final {
+		public:
+			ArchiveReader() = default;
+			~ArchiveReader() {
+				this->close();
+			}
+			ArchiveReader(const ArchiveReader &rhs) = delete;
+			ArchiveReader& operator=(const ArchiveReader &rhs) = delete;
+
+			// a block: its header and its columns.
+			struct Block {
+				ArchiveBlockHeader header;
+				const char *time;
+				const char *levels;
+				const char *sites;
+				const char *dict;
+				const char *raw;
+				const char *lengths;
+				const char *body;
+			};
+
+		public:
+			// open maps the archive and reads its block headers, false if it is not an
+			// archive or is cut in a block.
+			bool open(const std::string &path) {
+				this->close();
+        #if defined(_WIN32)
+				(void)path;
+				return false;
+        #else
+				int fd = ::open(path.c_str(), O_RDONLY);
+				struct stat st;
+				if (fd < 0 || fstat(fd, &st) != 0 || size_t(st.st_size) < gArchive_magic_size) {
+					if (fd >= 0) {
+						::close(fd);
+					}
+					return false;
+				}
+				m_size = size_t(st.st_size);
+				void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				::close(fd);
+				if (data == MAP_FAILED) {
+					m_size = 0;
+					return false;
+				}
+				m_data = static_cast<const char*>(data);
+				if (memcmp(m_data, gArchive_magic, gArchive_magic_size) != 0) {
+					this->close();
+					return false;
+				}
+				const char *p = m_data + gArchive_magic_size, *end = m_data + m_size;
+				while (size_t(end - p) >= sizeof(ArchiveBlockHeader)) {
+					Block block;
+					memcpy(&block.header, p, sizeof(block.header));
+					const ArchiveBlockHeader &h = block.header;
+					p += sizeof(h);
+					uint64_t columns = uint64_t(h.timeSize) + h.levelSize + h.siteSize + h.dictSize +
+						h.rawSize + h.lengthSize + h.bodySize;
+					if (uint64_t(end - p) < columns || h.levelSize != (h.records + 3) / 4) {
+						this->close();
+						return false;
+					}
+					block.time = p;
+					block.levels = block.time + h.timeSize;
+					block.sites = block.levels + h.levelSize;
+					block.dict = block.sites + h.siteSize;
+					block.raw = block.dict + h.dictSize;
+					block.lengths = block.raw + h.rawSize;
+					block.body = block.lengths + h.lengthSize;
+					p = block.body + h.bodySize;
+					m_records += h.records;
+					m_blocks.push_back(block);
+				}
+				return p == end;
+        #endif
+			}
+
+			void close() {
+        #if !defined(_WIN32)
+				if (m_data != nullptr) {
+					munmap(const_cast<char*>(m_data), m_size);
+				}
+        #endif
+				m_data = nullptr;
+				m_size = 0;
+				m_records = 0;
+				m_blocks.clear();
+				m_cached = ~size_t(0);
+			}
+
+			const std::vector<Block>& blocks() const {
+				return m_blocks;
+			}
+			size_t records() const {
+				return m_records;
+			}
+
+			// scan calls fn(const ArchiveRow&) for the records in [fromMs, toMs] of the
+			// levels of levelMask(bit 1 << level), returns their number. only the time
+			// and the level columns are decoded, a block out of the query is skipped.
+			template <typename Fn>
+			size_t scan(int64_t fromMs, int64_t toMs, unsigned levelMask, Fn &&fn) const {
+				size_t found = 0;
+				for (size_t b = 0; b < m_blocks.size(); b++) {
+					const Block &block = m_blocks[b];
+					const ArchiveBlockHeader &h = block.header;
+					bool anyLevel = false;
+					for (int l = 0; l < 4; l++) {
+						anyLevel = anyLevel || ((levelMask >> l & 1) != 0 && h.levels[l] > 0);
+					}
+					if (!anyLevel || h.maxMs < fromMs || h.minMs > toMs) {
+						continue;
+					}
+					const char *time = block.time, *timeEnd = block.time + h.timeSize;
+					int64_t ms = h.firstMs;
+					for (uint32_t row = 0; row < h.records; row++) {
+						ms += unzigzag(getVarint(time, timeEnd));
+						int level = (uint8_t(block.levels[row / 4]) >> (row % 4 * 2)) & 3;
+						if ((levelMask >> level & 1) != 0 && ms >= fromMs && ms <= toMs) {
+							fn(ArchiveRow{ uint32_t(b), row, ms, level });
+							++found;
+						}
+					}
+				}
+				return found;
+			}
+
+			// text rebuilds the record of a row, the bodies of the row's block are
+			// decompressed once for the rows of the block.
+			bool text(const ArchiveRow &row, std::string &out) {
+				out.clear();
+				if (row.block >= m_blocks.size() || row.row >= m_blocks[row.block].header.records ||
+					!this->load(row.block)) {
+					return false;
+				}
+				const Block &block = m_blocks[row.block];
+				size_t offset = m_offsets[row.row];
+				size_t len = m_offsets[row.row + 1] - offset;
+				if (!m_isRaw[row.row]) {
+					char time[gRecord_time_size + 1];
+					formatRecordMs(row.timeMs, time);
+					out.append(time, gRecord_time_size);
+					out.append(" [", 2);
+					out.append(gArchiveLevels[row.level], 4);
+					out.append("] ", 2);
+					const char *site = block.sites + m_siteOffsets[row.row];
+					uint64_t id = getVarint(site, block.sites + block.header.siteSize);
+					if (id > 0 && id <= m_dict.size()) {
+						out.append(m_dict[id - 1]);
+					}
+				}
+				out.append(m_bodies, offset, len);
+				return true;
+			}
+
+		private:
+			// load decodes the dictionary, the raw rows and the bodies of a block.
+			bool load(size_t b) {
+				if (m_cached == b) {
+					return true;
+				}
+				m_cached = ~size_t(0);
+				const Block &block = m_blocks[b];
+				const ArchiveBlockHeader &h = block.header;
+				if (!decompressFrame(eCompression(h.codec), block.body, h.bodySize, h.bodyRawSize, m_bodies)) {
+					return false;
+				}
+				m_dict.clear();
+				const char *p = block.dict, *end = block.dict + h.dictSize;
+				for (uint64_t n = getVarint(p, end); n > 0 && p < end; n--) {
+					uint64_t len = getVarint(p, end);
+					len = len < uint64_t(end - p) ? len : uint64_t(end - p);
+					m_dict.emplace_back(p, size_t(len));
+					p += len;
+				}
+				m_isRaw.assign(h.records, false);
+				p = block.raw;
+				end = block.raw + h.rawSize;
+				uint64_t rawRow = 0;
+				for (uint64_t n = getVarint(p, end); n > 0 && p < end; n--) {
+					rawRow += getVarint(p, end);
+					if (rawRow < h.records) {
+						m_isRaw[rawRow] = true;
+					}
+				}
+				m_offsets.resize(h.records + 1);
+				m_siteOffsets.resize(h.records);
+				const char *length = block.lengths, *lengthEnd = block.lengths + h.lengthSize;
+				const char *site = block.sites, *siteEnd = block.sites + h.siteSize;
+				m_offsets[0] = 0;
+				for (uint32_t row = 0; row < h.records; row++) {
+					m_siteOffsets[row] = uint32_t(site - block.sites);
+					getVarint(site, siteEnd);
+					m_offsets[row + 1] = m_offsets[row] + size_t(getVarint(length, lengthEnd));
+				}
+				if (m_offsets[h.records] != m_bodies.size()) {
+					return false;
+				}
+				m_cached = b;
+				return true;
+			}
+
+		private:
+			const char *m_data{ nullptr };
+			size_t m_size{ 0 };
+			size_t m_records{ 0 };
+			std::vector<Block> m_blocks;
+			// the decoded block.
+			size_t m_cached{ ~size_t(0) };
+			std::string m_bodies;
+			std::vector<std::string> m_dict;
+			std::vector<bool> m_isRaw;
+			std::vector<size_t> m_offsets;
+			std::vector<uint32_t> m_siteOffsets;
+		};
+	}
+}
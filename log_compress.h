@@ -0,0 +1,384 @@
+#pragma once
+
+/*
+ * streaming compression of the log file: the writer hands the lines to a
+ * compress stage, which cuts them into frames every gCompress_frame_size bytes
+ * or gCompress_frame_ms, and a worker thread compresses and appends each frame.
+ * every frame is an independent zstd frame(or gzip member), so a crash loses at
+ * most the frame being built, and a reader can seek frame by frame: a zstd file
+ * ends with the seek table of the zstd seekable format. a file being rotated is
+ * handed to the worker, which writes its last frames and its seek table, then
+ * closes it, so the writer never waits for the compression. the worker keeps
+ * gCompress_max_jobs frames at most, a frame beyond them is dropped(counted).
+ *
+ * build with ALOG_WITH_ZSTD(-lzstd) and/or ALOG_WITH_ZLIB(-lz).
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log_thread.h"
+
+#if defined(ALOG_WITH_ZSTD)
+#include <zstd.h>
+#endif
+#if defined(ALOG_WITH_ZLIB)
+#include <zlib.h>
+#endif
+
+namespace anet {
+	namespace log {
+		// default frame size and frame interval.
+		static constexpr size_t gCompress_frame_size = 256 * 1024;
+		static constexpr int gCompress_frame_ms = 1000;
+		// frames waiting for the worker at most.
+		static constexpr size_t gCompress_max_jobs = 64;
+
+		// compression of the log file.
+		enum class eCompression : int {
+			noneCompression = 0,
+			zstdCompression,
+			gzipCompression,
+		};
+
+		// whether the compression is built in.
+		inline bool compressionSupported(eCompression compression) {
+			switch (compression) {
+			case eCompression::noneCompression:
+				return true;
+			case eCompression::zstdCompression:
+            #if defined(ALOG_WITH_ZSTD)
+				return true;
+            #else
+				return false;
+            #endif
+			case eCompression::gzipCompression:
+            #if defined(ALOG_WITH_ZLIB)
+				return true;
+            #else
+				return false;
+            #endif
+			}
+			return false;
+		}
+
+		// resolveCompression falls back from zstd to gzip, then to none.
+		inline eCompression resolveCompression(eCompression compression) {
+			if (compressionSupported(compression)) {
+				return compression;
+			}
+			if (compression == eCompression::zstdCompression &&
+				compressionSupported(eCompression::gzipCompression)) {
+				return eCompression::gzipCompression;
+			}
+			return eCompression::noneCompression;
+		}
+
+		// the file name suffix of the compression.
+		inline const char* compressionSuffix(eCompression compression) {
+			switch (compression) {
+			case eCompression::zstdCompression:
+				return ".zst";
+			case eCompression::gzipCompression:
+				return ".gz";
+			default:
+				return "";
+			}
+		}
+
+		// compressFrame compresses data as one independent frame into out,
+		// returns false on failure.
+		inline bool compressFrame(eCompression compression, int level,
+			const char *data, size_t len, std::string &out) {
+			out.clear();
+			switch (compression) {
+            #if defined(ALOG_WITH_ZSTD)
+			case eCompression::zstdCompression: {
+				out.resize(ZSTD_compressBound(len));
+				size_t n = ZSTD_compress(&out[0], out.size(), data, len, level);
+				if (ZSTD_isError(n)) {
+					return false;
+				}
+				out.resize(n);
+				return true;
+			}
+            #endif
+            #if defined(ALOG_WITH_ZLIB)
+			case eCompression::gzipCompression: {
+				z_stream zs;
+				memset(&zs, 0, sizeof(zs));
+				// 15 + 16: a gzip member, members can be concatenated.
+				if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+					return false;
+				}
+				out.resize(deflateBound(&zs, uLong(len)) + 32);
+				zs.next_in = (Bytef*)data;
+				zs.avail_in = uInt(len);
+				zs.next_out = (Bytef*)&out[0];
+				zs.avail_out = uInt(out.size());
+				int ret = deflate(&zs, Z_FINISH);
+				out.resize(zs.total_out);
+				deflateEnd(&zs);
+				return ret == Z_STREAM_END;
+			}
+            #endif
+			case eCompression::noneCompression:
+				out.assign(data, len);
+				return true;
+			default:
+				(void)level;
+				return false;
+			}
+		}
+
+		// decompressFrame decompresses a frame of compressFrame, whose size before
+		// the compression is rawSize, into out. returns false on failure.
+		inline bool decompressFrame(eCompression compression, const char *data, size_t len,
+			size_t rawSize, std::string &out) {
+			out.resize(rawSize);
+			switch (compression) {
+            #if defined(ALOG_WITH_ZSTD)
+			case eCompression::zstdCompression: {
+				size_t n = ZSTD_decompress(&out[0], out.size(), data, len);
+				return !ZSTD_isError(n) && n == rawSize;
+			}
+            #endif
+            #if defined(ALOG_WITH_ZLIB)
+			case eCompression::gzipCompression: {
+				z_stream zs;
+				memset(&zs, 0, sizeof(zs));
+				if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+					return false;
+				}
+				zs.next_in = (Bytef*)data;
+				zs.avail_in = uInt(len);
+				zs.next_out = (Bytef*)&out[0];
+				zs.avail_out = uInt(out.size());
+				int ret = inflate(&zs, Z_FINISH);
+				bool ok = ret == Z_STREAM_END && zs.total_out == rawSize;
+				inflateEnd(&zs);
+				return ok;
+			}
+            #endif
+			case eCompression::noneCompression:
+				out.assign(data, len);
+				return len == rawSize;
+			default:
+				return false;
+			}
+		}
+
+		// one frame of the zstd seek table.
+		struct SeekEntry {
+			uint32_t compressedSize;
+			uint32_t decompressedSize;
+		};
+
+		// appendSeekTable appends the zstd seekable format's seek table: a skippable
+		// frame of the entries and its footer.
+		inline void appendSeekTable(const std::vector<SeekEntry> &entries, std::string &out) {
+			auto put32 = [&out](uint32_t v) {
+				char b[4] = { char(v), char(v >> 8), char(v >> 16), char(v >> 24) };
+				out.append(b, 4);
+			};
+			put32(0x184D2A5E);
+			put32(uint32_t(entries.size() * 8 + 9));
+			for (auto &entry : entries) {
+				put32(entry.compressedSize);
+				put32(entry.decompressedSize);
+			}
+			put32(uint32_t(entries.size()));
+			out.push_back(0); // descriptor: no checksums.
+			put32(0x8F92EAB1);
+		}
+
+		// compress stage: frames are cut by the writer and compressed by the worker.
+		// all calls but stop and droppedFrames come from the writer, with the file
+		// lock held.
+		class CompressStage final {
+		public:
+			CompressStage(eCompression compression, int level, size_t frameSize, int frameMs) :
+				m_compression(compression), m_level(level),
+				m_frameSize(frameSize > 0 ? frameSize : gCompress_frame_size),
+				m_frameMs(frameMs > 0 ? frameMs : gCompress_frame_ms) {
+				m_pending.reserve(m_frameSize);
+				m_th = std::thread([this]() { this->threadFunc(); });
+			}
+			~CompressStage() {
+				this->stop();
+			}
+			CompressStage(const CompressStage &rhs) = delete;
+			CompressStage& operator=(const CompressStage &rhs) = delete;
+
+		public:
+			eCompression compression() const {
+				return m_compression;
+			}
+
+			// write appends lines of the file, a full frame is handed to the worker.
+			void write(FILE *file, const char *data, size_t len) {
+				if (m_pending.empty()) {
+					m_frameBegin = std::chrono::steady_clock::now();
+				}
+				m_pending.append(data, len);
+				if (m_pending.size() >= m_frameSize) {
+					this->seal(file);
+				}
+			}
+
+			// tick seals the frame which is older than the frame interval.
+			void tick(FILE *file) {
+				if (!m_pending.empty() && std::chrono::steady_clock::now() - m_frameBegin >=
+					std::chrono::milliseconds(m_frameMs)) {
+					this->seal(file);
+				}
+			}
+
+			// retire seals the frame and hands the file over: the worker writes its
+			// frames, ends a zstd file with its seek table, then closes it. the
+			// writer does not use the file any more.
+			void retire(FILE *file) {
+				this->seal(file);
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					m_jobs.push_back(Job{ file, std::string(), true });
+				}
+				m_cond.notify_one();
+			}
+
+			// finish retires the file, and waits until the worker has closed it.
+			void finish(FILE *file) {
+				this->retire(file);
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_idleCond.wait(lock, [this]() { return m_jobs.empty() && !m_busy; });
+			}
+
+			// frames dropped as the worker fell behind.
+			size_t droppedFrames() const {
+				return m_dropped.load(std::memory_order_relaxed);
+			}
+
+			// stop writes the handed frames, then stops the worker.
+			void stop() {
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					if (m_quit) {
+						return;
+					}
+					m_quit = true;
+				}
+				m_cond.notify_one();
+				if (m_th.joinable()) {
+					m_th.join();
+				}
+			}
+
+		private:
+			// a frame of file, or the end of file.
+			struct Job {
+				FILE *file;
+				std::string data;
+				bool end;
+			};
+
+			// seal hands the pending frame to the worker, or drops it if the worker
+			// has gCompress_max_jobs frames.
+			void seal(FILE *file) {
+				if (m_pending.empty()) {
+					return;
+				}
+				Job job{ file, std::string(), false };
+				job.data.reserve(m_frameSize);
+				job.data.swap(m_pending);
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					if (m_frames >= gCompress_max_jobs) {
+						m_dropped.fetch_add(1, std::memory_order_relaxed);
+						return;
+					}
+					++m_frames;
+					m_jobs.push_back(std::move(job));
+				}
+				m_cond.notify_one();
+			}
+
+			void threadFunc() {
+				placeLogThread("compress");
+				std::string out;
+				for (;;) {
+					Job job;
+					{
+						std::unique_lock<std::mutex> lock(m_mutex);
+						m_cond.wait(lock, [this]() { return m_quit || !m_jobs.empty(); });
+						if (m_jobs.empty()) {
+							return;
+						}
+						job = std::move(m_jobs.front());
+						m_jobs.pop_front();
+						m_busy = true;
+					}
+
+					if (job.end) {
+						// the end of the file: its seek table, then it is closed.
+						if (m_compression == eCompression::zstdCompression && !m_seekTable.empty()) {
+							out.clear();
+							appendSeekTable(m_seekTable, out);
+							fwrite(out.data(), 1, out.size(), job.file);
+							fflush(job.file);
+						}
+						m_seekTable.clear();
+						fclose(job.file);
+					} else {
+						// a frame is flushed as a whole, so a crash loses at most the next
+						// one. a frame which fails is dropped, with no entry in the seek
+						// table, so the offsets of the later frames stay right.
+						if (compressFrame(m_compression, m_level, job.data.data(), job.data.size(), out) &&
+							fwrite(out.data(), 1, out.size(), job.file) == out.size()) {
+							m_seekTable.push_back(SeekEntry{ uint32_t(out.size()), uint32_t(job.data.size()) });
+						}
+						fflush(job.file);
+					}
+
+					{
+						std::lock_guard<std::mutex> guard(m_mutex);
+						m_frames -= job.end ? 0 : 1;
+						m_busy = false;
+					}
+					m_idleCond.notify_all();
+				}
+			}
+
+		private:
+			eCompression m_compression;
+			int m_level;
+			size_t m_frameSize;
+			int m_frameMs;
+
+			// the frame being built by the writer.
+			std::string m_pending;
+			std::chrono::steady_clock::time_point m_frameBegin;
+
+			// frames handed to the worker.
+			std::thread m_th;
+			std::mutex m_mutex;
+			std::condition_variable m_cond;
+			std::condition_variable m_idleCond;
+			std::deque<Job> m_jobs;
+			// frames in m_jobs.
+			size_t m_frames{ 0 };
+			bool m_busy{ false };
+			bool m_quit{ false };
+			std::atomic<size_t> m_dropped{ 0 };
+			// the seek table of the file being written, the worker's only.
+			std::vector<SeekEntry> m_seekTable;
+		};
+	}
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+/*
+ * thread local logging context(mdc):
+ *
+ *     ScopedLogContext ctx{ "req", requestId, "uid", uid };
+ *
+ * renders "req=<id> uid=<uid> " once when the scope is entered, and every
+ * record the thread builds in the scope carries those bytes after its
+ * "time [level] " prefix, a memcpy instead of formatting the values again.
+ * scopes nest, an inner one appends to the outer one.
+ *
+ * a snapshot of the context is shared(made once per scope), so a task which
+ * runs later or on another thread enters it with ScopedLogContext(snapshot)
+ * and logs in the context it was created in.
+ */
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include "variable_parameter_build.h"
+
+namespace anet {
+	namespace log {
+		// the rendered context of the calling thread, plain data, so reading it
+		// on every record costs no thread_local guard.
+		struct LogContextView {
+			const char *data;
+			size_t len;
+		};
+		inline LogContextView& logContextView() {
+			static thread_local LogContextView view{ nullptr, 0 };
+			return view;
+		}
+
+		// shared rendered context, see LogContext::snapshot.
+		using LogContextSnapshot = std::shared_ptr<const std::string>;
+
+		// the context of the calling thread.
+		class LogContext final {
+		public:
+			static LogContext& current() {
+				static thread_local LogContext context;
+				return context;
+			}
+			~LogContext() {
+				logContextView() = { nullptr, 0 };
+			}
+
+			const std::string& prefix() const {
+				return m_prefix;
+			}
+
+			// snapshot returns the shared rendered context.
+			LogContextSnapshot snapshot() {
+				if (m_snapshot == nullptr) {
+					m_snapshot = std::make_shared<const std::string>(m_prefix);
+				}
+				return m_snapshot;
+			}
+
+		private:
+			friend class ScopedLogContext;
+
+			LogContext() {
+				m_prefix.reserve(256);
+			}
+			LogContext(const LogContext &rhs) = delete;
+			LogContext& operator=(const LogContext &rhs) = delete;
+
+			void publish() {
+				LogContextView &view = logContextView();
+				view.data = m_prefix.data();
+				view.len = m_prefix.size();
+			}
+
+		private:
+			std::string m_prefix;
+			LogContextSnapshot m_snapshot;
+		};
+
+		class ScopedLogContext final {
+		public:
+			// key, value pairs, rendered as "key=value ".
+			template <typename Key, typename Value, typename... Args>
+			ScopedLogContext(Key &&key, Value &&value, Args&&... args) : ScopedLogContext() {
+				static_assert(sizeof...(Args) % 2 == 0, "key, value pairs are expected");
+				SStreamType ss;
+				renderPairs(ss, std::forward<Key>(key), std::forward<Value>(value), std::forward<Args>(args)...);
+				m_context.m_prefix.append(ss.str(), size_t(ss.len()));
+				m_context.publish();
+			}
+			// a snapshot of a context, appended to the current one.
+			explicit ScopedLogContext(const LogContextSnapshot &snapshot) : ScopedLogContext() {
+				if (snapshot != nullptr) {
+					m_context.m_prefix.append(*snapshot);
+				}
+				m_context.publish();
+			}
+			~ScopedLogContext() {
+				m_context.m_prefix.resize(m_previous);
+				m_context.m_snapshot = std::move(m_snapshot);
+				m_context.publish();
+			}
+			ScopedLogContext(const ScopedLogContext &rhs) = delete;
+			ScopedLogContext& operator=(const ScopedLogContext &rhs) = delete;
+
+		private:
+			// the enclosing context is restored when the scope exits.
+			ScopedLogContext() : m_context(LogContext::current()), m_previous(m_context.m_prefix.size()),
+				m_snapshot(std::move(m_context.m_snapshot)) {}
+
+			static void renderPairs(SStreamType &) {}
+			template <typename Key, typename Value, typename... Args>
+			static void renderPairs(SStreamType &ss, Key &&key, Value &&value, Args&&... args) {
+				ss << key;
+				ss.To("=", 1);
+				ss << value;
+				ss.To(" ", 1);
+				renderPairs(ss, std::forward<Args>(args)...);
+			}
+
+		private:
+			LogContext &m_context;
+			size_t m_previous;
+			LogContextSnapshot m_snapshot;
+		};
+
+		// logContextSnapshot returns the shared context of the calling thread.
+		inline LogContextSnapshot logContextSnapshot() {
+			return LogContext::current().snapshot();
+		}
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+/*
+ * external drain: the application's event loop drives the asynchronous queue
+ * instead of the writer thread. the notifier's fd(an eventfd on linux, the read
+ * end of a pipe on the other posix systems) becomes readable when the queue
+ * turns non-empty, and stays so until the queue is drained(see aLog::drain).
+ * on windows there is no fd, the loop calls drain on its timer.
+ */
+
+#include <cstdint>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace anet {
+	namespace log {
+		// the bytes drained between the deadline's checks.
+		static constexpr size_t gDrain_step_size = 64 * 1024;
+
+		class DrainNotifier final {
+		public:
+			DrainNotifier() {
+        #if defined(__linux__)
+				m_readFd = m_writeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        #elif !defined(_WIN32)
+				int fds[2];
+				if (pipe(fds) == 0) {
+					for (int fd : fds) {
+						fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+						fcntl(fd, F_SETFD, FD_CLOEXEC);
+					}
+					m_readFd = fds[0];
+					m_writeFd = fds[1];
+				}
+        #endif
+			}
+			~DrainNotifier() {
+        #if !defined(_WIN32)
+				if (m_readFd >= 0) {
+					close(m_readFd);
+				}
+				if (m_writeFd >= 0 && m_writeFd != m_readFd) {
+					close(m_writeFd);
+				}
+        #endif
+			}
+			DrainNotifier(const DrainNotifier &rhs) = delete;
+			DrainNotifier& operator=(const DrainNotifier &rhs) = delete;
+
+			// fd to poll for reading, -1 if there is none.
+			int fd() const {
+				return m_readFd;
+			}
+
+			// notify makes the fd readable.
+			void notify() {
+        #if !defined(_WIN32)
+				if (m_writeFd >= 0) {
+					uint64_t one = 1;
+					ssize_t n = ::write(m_writeFd, &one, m_writeFd == m_readFd ? sizeof(one) : 1);
+					(void)n;
+				}
+        #endif
+			}
+
+			// clear makes the fd not readable.
+			void clear() {
+        #if !defined(_WIN32)
+				if (m_readFd >= 0) {
+					char buff[64];
+					while (::read(m_readFd, buff, sizeof(buff)) > 0) {
+					}
+				}
+        #endif
+			}
+
+		private:
+			int m_readFd{ -1 };
+			int m_writeFd{ -1 };
+		};
+	}
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+/*
+ * time index: a sidecar file <log file>.idx which maps the seconds of the log
+ * file to byte offsets, so a time range is read without scanning the file(see
+ * alog_query.cpp). an entry is added when the record time passes a new second,
+ * and at least every interval bytes, and the entries are written when the log
+ * file is flushed.
+ *
+ * the file is "ALOGIDX1" and the entries {second, offset} in native byte order,
+ * where second counts the seconds of the local time of the records(not utc).
+ * the second of an entry is the latest of all records before its offset, so the
+ * records before the first entry of a second S are all earlier than S. an index
+ * opened on a non-empty log file starts past the file's head, so a reader scans
+ * from 0 for a time at or before the first entry.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace anet {
+	namespace log {
+		static constexpr char gIndex_suffix[] = ".idx";
+		static constexpr char gIndex_magic[] = "ALOGIDX1";
+		static constexpr size_t gIndex_magic_size = 8;
+		// bytes of the log file between two entries at most.
+		static constexpr size_t gIndex_interval_size = 1024 * 1024;
+		// "2026-10-18 12:00:00.000"
+		static constexpr size_t gRecord_time_size = 23;
+
+		struct TimeIndexEntry {
+			int64_t second;
+			uint64_t offset;
+		};
+
+		// isRecordTime checks the time "YYYY-MM-DD hh:mm:ss.mmm" at p.
+		inline bool isRecordTime(const char *p, const char *end) {
+			static const char pattern[] = "dddd-dd-dd dd:dd:dd.ddd";
+			if (end - p < ptrdiff_t(gRecord_time_size)) {
+				return false;
+			}
+			for (size_t i = 0; i < gRecord_time_size; i++) {
+				if (pattern[i] == 'd' ? (p[i] < '0' || p[i] > '9') : p[i] != pattern[i]) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		// recordTime returns the time of a record: a text line starts with it,
+		// json and logfmt records have it as the first field. nullptr if the line
+		// does not start a record(e.g. a hex dump line).
+		inline const char* recordTime(const char *line, const char *end) {
+			if (isRecordTime(line, end)) {
+				return line;
+			}
+			if (end - line > 7 && memcmp(line, "{\"ts\":\"", 7) == 0 && isRecordTime(line + 7, end)) {
+				return line + 7;
+			}
+			if (end - line > 4 && memcmp(line, "ts=\"", 4) == 0 && isRecordTime(line + 4, end)) {
+				return line + 4;
+			}
+			return nullptr;
+		}
+
+		// recordEnd returns the end of the record at p, which is where the next line
+		// with a time starts.
+		inline const char* recordEnd(const char *p, const char *end) {
+			for (;;) {
+				const char *eol = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+				if (eol == nullptr) {
+					return end;
+				}
+				p = eol + 1;
+				if (p >= end || recordTime(p, end) != nullptr) {
+					return p;
+				}
+			}
+		}
+
+		// civilSecond counts the seconds of a date and time since 1970-01-01.
+		inline int64_t civilSecond(int year, int month, int day, int hour, int minute, int second) {
+			// days from civil, see howard hinnant's date algorithms.
+			year -= month <= 2;
+			int64_t era = (year >= 0 ? year : year - 399) / 400;
+			int64_t yoe = year - era * 400;
+			int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+			int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+			int64_t days = era * 146097 + doe - 719468;
+			return days * 86400 + hour * 3600 + minute * 60 + second;
+		}
+
+		// timeSecond converts a record time(see isRecordTime) to its second.
+		inline int64_t timeSecond(const char *p) {
+			auto num = [p](int at, int n) {
+				int v = 0;
+				for (int i = 0; i < n; i++) {
+					v = v * 10 + (p[at + i] - '0');
+				}
+				return v;
+			};
+			return civilSecond(num(0, 4), num(5, 2), num(8, 2), num(11, 2), num(14, 2), num(17, 2));
+		}
+
+		// loadTimeIndex reads the entries of the index of a log file.
+		inline bool loadTimeIndex(const std::string &logPath, std::vector<TimeIndexEntry> &entries) {
+			FILE *file = fopen((logPath + gIndex_suffix).c_str(), "rb");
+			if (file == nullptr) {
+				return false;
+			}
+			char magic[gIndex_magic_size];
+			bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+				memcmp(magic, gIndex_magic, sizeof(magic)) == 0;
+			TimeIndexEntry entry;
+			while (ok && fread(&entry, sizeof(entry), 1, file) == 1) {
+				entries.push_back(entry);
+			}
+			fclose(file);
+			return ok;
+		}
+
+		class TimeIndexWriter final {
+		public:
+			TimeIndexWriter(FILE *file, size_t intervalBytes) : m_file(file),
+				m_intervalBytes(intervalBytes > 0 ? intervalBytes : gIndex_interval_size) {}
+			~TimeIndexWriter() {
+				this->flush();
+				fclose(m_file);
+			}
+			TimeIndexWriter(const TimeIndexWriter &rhs) = delete;
+			TimeIndexWriter& operator=(const TimeIndexWriter &rhs) = delete;
+
+			// open opens(or appends to) the index of the log file.
+			static std::unique_ptr<TimeIndexWriter> open(const std::string &logPath, size_t intervalBytes) {
+				FILE *file = fopen((logPath + gIndex_suffix).c_str(), "ab");
+				if (file == nullptr) {
+					return nullptr;
+				}
+				fseek(file, 0, SEEK_END);
+				if (ftell(file) == 0) {
+					fwrite(gIndex_magic, 1, gIndex_magic_size, file);
+				}
+				return std::make_unique<TimeIndexWriter>(file, intervalBytes);
+			}
+
+		public:
+			// record indexes a record written at offset of the log file.
+			void record(const char *data, size_t len, uint64_t offset) {
+				const char *time = recordTime(data, data + len);
+				// the second is parsed only when the time passes a new second.
+				if (time != nullptr && memcmp(time, m_lastTime, sizeof(m_lastTime)) != 0) {
+					memcpy(m_lastTime, time, sizeof(m_lastTime));
+					int64_t second = timeSecond(time);
+					if (second > m_lastSecond) {
+						m_lastSecond = second;
+						this->add(offset);
+						return;
+					}
+				}
+				if (m_lastSecond >= 0 && offset - m_lastOffset >= m_intervalBytes) {
+					this->add(offset);
+				}
+			}
+
+			// flush writes the entries added since the last flush.
+			void flush() {
+				if (!m_pending.empty()) {
+					fwrite(m_pending.data(), sizeof(TimeIndexEntry), m_pending.size(), m_file);
+					m_pending.clear();
+				}
+				fflush(m_file);
+			}
+
+		private:
+			void add(uint64_t offset) {
+				m_pending.push_back({ m_lastSecond, offset });
+				m_lastOffset = offset;
+			}
+
+		private:
+			FILE *m_file;
+			size_t m_intervalBytes;
+			std::vector<TimeIndexEntry> m_pending;
+			// "YYYY-MM-DD hh:mm:ss" of the last record.
+			char m_lastTime[19] = { 0 };
+			int64_t m_lastSecond{ -1 };
+			uint64_t m_lastOffset{ 0 };
+		};
+	}
+}
@@ -0,0 +1,295 @@
+#pragma once
+
+/*
+ * self metrics of the log: counters kept per thread, so the producers never
+ * contend on them, and summed when a snapshot is read. a counter is written by
+ * its own thread only(a relaxed load and store, no locked instruction) and read
+ * by the snapshot. the counters of the exited threads are folded into the
+ * retired totals.
+ *
+ * latencies are kept in log2 histograms of ns: bucket b counts [2^b, 2^(b+1)).
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "log_process.h"
+#include "log_record.h"
+
+namespace anet {
+	namespace log {
+		static constexpr int gMetrics_buckets = 32;
+
+		// now in ns of the steady clock, for the metrics.
+		inline uint64_t metricsNow() {
+			return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+
+		inline int metricsBucket(uint64_t value) {
+			int bucket = 0;
+			while (value > 1 && bucket + 1 < gMetrics_buckets) {
+				value >>= 1;
+				++bucket;
+			}
+			return bucket;
+		}
+
+		// snapshot of a histogram.
+		struct MetricsHistogram {
+			uint64_t buckets[gMetrics_buckets] = { 0 };
+
+			uint64_t count() const {
+				uint64_t total = 0;
+				for (uint64_t n : buckets) {
+					total += n;
+				}
+				return total;
+			}
+
+			// percentile returns the upper bound of the bucket of the q quantile.
+			uint64_t percentile(double q) const {
+				uint64_t total = this->count();
+				if (total == 0) {
+					return 0;
+				}
+				uint64_t rank = uint64_t(q * double(total - 1)) + 1, seen = 0;
+				for (int b = 0; b < gMetrics_buckets; b++) {
+					seen += buckets[b];
+					if (seen >= rank) {
+						return uint64_t(1) << (b + 1);
+					}
+				}
+				return uint64_t(1) << gMetrics_buckets;
+			}
+		};
+
+		// snapshot of the metrics, see aLog::metrics.
+		struct LogMetrics {
+			// records and bytes handed to the file(or the queue, the shards, the sinks) per level.
+			uint64_t records[int(eLogLevel::allLevelSize)] = { 0 };
+			uint64_t bytes[int(eLogLevel::allLevelSize)] = { 0 };
+			// producers' time building the lines, and handing them over.
+			uint64_t formatNs{ 0 };
+			uint64_t enqueueNs{ 0 };
+
+			// asynchronous queue bytes now, and the most since the start.
+			uint64_t queueDepth{ 0 };
+			uint64_t queueHighWater{ 0 };
+			// batches dropped for the lagging sinks, and their pending bytes.
+			uint64_t sinkDropped{ 0 };
+			uint64_t sinkPending{ 0 };
+			// records the full ring sent to the local file instead.
+			uint64_t ringFallbacks{ 0 };
+
+			// the writer: batches drained from the queue, their bytes, the writes
+			// and the flushes of the file, and the file switches.
+			uint64_t batches{ 0 };
+			MetricsHistogram batchBytes;
+			MetricsHistogram writeNs;
+			uint64_t flushes{ 0 };
+			MetricsHistogram flushNs;
+			uint64_t rotations{ 0 };
+			uint64_t rotationNs{ 0 };
+			uint64_t rotationMaxNs{ 0 };
+		};
+
+		class MetricsRegistry final {
+		public:
+			// the counters of a thread.
+			class ThreadMetrics;
+
+			MetricsRegistry() : m_core(std::make_shared<Core>()), m_id(nextId()) {}
+			MetricsRegistry(const MetricsRegistry &rhs) = delete;
+			MetricsRegistry& operator=(const MetricsRegistry &rhs) = delete;
+
+			enum eCounter : int {
+				recordsCounter = 0,
+				bytesCounter = recordsCounter + int(eLogLevel::allLevelSize),
+				formatCounter = bytesCounter + int(eLogLevel::allLevelSize),
+				enqueueCounter,
+				batchCounter,
+				flushCounter,
+				rotationCounter,
+				rotationNsCounter,
+				rotationMaxCounter,
+				counterSize,
+			};
+			enum eHistogram : int {
+				batchHistogram = 0,
+				writeHistogram,
+				flushHistogram,
+				histogramSize,
+			};
+
+		public:
+			// the calling thread's counters.
+			void record(eLogLevel level, size_t len) {
+				ThreadMetrics &m = this->local();
+				m.add(recordsCounter + int(level), 1);
+				m.add(bytesCounter + int(level), len);
+			}
+			void produce(uint64_t formatNs, uint64_t enqueueNs) {
+				ThreadMetrics &m = this->local();
+				m.add(formatCounter, formatNs);
+				m.add(enqueueCounter, enqueueNs);
+			}
+			void batch(size_t len) {
+				ThreadMetrics &m = this->local();
+				m.add(batchCounter, 1);
+				m.observe(batchHistogram, len);
+			}
+			void write(uint64_t ns) {
+				this->local().observe(writeHistogram, ns);
+			}
+			void flush(uint64_t ns) {
+				ThreadMetrics &m = this->local();
+				m.add(flushCounter, 1);
+				m.observe(flushHistogram, ns);
+			}
+			void rotate(uint64_t ns) {
+				ThreadMetrics &m = this->local();
+				m.add(rotationCounter, 1);
+				m.add(rotationNsCounter, ns);
+				m.max(rotationMaxCounter, ns);
+			}
+
+			// collect sums the counters of all threads into metrics.
+			void collect(LogMetrics &metrics) const {
+				Totals totals;
+				{
+					std::lock_guard<std::mutex> guard(m_core->mutex);
+					totals = m_core->retired;
+					for (ThreadMetrics *m : m_core->live) {
+						m->addTo(totals);
+					}
+				}
+				for (int l = 0; l < int(eLogLevel::allLevelSize); l++) {
+					metrics.records[l] = totals.counters[recordsCounter + l];
+					metrics.bytes[l] = totals.counters[bytesCounter + l];
+				}
+				metrics.formatNs = totals.counters[formatCounter];
+				metrics.enqueueNs = totals.counters[enqueueCounter];
+				metrics.batches = totals.counters[batchCounter];
+				metrics.flushes = totals.counters[flushCounter];
+				metrics.rotations = totals.counters[rotationCounter];
+				metrics.rotationNs = totals.counters[rotationNsCounter];
+				metrics.rotationMaxNs = totals.counters[rotationMaxCounter];
+				for (int b = 0; b < gMetrics_buckets; b++) {
+					metrics.batchBytes.buckets[b] = totals.histograms[batchHistogram][b];
+					metrics.writeNs.buckets[b] = totals.histograms[writeHistogram][b];
+					metrics.flushNs.buckets[b] = totals.histograms[flushHistogram][b];
+				}
+			}
+
+		private:
+			struct Totals {
+				uint64_t counters[counterSize] = { 0 };
+				uint64_t histograms[histogramSize][gMetrics_buckets] = { { 0 } };
+			};
+
+			// the live threads' counters, and the totals of the exited ones. it lives
+			// as long as the registry or a thread's counters.
+			struct Core {
+				std::mutex mutex;
+				std::vector<ThreadMetrics*> live;
+				Totals retired;
+
+				Core() {
+					ForkRegistry::instance().addLeaf(&mutex);
+				}
+				~Core() {
+					ForkRegistry::instance().removeLeaf(&mutex);
+				}
+			};
+
+		public:
+			class ThreadMetrics final {
+			public:
+				explicit ThreadMetrics(std::shared_ptr<Core> core) : m_core(std::move(core)) {
+					std::lock_guard<std::mutex> guard(m_core->mutex);
+					m_core->live.push_back(this);
+				}
+				~ThreadMetrics() {
+					std::lock_guard<std::mutex> guard(m_core->mutex);
+					this->addTo(m_core->retired);
+					auto &live = m_core->live;
+					for (size_t i = 0; i < live.size(); i++) {
+						if (live[i] == this) {
+							live[i] = live.back();
+							live.pop_back();
+							break;
+						}
+					}
+				}
+				ThreadMetrics(const ThreadMetrics &rhs) = delete;
+				ThreadMetrics& operator=(const ThreadMetrics &rhs) = delete;
+
+				// only the owner thread writes, so a load and a store do.
+				inline void add(int counter, uint64_t value) {
+					auto &c = m_counters[counter];
+					c.store(c.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+				}
+				inline void max(int counter, uint64_t value) {
+					auto &c = m_counters[counter];
+					if (value > c.load(std::memory_order_relaxed)) {
+						c.store(value, std::memory_order_relaxed);
+					}
+				}
+				inline void observe(int histogram, uint64_t value) {
+					auto &c = m_histograms[histogram][metricsBucket(value)];
+					c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+				}
+
+				void addTo(Totals &totals) const {
+					for (int i = 0; i < counterSize; i++) {
+						uint64_t value = m_counters[i].load(std::memory_order_relaxed);
+						if (i == rotationMaxCounter) {
+							totals.counters[i] = value > totals.counters[i] ? value : totals.counters[i];
+						} else {
+							totals.counters[i] += value;
+						}
+					}
+					for (int h = 0; h < histogramSize; h++) {
+						for (int b = 0; b < gMetrics_buckets; b++) {
+							totals.histograms[h][b] += m_histograms[h][b].load(std::memory_order_relaxed);
+						}
+					}
+				}
+
+			private:
+				std::shared_ptr<Core> m_core;
+				std::atomic<uint64_t> m_counters[counterSize] = {};
+				std::atomic<uint64_t> m_histograms[histogramSize][gMetrics_buckets] = {};
+			};
+
+		private:
+			// the calling thread's counters of this registry, created at its first use
+			// and folded into the retired totals when the thread exits.
+			ThreadMetrics& local() {
+				using Slots = std::vector<std::pair<uint64_t, std::unique_ptr<ThreadMetrics>>>;
+				static thread_local Slots slots;
+				for (auto &slot : slots) {
+					if (slot.first == m_id) {
+						return *slot.second;
+					}
+				}
+				slots.emplace_back(m_id, std::make_unique<ThreadMetrics>(m_core));
+				return *slots.back().second;
+			}
+
+			static uint64_t nextId() {
+				static std::atomic<uint64_t> id{ 0 };
+				return ++id;
+			}
+
+		private:
+			std::shared_ptr<Core> m_core;
+			uint64_t m_id;
+		};
+	}
+}
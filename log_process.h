@@ -0,0 +1,193 @@
+#pragma once
+
+/*
+ * multi-process safety of the log file.
+ *
+ * fork: ForkRegistry calls the handlers of the registered logs around fork()
+ * (pthread_atfork): before it, a log takes its locks and flushes its file, so
+ * the child does not inherit a held lock or buffered bytes, and in the child it
+ * drops the parent's queue and restarts its writer(see aLog::onFork). the leaf
+ * locks of the registries(a thread takes no other lock while it holds one) are
+ * held over fork too, after the handlers took theirs.
+ *
+ * atomic append: processes which append to the same file(opened with
+ * O_APPEND) must not tear the lines, as buffered stdio writes at its buffer's
+ * boundaries. AtomicAppender gathers whole records and writes a batch with one
+ * write(2) of maxWrite bytes at most, an O_APPEND write is atomic on a local
+ * file system(and up to PIPE_BUF on a fifo). a larger record goes alone.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace anet {
+	namespace log {
+		// bytes of a write(2) of the atomic append.
+		static constexpr size_t gAtomic_write_size = 64 * 1024;
+
+		enum class eForkStage : int {
+			prepareFork = 0,    // in the parent before fork
+			parentFork,         // in the parent after fork
+			childFork,          // in the child after fork
+		};
+
+		class ForkRegistry final {
+		public:
+			using Handler = void(*)(void *owner, eForkStage stage);
+
+			// never destroyed: the fork handlers can not be removed, and the owners
+			// which remove themselves may be destroyed after it at exit.
+			static ForkRegistry& instance() {
+				static ForkRegistry *registry = new ForkRegistry();
+				return *registry;
+			}
+
+			// add registers the handler of owner, the fork handlers are installed at
+			// the first one.
+			void add(void *owner, Handler handler) {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				this->install();
+				for (auto &entry : m_handlers) {
+					if (entry.first == owner) {
+						entry.second = handler;
+						return;
+					}
+				}
+				m_handlers.emplace_back(owner, handler);
+			}
+			void remove(void *owner) {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				m_handlers.erase(std::remove_if(m_handlers.begin(), m_handlers.end(),
+					[owner](const std::pair<void*, Handler> &entry) { return entry.first == owner; }),
+					m_handlers.end());
+			}
+
+			// addLeaf registers a leaf lock, which is held over fork.
+			void addLeaf(std::mutex *mutex) {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				this->install();
+				m_leaves.push_back(mutex);
+			}
+			void removeLeaf(std::mutex *mutex) {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				m_leaves.erase(std::remove(m_leaves.begin(), m_leaves.end(), mutex), m_leaves.end());
+			}
+
+		private:
+			ForkRegistry() = default;
+
+			// install installs the fork handlers once, m_mutex must be held.
+			void install() {
+        #if !defined(_WIN32)
+				if (!m_installed) {
+					m_installed = pthread_atfork(&ForkRegistry::prepare, &ForkRegistry::parent,
+						&ForkRegistry::child) == 0;
+				}
+        #endif
+			}
+
+			// the registry is locked over the fork, the handlers are called in reverse
+			// before it and in order after it, the leaves are locked after them.
+			static void prepare() {
+				ForkRegistry &registry = instance();
+				registry.m_mutex.lock();
+				for (auto it = registry.m_handlers.rbegin(); it != registry.m_handlers.rend(); ++it) {
+					it->second(it->first, eForkStage::prepareFork);
+				}
+				for (std::mutex *leaf : registry.m_leaves) {
+					leaf->lock();
+				}
+			}
+			static void parent() {
+				instance().after(eForkStage::parentFork);
+			}
+			static void child() {
+				instance().after(eForkStage::childFork);
+			}
+			void after(eForkStage stage) {
+				for (auto it = m_leaves.rbegin(); it != m_leaves.rend(); ++it) {
+					(*it)->unlock();
+				}
+				for (auto &entry : m_handlers) {
+					entry.second(entry.first, stage);
+				}
+				m_mutex.unlock();
+			}
+
+		private:
+			std::mutex m_mutex;
+			std::vector<std::pair<void*, Handler>> m_handlers;
+			std::vector<std::mutex*> m_leaves;
+			bool m_installed{ false };
+		};
+
+		class AtomicAppender final {
+		public:
+			explicit AtomicAppender(size_t maxWrite) : m_maxWrite(maxWrite > 0 ? maxWrite : gAtomic_write_size) {
+				m_batch.reserve(m_maxWrite);
+			}
+			AtomicAppender(const AtomicAppender &rhs) = delete;
+			AtomicAppender& operator=(const AtomicAppender &rhs) = delete;
+
+			// append adds a whole record, the batch is written first if the record
+			// does not fit it.
+			void append(int fd, const char *data, size_t len) {
+				if (!m_batch.empty() && m_batch.size() + len > m_maxWrite) {
+					this->flush(fd);
+				}
+				if (len >= m_maxWrite) {
+					writeAll(fd, data, len);
+					return;
+				}
+				m_batch.append(data, len);
+			}
+
+			// flush writes the batch.
+			void flush(int fd) {
+				if (!m_batch.empty()) {
+					writeAll(fd, m_batch.data(), m_batch.size());
+					m_batch.clear();
+				}
+			}
+
+			// drop forgets the batch, in a child which did not write it.
+			void drop() {
+				m_batch.clear();
+			}
+
+		private:
+			static void writeAll(int fd, const char *data, size_t len) {
+        #if !defined(_WIN32)
+				while (len > 0) {
+					ssize_t n = ::write(fd, data, len);
+					if (n < 0) {
+						if (errno == EINTR) {
+							continue;
+						}
+						return;
+					}
+					data += n;
+					len -= size_t(n);
+				}
+        #else
+				(void)fd;
+				(void)data;
+				(void)len;
+        #endif
+			}
+
+		private:
+			size_t m_maxWrite;
+			std::string m_batch;
+		};
+	}
+}
@@ -0,0 +1,319 @@
+#pragma once
+
+/*
+ * call site profiler: which log lines cost the most. every expansion of a log
+ * macro is a call site, which counts its calls, the bytes of its records and
+ * the producer's time of its calls(timed with rdtsc on one call in
+ * 2^sampleShift, and scaled to all calls).
+ *
+ * it is compiled in with ALOG_PROFILE_SITES only, otherwise the macros carry no
+ * trace of it. compiled in, it costs a flag check per call until it is enabled
+ * (see enableSiteProfiler). the counters are kept per thread, as the metrics.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "log_metrics.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace anet {
+	namespace log {
+		// the counters of a thread are allocated in chunks of sites.
+		static constexpr uint32_t gSite_chunk_size = 256;
+		static constexpr uint32_t gSite_chunk_count = 256;
+		// one call in 2^gSite_sample_shift is timed.
+		static constexpr unsigned gSite_sample_shift = 3;
+
+		inline uint64_t siteTicks() {
+        #if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+			return __rdtsc();
+        #else
+			return metricsNow();
+        #endif
+		}
+
+		// bytes of the records of the current call, see aLog::countRecord.
+		inline uint64_t& siteRecordBytes() {
+			static thread_local uint64_t bytes = 0;
+			return bytes;
+		}
+
+		// a call site, a static of the macro's expansion.
+		struct CallSite {
+			const char *file;
+			int line;
+			const char *macro;
+			uint32_t id;
+
+			CallSite(const char *file, int line, const char *macro);
+		};
+
+		// the profile of a call site.
+		struct SiteProfile {
+			const char *file;
+			int line;
+			const char *macro;
+			uint64_t calls;
+			uint64_t bytes;
+			// the estimated producer's ns of all calls.
+			uint64_t ns;
+		};
+
+		class SiteProfiler final {
+		public:
+			static SiteProfiler& instance() {
+				static SiteProfiler profiler;
+				return profiler;
+			}
+
+			struct Counter {
+				std::atomic<uint64_t> calls{ 0 };
+				std::atomic<uint64_t> bytes{ 0 };
+				std::atomic<uint64_t> ticks{ 0 };
+				std::atomic<uint64_t> samples{ 0 };
+			};
+
+		public:
+			// add registers a call site, returns its id.
+			uint32_t add(CallSite *site) {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				m_sites.push_back(site);
+				m_retired.resize(m_sites.size());
+				return uint32_t(m_sites.size() - 1);
+			}
+
+			// enable starts(or stops) the counting, one call in 2^sampleShift is timed.
+			void enable(bool on, unsigned sampleShift = gSite_sample_shift) {
+				if (on) {
+					std::lock_guard<std::mutex> guard(m_mutex);
+					m_startTicks = siteTicks();
+					m_startNs = metricsNow();
+				}
+				m_sampleMask.store((uint64_t(1) << (sampleShift < 32 ? sampleShift : 31)) - 1, std::memory_order_relaxed);
+				m_enabled.store(on, std::memory_order_release);
+			}
+			bool enabled() const {
+				return m_enabled.load(std::memory_order_relaxed);
+			}
+			uint64_t sampleMask() const {
+				return m_sampleMask.load(std::memory_order_relaxed);
+			}
+
+			// counter returns the calling thread's counter of a site.
+			Counter& counter(uint32_t id) {
+				ThreadSites &sites = this->local();
+				if (id >= gSite_chunk_size * gSite_chunk_count) {
+					static thread_local Counter overflow;
+					return overflow;
+				}
+				auto &chunk = sites.chunks[id / gSite_chunk_size];
+				Counter *counters = chunk.load(std::memory_order_relaxed);
+				if (counters == nullptr) {
+					counters = new Counter[gSite_chunk_size];
+					chunk.store(counters, std::memory_order_release);
+				}
+				return counters[id % gSite_chunk_size];
+			}
+
+			// top returns the n sites of the most time, n = 0 for all.
+			std::vector<SiteProfile> top(size_t n) const {
+				std::vector<Totals> totals;
+				double nsPerTick = 1.0;
+				std::vector<CallSite*> sites;
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					sites = m_sites;
+					totals = m_retired;
+					for (ThreadSites *thread : m_live) {
+						thread->addTo(totals);
+					}
+					uint64_t ticks = siteTicks() - m_startTicks;
+					if (ticks > 0) {
+						nsPerTick = double(metricsNow() - m_startNs) / double(ticks);
+					}
+				}
+
+				std::vector<SiteProfile> profiles;
+				for (size_t i = 0; i < sites.size() && i < totals.size(); i++) {
+					const Totals &t = totals[i];
+					if (t.calls == 0) {
+						continue;
+					}
+					double ns = t.samples > 0 ? double(t.ticks) * nsPerTick * double(t.calls) / double(t.samples) : 0;
+					profiles.push_back({ sites[i]->file, sites[i]->line, sites[i]->macro, t.calls, t.bytes, uint64_t(ns) });
+				}
+				std::sort(profiles.begin(), profiles.end(), [](const SiteProfile &a, const SiteProfile &b) {
+					return a.ns != b.ns ? a.ns > b.ns : a.calls > b.calls;
+				});
+				if (n > 0 && profiles.size() > n) {
+					profiles.resize(n);
+				}
+				return profiles;
+			}
+
+			// a dump asked by a signal, taken by the log's writer thread.
+			void requestDump() {
+				m_dumpRequest.store(true, std::memory_order_relaxed);
+			}
+			bool takeDumpRequest() {
+				return m_dumpRequest.load(std::memory_order_relaxed) &&
+					m_dumpRequest.exchange(false, std::memory_order_relaxed);
+			}
+
+		private:
+			SiteProfiler() {
+				ForkRegistry::instance().addLeaf(&m_mutex);
+			}
+			~SiteProfiler() {
+				ForkRegistry::instance().removeLeaf(&m_mutex);
+			}
+
+			struct Totals {
+				uint64_t calls{ 0 };
+				uint64_t bytes{ 0 };
+				uint64_t ticks{ 0 };
+				uint64_t samples{ 0 };
+			};
+
+			// the counters of a thread, folded into the retired totals when it exits.
+			struct ThreadSites {
+				SiteProfiler *profiler{ nullptr };
+				std::atomic<Counter*> chunks[gSite_chunk_count] = {};
+
+				~ThreadSites() {
+					{
+						std::lock_guard<std::mutex> guard(profiler->m_mutex);
+						this->addTo(profiler->m_retired);
+						auto &live = profiler->m_live;
+						live.erase(std::remove(live.begin(), live.end(), this), live.end());
+					}
+					for (auto &chunk : chunks) {
+						delete[] chunk.load(std::memory_order_acquire);
+					}
+				}
+
+				void addTo(std::vector<Totals> &totals) const {
+					for (uint32_t c = 0; c < gSite_chunk_count; c++) {
+						const Counter *counters = chunks[c].load(std::memory_order_acquire);
+						if (counters == nullptr) {
+							continue;
+						}
+						for (uint32_t i = 0; i < gSite_chunk_size; i++) {
+							size_t id = size_t(c) * gSite_chunk_size + i;
+							if (id >= totals.size()) {
+								break;
+							}
+							totals[id].calls += counters[i].calls.load(std::memory_order_relaxed);
+							totals[id].bytes += counters[i].bytes.load(std::memory_order_relaxed);
+							totals[id].ticks += counters[i].ticks.load(std::memory_order_relaxed);
+							totals[id].samples += counters[i].samples.load(std::memory_order_relaxed);
+						}
+					}
+				}
+			};
+
+			ThreadSites& local() {
+				static thread_local std::unique_ptr<ThreadSites> sites;
+				if (sites == nullptr) {
+					sites = std::make_unique<ThreadSites>();
+					sites->profiler = this;
+					std::lock_guard<std::mutex> guard(m_mutex);
+					m_live.push_back(sites.get());
+				}
+				return *sites;
+			}
+
+		private:
+			std::atomic<bool> m_enabled{ false };
+			std::atomic<uint64_t> m_sampleMask{ (uint64_t(1) << gSite_sample_shift) - 1 };
+			std::atomic<bool> m_dumpRequest{ false };
+
+			mutable std::mutex m_mutex;
+			std::vector<CallSite*> m_sites;
+			std::vector<ThreadSites*> m_live;
+			std::vector<Totals> m_retired;
+			// the clocks when it was enabled, to convert the ticks to ns.
+			uint64_t m_startTicks{ 0 };
+			uint64_t m_startNs{ 0 };
+		};
+
+		inline CallSite::CallSite(const char *file, int line, const char *macro) :
+			file(file), line(line), macro(macro), id(SiteProfiler::instance().add(this)) {}
+
+		// the profile of a call of a site, from the macro to the hand-over.
+		class SiteScope final {
+		public:
+			explicit SiteScope(CallSite &site) {
+				SiteProfiler &profiler = SiteProfiler::instance();
+				if (!profiler.enabled()) {
+					return;
+				}
+				m_counter = &profiler.counter(site.id);
+				uint64_t calls = m_counter->calls.load(std::memory_order_relaxed);
+				m_counter->calls.store(calls + 1, std::memory_order_relaxed);
+				siteRecordBytes() = 0;
+				if ((calls & profiler.sampleMask()) == 0) {
+					m_start = siteTicks();
+				}
+			}
+			~SiteScope() {
+				if (m_counter == nullptr) {
+					return;
+				}
+				if (m_start != 0) {
+					uint64_t ticks = siteTicks() - m_start;
+					m_counter->ticks.store(m_counter->ticks.load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+					m_counter->samples.store(m_counter->samples.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+				}
+				m_counter->bytes.store(m_counter->bytes.load(std::memory_order_relaxed) + siteRecordBytes(),
+					std::memory_order_relaxed);
+			}
+			SiteScope(const SiteScope &rhs) = delete;
+			SiteScope& operator=(const SiteScope &rhs) = delete;
+
+		private:
+			SiteProfiler::Counter *m_counter{ nullptr };
+			uint64_t m_start{ 0 };
+		};
+
+		// formatSiteProfile formats the profiles as a table, with each site's share
+		// of the time of all sites.
+		inline std::string formatSiteProfile(const std::vector<SiteProfile> &profiles) {
+			uint64_t total = 0;
+			for (auto &profile : SiteProfiler::instance().top(0)) {
+				total += profile.ns;
+			}
+			std::string table = " rank        calls        bytes    total ms   ns/call  share  site\n";
+			char line[512];
+			for (size_t i = 0; i < profiles.size(); i++) {
+				const SiteProfile &p = profiles[i];
+				std::snprintf(line, sizeof(line), "%5zu %12llu %12llu %11.3f %9.0f %5.1f%%  %s:%d %s\n",
+					i + 1, (unsigned long long)p.calls, (unsigned long long)p.bytes, double(p.ns) / 1e6,
+					double(p.ns) / double(p.calls), total > 0 ? 100.0 * double(p.ns) / double(total) : 0.0,
+					p.file, p.line, p.macro);
+				table += line;
+			}
+			return table;
+		}
+	}
+}
+
+// the call site of a macro's expansion.
+#if defined(ALOG_PROFILE_SITES)
+#define ALOG_SITE_SCOPE(macro) \
+	static anet::log::CallSite _alogSite(__FILE__, __LINE__, #macro); \
+	anet::log::SiteScope _alogSiteScope(_alogSite)
+#else
+#define ALOG_SITE_SCOPE(macro)
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+
+/*
+ * log record framing shared by the asynchronous queue, the writer and the sinks:
+ * a batch is a sequence of RecordHeader + len bytes.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+namespace anet {
+	namespace log {
+		// log level enum.
+		enum class eLogLevel : int {
+			debugLevel = 0,
+			infoLevel,
+			warnLevel,
+			critLevel,
+			allLevelSize,
+		};
+
+		// asynchronous queue's record frame: the header followed by len bytes of the line.
+		struct RecordHeader {
+			uint32_t len{ 0 };
+			uint8_t level{ 0 };
+			uint8_t flags{ 0 };
+			uint16_t reserved{ 0 };
+		};
+
+		// record flags: the record is a packed key/value record(see kv_encode.h).
+		static constexpr uint8_t gRecordFlag_kv = 0x01;
+		// record flags: padding to the wrap of a shared memory ring(see shm_ring.h).
+		static constexpr uint8_t gRecordFlag_pad = 0x02;
+
+		// forEachRecord calls func(header, data) for each record of a batch.
+		template <typename Func>
+		inline void forEachRecord(const char *batch, size_t len, Func &&func) {
+			size_t pos = 0;
+			while (pos + sizeof(RecordHeader) <= len) {
+				RecordHeader header;
+				memcpy(&header, batch + pos, sizeof(header));
+				pos += sizeof(header);
+				if (pos + header.len > len) {
+					break;
+				}
+				func(header, batch + pos);
+				pos += header.len;
+			}
+		}
+	}
+}
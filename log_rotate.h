@@ -0,0 +1,349 @@
+#pragma once
+
+/*
+ * log file rotation by time and by size. a helper thread opens(and preallocates)
+ * the next files ahead of time, closes the retired ones and deletes the files
+ * beyond the retention limits, so the writer just swaps the file pointer at the
+ * rotation boundary and never waits on the file system metadata.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log_index.h"
+#include "log_thread.h"
+
+#if defined(__linux__)
+#include <fcntl.h>
+#endif
+
+namespace anet {
+	namespace log {
+		// rotation and retention policy, 0 means no limit.
+		struct RotatePolicy {
+			// switch to <prefix>YYYYMMDD_HH.N.log when the file reaches it.
+			uint64_t maxFileSize{ 0 };
+			// delete the oldest files beyond maxFiles or maxTotalSize.
+			size_t maxFiles{ 0 };
+			uint64_t maxTotalSize{ 0 };
+			// space reserved for the prepared files.
+			uint64_t preallocSize{ 0 };
+		};
+
+		// preallocateFile reserves size bytes of blocks without changing the file size,
+		// so appending writes do not allocate. linux only, a no-op elsewhere.
+		inline void preallocateFile(FILE *file, uint64_t size) {
+        #if defined(__linux__)
+			if (file != nullptr && size > 0) {
+				(void)fallocate(fileno(file), FALLOC_FL_KEEP_SIZE, 0, off_t(size));
+			}
+        #else
+			(void)file;
+			(void)size;
+        #endif
+		}
+
+		// fileSize returns the size of an opened file.
+		inline uint64_t fileSize(FILE *file) {
+			if (file == nullptr || fseek(file, 0, SEEK_END) != 0) {
+				return 0;
+			}
+			long size = ftell(file);
+			return size > 0 ? uint64_t(size) : 0;
+		}
+
+		// buildLogFileName builds <dir>/<YYYYMMDD>/<prefix>YYYYMMDD_HH[.index].log
+		// [suffix], the name of the log file of the hour t.
+		inline std::string buildLogFileName(const std::string &dir, const std::string &prefix,
+			const struct tm &t, int index, const char *suffix = "") {
+			char date[40];
+			std::snprintf(date, sizeof(date), "%04d%02d%02d", 1900 + t.tm_year, t.tm_mon + 1, t.tm_mday);
+			char hour[40];
+			if (index > 0) {
+				std::snprintf(hour, sizeof(hour), "_%02d.%d.log", t.tm_hour, index);
+			} else {
+				std::snprintf(hour, sizeof(hour), "_%02d.log", t.tm_hour);
+			}
+			return dir + "/" + date + "/" + prefix + date + hour + suffix;
+		}
+
+		// isLogFileName checks the name of a log file of prefix:
+		// <prefix>YYYYMMDD_HH[.N].log[.zst|.gz]. the files of other prefixes, the
+		// archives, the shards and the indexes do not match.
+		inline bool isLogFileName(const std::string &name, const std::string &prefix) {
+			auto digits = [&name](size_t at, size_t n) {
+				for (size_t i = at; i < at + n; i++) {
+					if (i >= name.size() || name[i] < '0' || name[i] > '9') {
+						return false;
+					}
+				}
+				return true;
+			};
+			size_t p = prefix.size();
+			if (name.compare(0, p, prefix) != 0 || !digits(p, 8) || p + 8 >= name.size() ||
+				name[p + 8] != '_' || !digits(p + 9, 2)) {
+				return false;
+			}
+			p += 11;
+			if (p + 1 < name.size() && name[p] == '.' && digits(p + 1, 1)) {
+				for (++p; p < name.size() && name[p] >= '0' && name[p] <= '9'; ++p) {
+				}
+			}
+			if (name.compare(p, 4, ".log") != 0) {
+				return false;
+			}
+			std::string rest = name.substr(p + 4);
+			return rest.empty() || rest == ".zst" || rest == ".gz";
+		}
+
+		// applyRetention deletes the oldest log files(see isLogFileName) under dir
+		// beyond the policy's limits, the files in keep are never deleted.
+		inline void applyRetention(const std::string &dir, const std::string &prefix,
+			const RotatePolicy &policy, const std::set<std::string> &keep) {
+			namespace fs = std::filesystem;
+			if (policy.maxFiles == 0 && policy.maxTotalSize == 0) {
+				return;
+			}
+
+			struct Entry {
+				fs::file_time_type time;
+				std::string path;
+				uint64_t size;
+			};
+			std::vector<Entry> files;
+			uint64_t total = 0;
+			std::error_code ec;
+			for (fs::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+				if (!it->is_regular_file(ec)) {
+					continue;
+				}
+				// just the log files, a time index goes with its log file.
+				if (!isLogFileName(it->path().filename().string(), prefix)) {
+					continue;
+				}
+				// the prepared files are empty and not counted.
+				Entry entry{ it->last_write_time(ec), it->path().string(), uint64_t(it->file_size(ec)) };
+				if (ec || entry.size == 0) {
+					continue;
+				}
+				total += entry.size;
+				files.push_back(std::move(entry));
+			}
+
+			// the oldest first.
+			std::sort(files.begin(), files.end(), [](const Entry &a, const Entry &b) {
+				return a.time != b.time ? a.time < b.time : a.path < b.path;
+			});
+			size_t count = files.size();
+			for (auto &entry : files) {
+				bool over = (policy.maxFiles > 0 && count > policy.maxFiles) ||
+					(policy.maxTotalSize > 0 && total > policy.maxTotalSize);
+				if (!over) {
+					break;
+				}
+				if (keep.count(entry.path) > 0) {
+					continue;
+				}
+				if (fs::remove(entry.path, ec)) {
+					fs::remove(entry.path + gIndex_suffix, ec);
+					--count;
+					total -= entry.size;
+					// the date folder is removed once it is empty.
+					fs::path parent = fs::path(entry.path).parent_path();
+					if (parent != fs::path(dir) && fs::is_empty(parent, ec)) {
+						fs::remove(parent, ec);
+					}
+				}
+			}
+		}
+
+		// file preparer: the helper thread of rotation.
+		class FilePreparer final {
+		public:
+			// opener creates the folder and opens a file for appending.
+			using Opener = std::function<FILE*(const std::string &path)>;
+
+			FilePreparer(const RotatePolicy &policy, Opener opener) :
+				m_policy(policy), m_opener(std::move(opener)) {
+				m_th = std::thread([this]() { this->threadFunc(); });
+			}
+			~FilePreparer() {
+				this->stop();
+			}
+			FilePreparer(const FilePreparer &rhs) = delete;
+			FilePreparer& operator=(const FilePreparer &rhs) = delete;
+
+		public:
+			const RotatePolicy& policy() const {
+				return m_policy;
+			}
+
+			// prepare opens the files of paths ahead, the prepared files which are
+			// not wanted any more are closed(and deleted if empty). a prepare which a
+			// later one supersedes is skipped, as the writer may have passed its paths.
+			void prepare(std::vector<std::string> paths) {
+				uint64_t seq = 0;
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					seq = ++m_prepares;
+				}
+				this->post([this, seq, paths = std::move(paths)]() {
+					std::set<std::string> wanted(paths.begin(), paths.end());
+					std::vector<std::string> toOpen;
+					std::vector<std::pair<std::string, FILE*>> stale;
+					{
+						std::lock_guard<std::mutex> guard(m_mutex);
+						if (seq != m_prepares) {
+							return;
+						}
+						// the writer is past the other claims, so only the wanted ones matter.
+						for (auto it = m_claimed.begin(); it != m_claimed.end();) {
+							it = wanted.count(*it) == 0 ? m_claimed.erase(it) : ++it;
+						}
+						for (auto it = m_prepared.begin(); it != m_prepared.end();) {
+							if (wanted.count(it->first) == 0) {
+								stale.push_back(*it);
+								it = m_prepared.erase(it);
+							} else {
+								++it;
+							}
+						}
+						for (auto &path : paths) {
+							if (m_prepared.count(path) == 0 && m_claimed.count(path) == 0) {
+								toOpen.push_back(path);
+							}
+						}
+					}
+					for (auto &file : stale) {
+						bool empty = fileSize(file.second) == 0;
+						fclose(file.second);
+						if (empty) {
+							std::remove(file.first.c_str());
+						}
+					}
+					for (auto &path : toOpen) {
+						FILE *file = m_opener(path);
+						if (file == nullptr) {
+							continue;
+						}
+						preallocateFile(file, m_policy.preallocSize);
+						std::lock_guard<std::mutex> guard(m_mutex);
+						if (m_claimed.count(path) > 0) {
+							// the writer has opened it by itself meanwhile.
+							fclose(file);
+							continue;
+						}
+						m_prepared[path] = file;
+					}
+				});
+			}
+
+			// take returns the prepared file of path, or nullptr if it is not ready,
+			// then the caller opens it and the helper does not prepare it any more.
+			FILE* take(const std::string &path) {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				auto it = m_prepared.find(path);
+				if (it == m_prepared.end()) {
+					m_claimed.insert(path);
+					return nullptr;
+				}
+				FILE *file = it->second;
+				m_prepared.erase(it);
+				return file;
+			}
+
+			// retire closes a file which is switched out.
+			void retire(FILE *file) {
+				this->post([file]() { fclose(file); });
+			}
+
+			// retain deletes the oldest files under dir beyond the policy's limits.
+			void retain(const std::string &dir, const std::string &prefix, const std::string &current) {
+				this->post([this, dir, prefix, current]() {
+					std::set<std::string> keep;
+					keep.insert(std::filesystem::path(current).string());
+					{
+						std::lock_guard<std::mutex> guard(m_mutex);
+						for (auto &file : m_prepared) {
+							keep.insert(file.first);
+						}
+					}
+					applyRetention(dir, prefix, m_policy, keep);
+				});
+			}
+
+			// stop runs the posted tasks, closes the unused prepared files and stops.
+			void stop() {
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					if (m_quit) {
+						return;
+					}
+					m_quit = true;
+				}
+				m_cond.notify_one();
+				if (m_th.joinable()) {
+					m_th.join();
+				}
+				for (auto &file : m_prepared) {
+					bool empty = fileSize(file.second) == 0;
+					fclose(file.second);
+					if (empty) {
+						std::remove(file.first.c_str());
+					}
+				}
+				m_prepared.clear();
+			}
+
+		private:
+			void post(std::function<void()> task) {
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					m_tasks.push_back(std::move(task));
+				}
+				m_cond.notify_one();
+			}
+
+			void threadFunc() {
+				placeLogThread("rotate");
+				for (;;) {
+					std::function<void()> task;
+					{
+						std::unique_lock<std::mutex> lock(m_mutex);
+						m_cond.wait(lock, [this]() { return m_quit || !m_tasks.empty(); });
+						if (m_tasks.empty()) {
+							return;
+						}
+						task = std::move(m_tasks.front());
+						m_tasks.pop_front();
+					}
+					task();
+				}
+			}
+
+		private:
+			RotatePolicy m_policy;
+			Opener m_opener;
+			std::thread m_th;
+			std::mutex m_mutex;
+			std::condition_variable m_cond;
+			std::deque<std::function<void()>> m_tasks;
+			std::map<std::string, FILE*> m_prepared;
+			std::set<std::string> m_claimed;
+			// prepares posted, the last one is run.
+			uint64_t m_prepares{ 0 };
+			bool m_quit{ false };
+		};
+	}
+}
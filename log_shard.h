@@ -0,0 +1,232 @@
+#pragma once
+
+/*
+ * per-thread shards: every producer thread writes its own file next to the log
+ * file, <path>/<YYYYMMDD>/<prefix>YYYYMMDD_HH.t<tid>.log, so the threads never
+ * contend on a queue or a file lock. alog_merge merges the shards of an hour
+ * back into one stream ordered by the time prefix.
+ *
+ * a shard is only locked by its own thread(and once by the owner at release),
+ * so the lock is never contended on the hot path.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "log_record.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace anet {
+	namespace log {
+		// stdio buffer of a shard.
+		static constexpr size_t gShard_buffer_size = 256 * 1024;
+
+		// the os thread id, which names the shard.
+		inline uint64_t currentThreadId() {
+        #if defined(_WIN32)
+			return uint64_t(GetCurrentThreadId());
+        #elif defined(__linux__)
+			return uint64_t(syscall(SYS_gettid));
+        #else
+			return uint64_t(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        #endif
+		}
+
+		class ThreadShards final {
+		public:
+			// opener creates the folder and opens a file for appending.
+			using Opener = std::function<FILE*(const std::string &path)>;
+
+			ThreadShards(const std::string &dir, const std::string &prefix, Opener opener) :
+				m_dir(dir), m_prefix(prefix), m_opener(std::move(opener)), m_id(nextId()) {}
+			~ThreadShards() {
+				this->close();
+			}
+			ThreadShards(const ThreadShards &rhs) = delete;
+			ThreadShards& operator=(const ThreadShards &rhs) = delete;
+
+		public:
+			// write appends a line to the calling thread's shard, crit lines are flushed.
+			void write(eLogLevel level, const char *data, size_t len) {
+				Shard *shard = this->current();
+				if (shard == nullptr) {
+					return;
+				}
+				std::lock_guard<std::mutex> guard(shard->mutex);
+				if (!this->prepare(*shard)) {
+					return;
+				}
+				fwrite(data, 1, len, shard->file);
+				if (level == eLogLevel::critLevel) {
+					fflush(shard->file);
+				}
+			}
+
+			// flush flushes the calling thread's shard.
+			void flush() {
+				Shard *shard = this->current();
+				if (shard != nullptr) {
+					std::lock_guard<std::mutex> guard(shard->mutex);
+					if (shard->file != nullptr) {
+						fflush(shard->file);
+					}
+				}
+			}
+
+			// close closes all shards, the later lines of their threads are dropped.
+			void close() {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				for (auto &weak : m_shards) {
+					if (auto shard = weak.lock()) {
+						std::lock_guard<std::mutex> shardGuard(shard->mutex);
+						shard->closeFile();
+						shard->closed = true;
+					}
+				}
+				m_shards.clear();
+			}
+
+			// prepareFork locks the shards and flushes them, so a child inherits neither
+			// a held lock nor buffered bytes. afterFork unlocks them, in the parent and
+			// in the child.
+			void prepareFork() {
+				m_mutex.lock();
+				for (auto &weak : m_shards) {
+					if (auto shard = weak.lock()) {
+						shard->mutex.lock();
+						if (shard->file != nullptr) {
+							fflush(shard->file);
+						}
+						m_forkLocked.push_back(std::move(shard));
+					}
+				}
+			}
+			void afterFork() {
+				for (auto it = m_forkLocked.rbegin(); it != m_forkLocked.rend(); ++it) {
+					(*it)->mutex.unlock();
+				}
+				m_forkLocked.clear();
+				m_mutex.unlock();
+			}
+
+		private:
+			struct Shard {
+				std::mutex mutex;
+				FILE *file{ nullptr };
+				time_t nextSwitch{ 0 };
+				bool closed{ false };
+				std::unique_ptr<char[]> buffer;
+
+				~Shard() {
+					this->closeFile();
+				}
+				void closeFile() {
+					if (file != nullptr) {
+						fclose(file);
+						file = nullptr;
+					}
+				}
+			};
+
+			// the shards of the calling thread, one per ThreadShards instance. they are
+			// closed(and flushed) when the thread exits.
+			using ThreadSlots = std::vector<std::pair<uint64_t, std::shared_ptr<Shard>>>;
+			static ThreadSlots& threadSlots() {
+				static thread_local ThreadSlots slots;
+				return slots;
+			}
+
+			static uint64_t nextId() {
+				static std::atomic<uint64_t> id{ 0 };
+				return ++id;
+			}
+
+			// current returns the calling thread's shard, registered at its first line.
+			Shard* current() {
+				ThreadSlots &slots = threadSlots();
+				for (auto &slot : slots) {
+					if (slot.first == m_id) {
+						return slot.second.get();
+					}
+				}
+				auto shard = std::make_shared<Shard>();
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					// forget the shards of the exited threads.
+					for (size_t i = 0; i < m_shards.size();) {
+						if (m_shards[i].expired()) {
+							m_shards[i] = m_shards.back();
+							m_shards.pop_back();
+						} else {
+							++i;
+						}
+					}
+					m_shards.push_back(shard);
+				}
+				slots.emplace_back(m_id, shard);
+				return shard.get();
+			}
+
+			// prepare opens the shard of the current hour, shard's mutex must be held.
+			bool prepare(Shard &shard) {
+				if (shard.closed) {
+					return false;
+				}
+				time_t now = time(nullptr);
+				if (shard.file != nullptr && now < shard.nextSwitch) {
+					return true;
+				}
+				shard.closeFile();
+
+				// the threads switch at the same time, localtime is not reentrant.
+				struct tm t;
+            #if defined(_WIN32)
+				localtime_s(&t, &now);
+            #else
+				localtime_r(&now, &t);
+            #endif
+				shard.nextSwitch = now - t.tm_min * 60 - t.tm_sec + 3600;
+				char fileName[512];
+				std::snprintf(fileName, sizeof(fileName), "%s/%04d%02d%02d/%s%04d%02d%02d_%02d.t%llu.log",
+					m_dir.c_str(), 1900 + t.tm_year, t.tm_mon + 1, t.tm_mday,
+					m_prefix.c_str(), 1900 + t.tm_year, t.tm_mon + 1, t.tm_mday, t.tm_hour,
+					(unsigned long long)currentThreadId());
+				shard.file = m_opener(fileName);
+				if (shard.file == nullptr) {
+					return false;
+				}
+				if (shard.buffer == nullptr) {
+					shard.buffer.reset(new char[gShard_buffer_size]);
+				}
+				setvbuf(shard.file, shard.buffer.get(), _IOFBF, gShard_buffer_size);
+				return true;
+			}
+
+		private:
+			std::string m_dir;
+			std::string m_prefix;
+			Opener m_opener;
+			uint64_t m_id;
+
+			// all shards, to close them at release.
+			std::mutex m_mutex;
+			std::vector<std::weak_ptr<Shard>> m_shards;
+			// the shards locked over fork.
+			std::vector<std::shared_ptr<Shard>> m_forkLocked;
+		};
+	}
+}
@@ -0,0 +1,479 @@
+#pragma once
+
+/*
+ * log sinks: besides the log file, records are fanned out to sinks(console,
+ * memory, callback, rotating file, ...), each with its own level and format.
+ *
+ * the writer publishes a batch of framed records once, and every sink holds it
+ * by reference. each sink drains the shared batches with its own cursor on its
+ * own thread, so a slow sink never slows down the others or the producers: a
+ * sink which lags more than the pending limit skips the oldest batches. a batch
+ * is rendered in the json or logfmt format once, by the first sink of the format
+ * which drains it, and shared with the other sinks of the format.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log_record.h"
+#include "kv_encode.h"
+#include "variable_parameter_build.h"
+#include "log_thread.h"
+#include "log_rotate.h"
+
+namespace anet {
+	namespace log {
+		// pending bytes of the shared batches, a sink behind it skips batches.
+		static constexpr size_t gSink_max_pending_size = 64 * 1024 * 1024;
+
+		// sink interface.
+		class LogSink {
+		public:
+			explicit LogSink(eLogLevel level = eLogLevel::debugLevel,
+				eRecordFormat format = eRecordFormat::textFormat) :
+				m_level(level), m_format(format) {}
+			virtual ~LogSink() {}
+			LogSink(const LogSink &rhs) = delete;
+			LogSink& operator=(const LogSink &rhs) = delete;
+
+		public:
+			// write a rendered line(with the tail "\n").
+			virtual void write(eLogLevel level, const char *data, size_t len) = 0;
+
+			// flush is called after each batch.
+			virtual void flush() {}
+
+			eLogLevel level() const {
+				return m_level;
+			}
+			eRecordFormat format() const {
+				return m_format;
+			}
+			// records dropped as the sink lagged.
+			size_t dropped() const {
+				return m_dropped.load(std::memory_order_relaxed);
+			}
+			void addDropped(size_t count) {
+				m_dropped.fetch_add(count, std::memory_order_relaxed);
+			}
+
+		protected:
+			eLogLevel m_level;
+			eRecordFormat m_format;
+			std::atomic<size_t> m_dropped{ 0 };
+		};
+
+		// console sink: stdout or stderr.
+		class ConsoleSink : public LogSink {
+		public:
+			explicit ConsoleSink(eLogLevel level = eLogLevel::debugLevel, FILE *out = stdout,
+				eRecordFormat format = eRecordFormat::textFormat) :
+				LogSink(level, format), m_out(out) {}
+
+			void write(eLogLevel, const char *data, size_t len) override {
+				fwrite(data, 1, len, m_out);
+			}
+			void flush() override {
+				fflush(m_out);
+			}
+
+		private:
+			FILE *m_out;
+		};
+
+		// memory sink: keeps the latest maxSize bytes of lines.
+		class MemorySink : public LogSink {
+		public:
+			explicit MemorySink(size_t maxSize, eLogLevel level = eLogLevel::debugLevel,
+				eRecordFormat format = eRecordFormat::textFormat) :
+				LogSink(level, format), m_maxSize(maxSize) {}
+
+			void write(eLogLevel, const char *data, size_t len) override {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				m_data.append(data, len);
+				if (m_data.size() > m_maxSize) {
+					// drop whole lines from the head.
+					size_t cut = m_data.size() - m_maxSize;
+					size_t pos = m_data.find('\n', cut > 0 ? cut - 1 : 0);
+					m_data.erase(0, pos == std::string::npos ? m_data.size() : pos + 1);
+				}
+			}
+
+			// snapshot returns a copy of the kept lines.
+			std::string snapshot() const {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				return m_data;
+			}
+
+		private:
+			size_t m_maxSize;
+			mutable std::mutex m_mutex;
+			std::string m_data;
+		};
+
+		// callback sink.
+		class CallbackSink : public LogSink {
+		public:
+			using Callback = std::function<void(eLogLevel, const char*, size_t)>;
+			explicit CallbackSink(Callback callback, eLogLevel level = eLogLevel::debugLevel,
+				eRecordFormat format = eRecordFormat::textFormat) :
+				LogSink(level, format), m_callback(std::move(callback)) {}
+
+			void write(eLogLevel level, const char *data, size_t len) override {
+				m_callback(level, data, len);
+			}
+
+		private:
+			Callback m_callback;
+		};
+
+		// rotating file sink: the files are named as the log files(see buildLogFileName),
+		// switched every hour, and by size and deleted by the policy's limits as the
+		// log files are(see RotatePolicy). the files are plain, not compressed, and
+		// switched and retained on the sink's thread.
+		class RotatingFileSink : public LogSink {
+		public:
+			RotatingFileSink(const std::string &dir, const std::string &prefix,
+				eLogLevel level = eLogLevel::debugLevel, eRecordFormat format = eRecordFormat::textFormat,
+				const RotatePolicy &policy = RotatePolicy()) :
+				LogSink(level, format), m_dir(dir), m_prefix(prefix), m_policy(policy) {}
+			~RotatingFileSink() override {
+				if (m_file != nullptr) {
+					fclose(m_file);
+				}
+			}
+
+			void write(eLogLevel, const char *data, size_t len) override {
+				if (this->prepareFile()) {
+					fwrite(data, 1, len, m_file);
+					m_size += len;
+				}
+			}
+			void flush() override {
+				if (m_file != nullptr) {
+					fflush(m_file);
+				}
+			}
+
+		private:
+			// prepareFile opens the file of the current hour, or the next index of it
+			// when the file reaches the policy's size.
+			bool prepareFile() {
+				time_t s = time(nullptr);
+				bool full = m_policy.maxFileSize > 0 && m_size >= m_policy.maxFileSize;
+				if (m_file != nullptr && s < m_nextSwitch && !full) {
+					return true;
+				}
+				if (m_file != nullptr) {
+					fclose(m_file);
+					m_file = nullptr;
+					m_size = 0;
+				}
+
+				struct tm t = *localtime(&s);
+				if (s >= m_nextSwitch) {
+					m_index = 0;
+				} else if (full) {
+					++m_index;
+				}
+				m_nextSwitch = s - t.tm_min * 60 - t.tm_sec + 3600;
+				std::string path = buildLogFileName(m_dir, m_prefix, t, m_index);
+				std::error_code ec;
+				std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+				m_file = fopen(path.c_str(), "a+");
+				if (m_file == nullptr) {
+					return false;
+				}
+				m_size = fileSize(m_file);
+				preallocateFile(m_file, m_policy.preallocSize);
+				applyRetention(m_dir, m_prefix, m_policy, { path });
+				return true;
+			}
+
+		private:
+			std::string m_dir;
+			std::string m_prefix;
+			RotatePolicy m_policy;
+			FILE *m_file{ nullptr };
+			int m_index{ 0 };
+			uint64_t m_size{ 0 };
+			time_t m_nextSwitch{ 0 };
+		};
+
+		// renders a packed key/value record with a format, see aLog::encodeKvRecord.
+		using KvRecordRenderer = std::function<bool(SStreamType&, eRecordFormat, eLogLevel, const char*, size_t)>;
+
+		// renderTextLine converts a text line("time [level] msg\n") to the format.
+		template <typename Stream>
+		inline void renderTextLine(Stream &ss, eRecordFormat format, const char *data, size_t len) {
+			if (len > 0 && data[len - 1] == '\n') {
+				--len;
+			}
+			// the prefix of gLog_out_format.
+			const char *levelBegin = (const char*)memchr(data, '[', len);
+			const char *levelEnd = levelBegin != nullptr ?
+				(const char*)memchr(levelBegin, ']', len - size_t(levelBegin - data)) : nullptr;
+			if (levelBegin == nullptr || levelEnd == nullptr || levelBegin == data ||
+				size_t(levelEnd - data) + 2 > len) {
+				levelBegin = levelEnd = nullptr;
+			}
+
+			const char *msg = levelEnd != nullptr ? levelEnd + 2 : data;
+			size_t msgLen = len - size_t(msg - data);
+			if (format == eRecordFormat::jsonFormat) {
+				ss.To("{", 1);
+				if (levelBegin != nullptr) {
+					ss.To("\"ts\":\"", 6);
+					ss.To(data, size_t(levelBegin - 1 - data));
+					ss.To("\",\"level\":\"", 11);
+					ss.To(levelBegin + 1, size_t(levelEnd - levelBegin - 1));
+					ss.To("\",", 2);
+				}
+				ss.To("\"msg\":", 6);
+				appendString(ss, format, msg, msgLen);
+				ss.To("}\n", 2);
+			} else {
+				if (levelBegin != nullptr) {
+					ss.To("ts=\"", 4);
+					ss.To(data, size_t(levelBegin - 1 - data));
+					ss.To("\" level=", 8);
+					ss.To(levelBegin + 1, size_t(levelEnd - levelBegin - 1));
+					ss.To(" ", 1);
+				}
+				ss.To("msg=", 4);
+				appendString(ss, format, msg, msgLen);
+				ss.To("\n", 1);
+			}
+		}
+
+		// sink dispatcher: the shared batches and a drain thread per sink.
+		class SinkDispatcher final {
+		public:
+			explicit SinkDispatcher(KvRecordRenderer renderer) : m_renderer(std::move(renderer)) {}
+			~SinkDispatcher() {
+				this->stop();
+			}
+			SinkDispatcher(const SinkDispatcher &rhs) = delete;
+			SinkDispatcher& operator=(const SinkDispatcher &rhs) = delete;
+
+		public:
+			// addSink starts the sink's drain thread from the next batch.
+			void addSink(std::shared_ptr<LogSink> sink) {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				auto channel = std::make_unique<Channel>();
+				channel->sink = std::move(sink);
+				channel->cursor = m_nextSeq;
+				Channel *pChannel = channel.get();
+				channel->th = std::thread([this, pChannel]() { this->drain(*pChannel); });
+				m_channels.push_back(std::move(channel));
+			}
+
+			// minLevel returns the lowest level of all sinks.
+			eLogLevel minLevel() const {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				eLogLevel level = eLogLevel::allLevelSize;
+				for (auto &channel : m_channels) {
+					if (channel->sink->level() < level) {
+						level = channel->sink->level();
+					}
+				}
+				return level;
+			}
+
+			// dropped sums the batches dropped for the lagging sinks.
+			size_t dropped() const {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				size_t dropped = 0;
+				for (auto &channel : m_channels) {
+					dropped += channel->sink->dropped();
+				}
+				return dropped;
+			}
+
+			// pendingSize returns the bytes of the batches not drained by all sinks.
+			size_t pendingSize() const {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				return m_pendingSize;
+			}
+
+			// publish shares a batch of framed records with all sinks, it never blocks
+			// on a sink: the batches which the slowest sink has not drained beyond
+			// gSink_max_pending_size are dropped for it.
+			void publish(std::shared_ptr<const std::string> batch) {
+				if (batch == nullptr || batch->empty()) {
+					return;
+				}
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					if (m_channels.empty()) {
+						return;
+					}
+					m_pendingSize += batch->size();
+					m_batches.push_back(Batch{ m_nextSeq++, std::move(batch), {} });
+					while (m_pendingSize > gSink_max_pending_size && m_batches.size() > 1) {
+						m_pendingSize -= m_batches.front().data->size();
+						m_batches.pop_front();
+					}
+				}
+				m_cond.notify_all();
+			}
+
+			// stop drains the pending batches, then stops all threads.
+			void stop() {
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					if (m_quit) {
+						return;
+					}
+					m_quit = true;
+				}
+				m_cond.notify_all();
+				for (auto &channel : m_channels) {
+					if (channel->th.joinable()) {
+						channel->th.join();
+					}
+				}
+			}
+
+		private:
+			// a batch rendered in a format by the first sink of the format which
+			// drains it, framed as the batch, for the other sinks of the format.
+			struct Rendering {
+				std::once_flag once;
+				std::string data;
+			};
+			struct Batch {
+				uint64_t seq;
+				std::shared_ptr<const std::string> data;
+				// the json and logfmt renderings.
+				std::shared_ptr<Rendering> renderings[2];
+			};
+			struct Channel {
+				std::shared_ptr<LogSink> sink;
+				std::thread th;
+				uint64_t cursor{ 0 };
+			};
+
+			// drain runs in the sink's thread.
+			void drain(Channel &channel) {
+				placeLogThread("sink");
+				for (;;) {
+					std::shared_ptr<const std::string> data;
+					std::shared_ptr<Rendering> rendering;
+					{
+						std::unique_lock<std::mutex> lock(m_mutex);
+						m_cond.wait(lock, [&]() { return m_quit || channel.cursor < m_nextSeq; });
+						if (channel.cursor >= m_nextSeq) {
+							return;
+						}
+
+						// skipped batches as the sink lagged.
+						uint64_t front = m_batches.empty() ? m_nextSeq : m_batches.front().seq;
+						if (channel.cursor < front) {
+							channel.sink->addDropped(size_t(front - channel.cursor));
+							channel.cursor = front;
+						}
+						Batch &batch = m_batches[size_t(channel.cursor - front)];
+						data = batch.data;
+						eRecordFormat format = channel.sink->format();
+						if (format != eRecordFormat::textFormat) {
+							auto &shared = batch.renderings[int(format) - 1];
+							if (shared == nullptr) {
+								shared = std::make_shared<Rendering>();
+							}
+							rendering = shared;
+						}
+						++channel.cursor;
+						this->trim();
+					}
+					if (rendering != nullptr) {
+						std::call_once(rendering->once, [&]() {
+							this->render(*data, channel.sink->format(), rendering->data);
+						});
+						this->deliver(*channel.sink, rendering->data);
+					} else {
+						this->deliver(*channel.sink, *data);
+					}
+				}
+			}
+
+			// trim frees the batches drained by all sinks, m_mutex must be held.
+			void trim() {
+				uint64_t minCursor = m_nextSeq;
+				for (auto &channel : m_channels) {
+					if (channel->cursor < minCursor) {
+						minCursor = channel->cursor;
+					}
+				}
+				while (!m_batches.empty() && m_batches.front().seq < minCursor) {
+					m_pendingSize -= m_batches.front().data->size();
+					m_batches.pop_front();
+				}
+			}
+
+			// render renders all records of the batch in the json or logfmt format
+			// into out, framed as the batch.
+			void render(const std::string &batch, eRecordFormat format, std::string &out) {
+				out.reserve(batch.size() * 2);
+				forEachRecord(batch.data(), batch.size(), [&](const RecordHeader &header, const char *data) {
+					eLogLevel level = eLogLevel(header.level);
+					SStreamType ss;
+					if ((header.flags & gRecordFlag_kv) != 0) {
+						if (!m_renderer(ss, format, level, data, header.len)) {
+							return;
+						}
+					} else {
+						renderTextLine(ss, format, data, header.len);
+					}
+					RecordHeader rendered;
+					rendered.len = uint32_t(ss.len());
+					rendered.level = header.level;
+					out.append((const char*)&rendered, sizeof(rendered));
+					out.append(ss.str(), size_t(ss.len()));
+				});
+			}
+
+			// deliver writes the batch's records of the sink's level to the sink. a
+			// text sink gets the shared bytes as they are, the other formats get the
+			// batch's rendering(see render).
+			void deliver(LogSink &sink, const std::string &batch) {
+				eLogLevel minLevel = sink.level();
+				eRecordFormat format = sink.format();
+				forEachRecord(batch.data(), batch.size(), [&](const RecordHeader &header, const char *data) {
+					eLogLevel level = eLogLevel(header.level);
+					if (level < minLevel) {
+						return;
+					}
+					if ((header.flags & gRecordFlag_kv) != 0 && format == eRecordFormat::textFormat) {
+						SStreamType ss;
+						if (m_renderer(ss, format, level, data, header.len)) {
+							sink.write(level, ss.str(), size_t(ss.len()));
+						}
+					} else {
+						sink.write(level, data, header.len);
+					}
+				});
+				sink.flush();
+			}
+
+		private:
+			KvRecordRenderer m_renderer;
+			mutable std::mutex m_mutex;
+			std::condition_variable m_cond;
+			std::deque<Batch> m_batches;
+			uint64_t m_nextSeq{ 0 };
+			size_t m_pendingSize{ 0 };
+			bool m_quit{ false };
+			std::vector<std::unique_ptr<Channel>> m_channels;
+		};
+	}
+}
@@ -0,0 +1,343 @@
+#pragma once
+
+/*
+ * socket sink: ships the records to a local agent over udp, a unix datagram
+ * socket or a unix stream socket. lines are packed into large datagrams which
+ * go out with one sendmmsg per batch(stream chunks with one sendmsg), from the
+ * sink's drain thread, so producers never wait for the socket.
+ *
+ * the socket is non-blocking: what can not be sent stays in a bounded retry
+ * buffer, and what overflows it goes to the fallback sink(e.g. a rotating
+ * file), at the level of each line. an unreachable agent is reconnected with
+ * a backoff. posix only.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "log_sink.h"
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace anet {
+	namespace log {
+		// lines of a datagram, and the bytes kept for the retry.
+		static constexpr size_t gSocket_datagram_size = 60 * 1024;
+		static constexpr size_t gSocket_retry_size = 4 * 1024 * 1024;
+		// messages of one sendmmsg/sendmsg call.
+		static constexpr size_t gSocket_batch_count = 64;
+		// reconnect backoff.
+		static constexpr int gSocket_min_backoff_ms = 100;
+		static constexpr int gSocket_max_backoff_ms = 5000;
+
+		// socket kind of the agent.
+		enum class eSocketKind : int {
+			udpSocket = 0,      // "host:port"
+			unixDgramSocket,    // path
+			unixStreamSocket,   // path
+		};
+
+		class SocketSink : public LogSink {
+		public:
+			SocketSink(eSocketKind kind, const std::string &address,
+				std::shared_ptr<LogSink> fallback = nullptr,
+				eLogLevel level = eLogLevel::debugLevel, eRecordFormat format = eRecordFormat::textFormat,
+				size_t datagramSize = gSocket_datagram_size, size_t retrySize = gSocket_retry_size) :
+				LogSink(level, format), m_kind(kind), m_address(address), m_fallback(std::move(fallback)),
+				m_datagramSize(datagramSize > 0 ? datagramSize : gSocket_datagram_size),
+				m_retrySize(retrySize) {}
+			~SocketSink() override {
+				// the last try, then the rest goes to the fallback.
+				this->flush();
+				this->spill(0);
+				this->closeSocket();
+			}
+
+		public:
+			void write(eLogLevel level, const char *data, size_t len) override {
+				if (!m_current.data.empty() && m_current.data.size() + len > m_datagramSize) {
+					this->seal();
+				}
+				if (m_current.data.empty()) {
+					m_current.data.reserve(m_datagramSize);
+				}
+				if (m_current.runs.empty() || m_current.runs.back().level != level) {
+					m_current.runs.push_back(LevelRun{ m_current.data.size(), level });
+				}
+				m_current.data.append(data, len);
+			}
+
+			void flush() override {
+				this->seal();
+				this->send();
+				// while the agent is unreachable, all goes to the fallback.
+				this->spill(m_fd < 0 && m_fallback != nullptr ? 0 : m_retrySize);
+				if (m_fallback != nullptr) {
+					m_fallback->flush();
+				}
+			}
+
+			// bytes sent to the agent, and bytes handed to the fallback(or lost).
+			size_t sentBytes() const {
+				return m_sentBytes.load(std::memory_order_relaxed);
+			}
+			size_t spilledBytes() const {
+				return m_spilledBytes.load(std::memory_order_relaxed);
+			}
+
+		private:
+			// lines of a level from offset on, up to the next run.
+			struct LevelRun {
+				size_t offset;
+				eLogLevel level;
+			};
+			// a datagram(or a stream chunk) and the levels of its lines.
+			struct Chunk {
+				std::string data;
+				std::vector<LevelRun> runs;
+			};
+
+			// seal moves the current datagram to the retry buffer.
+			void seal() {
+				if (m_current.data.empty()) {
+					return;
+				}
+				m_pendingBytes += m_current.data.size();
+				m_pending.push_back(std::move(m_current));
+				m_current = Chunk();
+			}
+
+			// spill hands the oldest pending chunks beyond limit bytes to the fallback.
+			void spill(size_t limit) {
+				while (!m_pending.empty() && m_pendingBytes > limit) {
+					if (m_fallback == nullptr) {
+						this->addDropped(1);
+					}
+					this->spillFront();
+				}
+			}
+
+			// spillFront hands the unsent part of the front chunk to the fallback, a
+			// write per level run.
+			void spillFront() {
+				Chunk &chunk = m_pending.front();
+				if (m_fallback != nullptr) {
+					for (size_t i = 0; i < chunk.runs.size(); i++) {
+						size_t end = i + 1 < chunk.runs.size() ? chunk.runs[i + 1].offset : chunk.data.size();
+						size_t begin = chunk.runs[i].offset > m_sentOffset ? chunk.runs[i].offset : m_sentOffset;
+						if (begin < end) {
+							m_fallback->write(chunk.runs[i].level, chunk.data.data() + begin, end - begin);
+						}
+					}
+				}
+				size_t len = chunk.data.size() - m_sentOffset;
+				m_spilledBytes.fetch_add(len, std::memory_order_relaxed);
+				m_pendingBytes -= len;
+				m_sentOffset = 0;
+				m_pending.pop_front();
+			}
+
+        #if !defined(_WIN32)
+			// send sends the pending chunks until the socket would block.
+			void send() {
+				if (m_pending.empty() || !this->connectSocket()) {
+					return;
+				}
+
+				while (!m_pending.empty()) {
+					size_t count = m_pending.size() < gSocket_batch_count ? m_pending.size() : gSocket_batch_count;
+					struct iovec iov[gSocket_batch_count];
+					for (size_t i = 0; i < count; i++) {
+						size_t offset = i == 0 ? m_sentOffset : 0;
+						iov[i].iov_base = &m_pending[i].data[offset];
+						iov[i].iov_len = m_pending[i].data.size() - offset;
+					}
+
+					if (m_kind == eSocketKind::unixStreamSocket) {
+						// a stream write of all chunks, which may be partial.
+						struct msghdr msg;
+						memset(&msg, 0, sizeof(msg));
+						msg.msg_iov = iov;
+						msg.msg_iovlen = count;
+						ssize_t n = ::sendmsg(m_fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+						if (n < 0) {
+							this->onError(errno);
+							return;
+						}
+						this->consume(size_t(n));
+						if (size_t(n) < this->bytesOf(iov, count)) {
+							return;
+						}
+					} else {
+						// a datagram per chunk.
+						struct mmsghdr msgs[gSocket_batch_count];
+						memset(msgs, 0, sizeof(msgs[0]) * count);
+						for (size_t i = 0; i < count; i++) {
+							msgs[i].msg_hdr.msg_iov = &iov[i];
+							msgs[i].msg_hdr.msg_iovlen = 1;
+						}
+						int n = ::sendmmsg(m_fd, msgs, unsigned(count), MSG_DONTWAIT);
+						if (n < 0) {
+							if (errno == EMSGSIZE) {
+								// never fits a datagram.
+								this->spillFront();
+								continue;
+							}
+							this->onError(errno);
+							return;
+						}
+						for (int i = 0; i < n; i++) {
+							this->consume(m_pending.front().data.size() - m_sentOffset);
+						}
+						if (size_t(n) < count) {
+							return;
+						}
+					}
+				}
+			}
+
+			static size_t bytesOf(const struct iovec *iov, size_t count) {
+				size_t bytes = 0;
+				for (size_t i = 0; i < count; i++) {
+					bytes += iov[i].iov_len;
+				}
+				return bytes;
+			}
+
+			// consume drops sent bytes from the head of the pending chunks.
+			void consume(size_t bytes) {
+				m_sentBytes.fetch_add(bytes, std::memory_order_relaxed);
+				m_pendingBytes -= bytes;
+				while (bytes > 0 && !m_pending.empty()) {
+					size_t left = m_pending.front().data.size() - m_sentOffset;
+					if (bytes < left) {
+						m_sentOffset += bytes;
+						return;
+					}
+					bytes -= left;
+					m_sentOffset = 0;
+					m_pending.pop_front();
+				}
+			}
+
+			// onError keeps the chunks if the socket is just full, or reconnects later.
+			void onError(int error) {
+				if (error == EAGAIN || error == EWOULDBLOCK || error == ENOBUFS || error == EINTR) {
+					return;
+				}
+				this->closeSocket();
+				// a partly sent line can not be resumed on a new connection, skip it.
+				if (m_sentOffset > 0) {
+					std::string &chunk = m_pending.front().data;
+					size_t pos = chunk.find('\n', m_sentOffset);
+					size_t cut = pos == std::string::npos ? chunk.size() : pos + 1;
+					m_spilledBytes.fetch_add(cut - m_sentOffset, std::memory_order_relaxed);
+					m_pendingBytes -= cut - m_sentOffset;
+					m_sentOffset = cut;
+					if (cut == chunk.size()) {
+						m_sentOffset = 0;
+						m_pending.pop_front();
+					}
+				}
+			}
+
+			// connectSocket connects if it is not connected and the backoff is over.
+			bool connectSocket() {
+				if (m_fd >= 0) {
+					return true;
+				}
+				auto now = std::chrono::steady_clock::now();
+				if (now < m_retryAt) {
+					return false;
+				}
+
+				int fd = -1;
+				if (m_kind == eSocketKind::udpSocket) {
+					auto pos = m_address.rfind(':');
+					struct addrinfo hints, *result = nullptr;
+					memset(&hints, 0, sizeof(hints));
+					hints.ai_family = AF_UNSPEC;
+					hints.ai_socktype = SOCK_DGRAM;
+					if (pos != std::string::npos && getaddrinfo(m_address.substr(0, pos).c_str(),
+						m_address.c_str() + pos + 1, &hints, &result) == 0) {
+						fd = ::socket(result->ai_family, SOCK_DGRAM, 0);
+						if (fd >= 0 && ::connect(fd, result->ai_addr, result->ai_addrlen) != 0) {
+							::close(fd);
+							fd = -1;
+						}
+						freeaddrinfo(result);
+					}
+				} else {
+					struct sockaddr_un addr;
+					memset(&addr, 0, sizeof(addr));
+					addr.sun_family = AF_UNIX;
+					strncpy(addr.sun_path, m_address.c_str(), sizeof(addr.sun_path) - 1);
+					fd = ::socket(AF_UNIX, m_kind == eSocketKind::unixStreamSocket ? SOCK_STREAM : SOCK_DGRAM, 0);
+					if (fd >= 0 && ::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+						::close(fd);
+						fd = -1;
+					}
+				}
+
+				if (fd < 0) {
+					m_backoffMs = m_backoffMs == 0 ? gSocket_min_backoff_ms :
+						(m_backoffMs * 2 < gSocket_max_backoff_ms ? m_backoffMs * 2 : gSocket_max_backoff_ms);
+					m_retryAt = now + std::chrono::milliseconds(m_backoffMs);
+					return false;
+				}
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+				int sendBuf = int(m_retrySize > 0 ? m_retrySize : gSocket_retry_size);
+				setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sendBuf, sizeof(sendBuf));
+				m_fd = fd;
+				m_backoffMs = 0;
+				return true;
+			}
+
+			void closeSocket() {
+				if (m_fd >= 0) {
+					::close(m_fd);
+					m_fd = -1;
+				}
+			}
+        #else
+			void send() {}
+			void closeSocket() {}
+        #endif
+
+		private:
+			eSocketKind m_kind;
+			std::string m_address;
+			std::shared_ptr<LogSink> m_fallback;
+			size_t m_datagramSize;
+			size_t m_retrySize;
+
+			// the datagram being packed, and the sealed ones not sent yet.
+			Chunk m_current;
+			std::deque<Chunk> m_pending;
+			size_t m_pendingBytes{ 0 };
+			// sent bytes of the front chunk(stream only).
+			size_t m_sentOffset{ 0 };
+
+			int m_fd{ -1 };
+			int m_backoffMs{ 0 };
+			std::chrono::steady_clock::time_point m_retryAt;
+
+			// read by any thread.
+			std::atomic<size_t> m_sentBytes{ 0 };
+			std::atomic<size_t> m_spilledBytes{ 0 };
+		};
+	}
+}
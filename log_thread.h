@@ -0,0 +1,178 @@
+#pragma once
+
+/*
+ * placement of the log's own threads: the writer, the sinks' drains, the
+ * rotation helper and the compressor. a thread places itself when it starts
+ * (and the writer again when the placement changes): its cpu set, scheduling
+ * policy, nice value, and a name for top(<prefix>-writer, -sink, ...).
+ *
+ * numaNodeCpus gives the cpus of a node, to keep the writer on its producers'
+ * node, where the queue's buffers are(they are grown, so first touched, by the
+ * producers). linux only, elsewhere the threads are just left as they are.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace anet {
+	namespace log {
+		// the nice value which is not changed.
+		static constexpr int gThread_keep_nice = 100;
+
+		struct ThreadPlacement {
+			// cpus to run on, left as they are if it is empty.
+			std::vector<int> cpus;
+			// SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO or SCHED_RR, -1 to
+			// keep it, and the priority of the real time policies.
+			int policy{ -1 };
+			int priority{ 0 };
+			// nice value of the thread, gThread_keep_nice to keep it.
+			int nice{ gThread_keep_nice };
+			// thread names are <prefix>-<role>, cut to 15 chars.
+			std::string namePrefix{ "alog" };
+		};
+
+		// parseCpuList parses a cpu list as "0-3,8,10-11".
+		inline std::vector<int> parseCpuList(const std::string &list) {
+			std::vector<int> cpus;
+			const char *p = list.c_str();
+			while (*p != 0) {
+				char *end = nullptr;
+				long first = strtol(p, &end, 10);
+				if (end == p) {
+					break;
+				}
+				long last = first;
+				p = end;
+				if (*p == '-') {
+					last = strtol(p + 1, &end, 10);
+					p = end;
+				}
+				for (long cpu = first; cpu <= last; cpu++) {
+					cpus.push_back(int(cpu));
+				}
+				while (*p == ',' || *p == '\n' || *p == ' ') {
+					++p;
+				}
+			}
+			return cpus;
+		}
+
+		// numaNodeCpus returns the cpus of a numa node, empty if it is not known.
+		inline std::vector<int> numaNodeCpus(int node) {
+			char path[128];
+			std::snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+			FILE *file = fopen(path, "r");
+			if (file == nullptr) {
+				return {};
+			}
+			char line[1024] = { 0 };
+			bool read = fgets(line, sizeof(line), file) != nullptr;
+			fclose(file);
+			return read ? parseCpuList(line) : std::vector<int>();
+		}
+
+		// placeCurrentThread applies a placement to the calling thread, named
+		// <prefix>-<role>. returns false if a setting is refused(e.g. a real time
+		// policy without the privilege), the others are applied still.
+		inline bool placeCurrentThread(const ThreadPlacement &placement, const char *role) {
+			bool ok = true;
+        #if defined(__linux__)
+			if (!placement.namePrefix.empty() && role != nullptr) {
+				std::string name = placement.namePrefix + "-" + role;
+				name.resize(name.size() < 15 ? name.size() : 15);
+				pthread_setname_np(pthread_self(), name.c_str());
+			}
+			if (!placement.cpus.empty()) {
+				cpu_set_t set;
+				CPU_ZERO(&set);
+				for (int cpu : placement.cpus) {
+					if (cpu >= 0 && cpu < CPU_SETSIZE) {
+						CPU_SET(cpu, &set);
+					}
+				}
+				ok = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 && ok;
+			}
+			if (placement.policy >= 0) {
+				sched_param param{};
+				param.sched_priority = placement.policy == SCHED_FIFO || placement.policy == SCHED_RR ?
+					placement.priority : 0;
+				ok = pthread_setschedparam(pthread_self(), placement.policy, &param) == 0 && ok;
+			}
+			if (placement.nice != gThread_keep_nice) {
+				// the nice value is per thread on linux.
+				ok = setpriority(PRIO_PROCESS, id_t(syscall(SYS_gettid)), placement.nice) == 0 && ok;
+			}
+        #else
+			(void)placement;
+			(void)role;
+        #endif
+			return ok;
+		}
+
+		// the placement of the log's threads, and its generation.
+		class LogThreadPlacement final {
+		public:
+			static LogThreadPlacement& instance() {
+				static LogThreadPlacement placement;
+				return placement;
+			}
+
+			void set(const ThreadPlacement &placement) {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				m_placement = placement;
+				++m_generation;
+			}
+			ThreadPlacement get() const {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				return m_placement;
+			}
+			uint64_t generation() const {
+				return m_generation.load(std::memory_order_relaxed);
+			}
+
+		private:
+			LogThreadPlacement() = default;
+
+		private:
+			mutable std::mutex m_mutex;
+			ThreadPlacement m_placement;
+			std::atomic<uint64_t> m_generation{ 0 };
+		};
+
+		// placeLogThread places the calling log thread by the placement of the log's
+		// threads, if it changed since the generation seen, which it updates.
+		inline bool placeLogThread(const char *role, uint64_t &seen) {
+			auto &placement = LogThreadPlacement::instance();
+			uint64_t generation = placement.generation();
+			if (generation == seen) {
+				return true;
+			}
+			seen = generation;
+			return placeCurrentThread(placement.get(), role);
+		}
+		inline bool placeLogThread(const char *role) {
+			uint64_t seen = ~uint64_t(0);
+			return placeLogThread(role, seen);
+		}
+
+		// setLogThreadPlacement places the log's threads: those started later, and
+		// the running writers at their next wake-up.
+		inline void setLogThreadPlacement(const ThreadPlacement &placement) {
+			LogThreadPlacement::instance().set(placement);
+		}
+	}
+}
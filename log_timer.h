@@ -0,0 +1,208 @@
+#pragma once
+
+/*
+ * scope timers: LOG_SCOPE_TIMER(name, thresholdUs) times the rest of its scope
+ * with the tsc(see siteTicks), and logs a line only when the scope took longer
+ * than the threshold. LOG_SCOPE_TIMER_STATS also aggregates the durations of
+ * its site(count, min, avg, max and a histogram for the p99), which the writer
+ * thread logs as one summary line of all sites every report interval(see
+ * aLog::enableScopeTimerReport), and resets.
+ *
+ * the histogram has 8 sub-buckets per power of two of ns, so the percentiles
+ * are within 12.5%. a site's stats are shared by its threads(relaxed atomics).
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "log_profile.h"
+
+namespace anet {
+	namespace log {
+		// sub-buckets per power of two, and the buckets of all uint64 values.
+		static constexpr int gTimer_sub_bits = 3;
+		static constexpr int gTimer_buckets = 64 << gTimer_sub_bits;
+
+		// tscNsPerTick returns the ns of a tick of siteTicks, measured once over
+		// 200us. initLog and enableScopeTimerReport measure it up front, so the
+		// first timed scope does not wait for it.
+		inline double tscNsPerTick() {
+			static const double nsPerTick = []() {
+				uint64_t startNs = metricsNow(), startTicks = siteTicks();
+				while (metricsNow() - startNs < 200000) {
+				}
+				uint64_t ticks = siteTicks() - startTicks;
+				return ticks > 0 ? double(metricsNow() - startNs) / double(ticks) : 1.0;
+			}();
+			return nsPerTick;
+		}
+
+		inline int timerBucket(uint64_t ns) {
+			if (ns < (uint64_t(1) << gTimer_sub_bits)) {
+				return int(ns);
+			}
+        #if defined(__GNUC__) || defined(__clang__)
+			int msb = 63 - __builtin_clzll(ns);
+        #else
+			int msb = 0;
+			for (uint64_t v = ns; v > 1; v >>= 1) {
+				++msb;
+			}
+        #endif
+			int sub = int(ns >> (msb - gTimer_sub_bits)) & ((1 << gTimer_sub_bits) - 1);
+			return ((msb - gTimer_sub_bits + 1) << gTimer_sub_bits) + sub;
+		}
+		// timerBucketUpper returns the largest ns of a bucket.
+		inline uint64_t timerBucketUpper(int bucket) {
+			if (bucket < (1 << gTimer_sub_bits)) {
+				return uint64_t(bucket);
+			}
+			int shift = (bucket >> gTimer_sub_bits) - 1;
+			uint64_t sub = uint64_t(bucket & ((1 << gTimer_sub_bits) - 1));
+			return (((uint64_t(1) << gTimer_sub_bits) + sub + 1) << shift) - 1;
+		}
+
+		// a site of a scope timer, a static of the macro's expansion.
+		class ScopeTimerSite final {
+		public:
+			ScopeTimerSite(const char *name, const char *file, const char *func, int line,
+				long long thresholdUs, bool stats);
+			ScopeTimerSite(const ScopeTimerSite &rhs) = delete;
+			ScopeTimerSite& operator=(const ScopeTimerSite &rhs) = delete;
+
+			// the stats of an interval.
+			struct Stats {
+				uint64_t count{ 0 };
+				uint64_t sumNs{ 0 };
+				uint64_t minNs{ 0 };
+				uint64_t maxNs{ 0 };
+				uint64_t p99Ns{ 0 };
+			};
+
+		public:
+			// over returns whether a duration of ticks passes the threshold.
+			inline bool over(uint64_t ticks) const {
+				return m_thresholdTicks != 0 && ticks > m_thresholdTicks;
+			}
+			inline bool stats() const {
+				return m_stats;
+			}
+
+			void observe(uint64_t ns) {
+				m_count.fetch_add(1, std::memory_order_relaxed);
+				m_sumNs.fetch_add(ns, std::memory_order_relaxed);
+				m_buckets[timerBucket(ns)].fetch_add(1, std::memory_order_relaxed);
+				uint64_t min = m_minNs.load(std::memory_order_relaxed);
+				while (ns < min && !m_minNs.compare_exchange_weak(min, ns, std::memory_order_relaxed)) {
+				}
+				uint64_t max = m_maxNs.load(std::memory_order_relaxed);
+				while (ns > max && !m_maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+				}
+			}
+
+			// take returns the stats since the last take, and resets them.
+			Stats take() {
+				Stats stats;
+				stats.count = m_count.exchange(0, std::memory_order_relaxed);
+				stats.sumNs = m_sumNs.exchange(0, std::memory_order_relaxed);
+				stats.minNs = m_minNs.exchange(UINT64_MAX, std::memory_order_relaxed);
+				stats.maxNs = m_maxNs.exchange(0, std::memory_order_relaxed);
+				uint64_t counts[gTimer_buckets], total = 0;
+				for (int b = 0; b < gTimer_buckets; b++) {
+					counts[b] = m_buckets[b].exchange(0, std::memory_order_relaxed);
+					total += counts[b];
+				}
+				uint64_t rank = total > 0 ? uint64_t(0.99 * double(total - 1)) + 1 : 0, seen = 0;
+				for (int b = 0; b < gTimer_buckets && total > 0; b++) {
+					seen += counts[b];
+					if (seen >= rank) {
+						stats.p99Ns = std::min(timerBucketUpper(b), stats.maxNs);
+						break;
+					}
+				}
+				return stats;
+			}
+
+		public:
+			const char *name;
+			const char *file;
+			const char *func;
+			int line;
+			long long thresholdUs;
+
+		private:
+			uint64_t m_thresholdTicks{ 0 };
+			bool m_stats{ false };
+			std::atomic<uint64_t> m_count{ 0 };
+			std::atomic<uint64_t> m_sumNs{ 0 };
+			std::atomic<uint64_t> m_minNs{ UINT64_MAX };
+			std::atomic<uint64_t> m_maxNs{ 0 };
+			std::atomic<uint64_t> m_buckets[gTimer_buckets] = {};
+		};
+
+		// the sites which aggregate.
+		class ScopeTimerRegistry final {
+		public:
+			static ScopeTimerRegistry& instance() {
+				static ScopeTimerRegistry registry;
+				return registry;
+			}
+
+			void add(ScopeTimerSite *site) {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				m_sites.push_back(site);
+			}
+
+			// summary returns "name n <count> min <> avg <> p99 <> max <> us; ..." of the
+			// sites timed since the last summary, empty if none was.
+			std::string summary() {
+				std::lock_guard<std::mutex> guard(m_mutex);
+				std::string line;
+				for (ScopeTimerSite *site : m_sites) {
+					auto stats = site->take();
+					if (stats.count == 0) {
+						continue;
+					}
+					char buff[256];
+					int n = std::snprintf(buff, sizeof(buff), "%s%s n %llu min %.3f avg %.3f p99 %.3f max %.3f us",
+						line.empty() ? "" : "; ", site->name, (unsigned long long)stats.count,
+						double(stats.minNs) / 1e3, double(stats.sumNs) / double(stats.count) / 1e3,
+						double(stats.p99Ns) / 1e3, double(stats.maxNs) / 1e3);
+					if (n > 0) {
+						line.append(buff, size_t(n) < sizeof(buff) ? size_t(n) : sizeof(buff) - 1);
+					}
+				}
+				return line;
+			}
+
+		private:
+			ScopeTimerRegistry() {
+				ForkRegistry::instance().addLeaf(&m_mutex);
+			}
+			~ScopeTimerRegistry() {
+				ForkRegistry::instance().removeLeaf(&m_mutex);
+			}
+
+		private:
+			std::mutex m_mutex;
+			std::vector<ScopeTimerSite*> m_sites;
+		};
+
+		inline ScopeTimerSite::ScopeTimerSite(const char *name, const char *file, const char *func, int line,
+			long long thresholdUs, bool stats) : name(name), file(file), func(func), line(line),
+			thresholdUs(thresholdUs), m_stats(stats) {
+			if (thresholdUs > 0) {
+				m_thresholdTicks = uint64_t(double(thresholdUs) * 1e3 / tscNsPerTick());
+				m_thresholdTicks = m_thresholdTicks > 0 ? m_thresholdTicks : 1;
+			}
+			if (stats) {
+				ScopeTimerRegistry::instance().add(this);
+			}
+		}
+	}
+}
@@ -0,0 +1,392 @@
+#pragma once
+
+/*
+ * shared memory transport: each producer process owns a ring(shm_open object
+ * "/alog.<name>.<pid>") which its writer fills with framed records(see
+ * log_record.h), and one collector process drains all rings of the name and
+ * does the batched writes, compression and rotation(see alog_collector.cpp).
+ *
+ * the ring is single producer(the writer holds the file lock) and single
+ * consumer. records are not split: a pad record(or less than a header of room)
+ * skips to the wrap. the collector beats a heartbeat in each ring, producers
+ * fall back to their local files when it stops. posix only.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include "log_record.h"
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace anet {
+	namespace log {
+		// default ring size of a producer.
+		static constexpr size_t gShm_ring_size = 8 * 1024 * 1024;
+		// the collector is taken as gone if its heartbeat is older than it.
+		static constexpr int64_t gShm_heartbeat_timeout_ms = 3000;
+		static constexpr uint32_t gShm_magic = 0x616c6f67; // "alog"
+		static constexpr uint32_t gShm_version = 1;
+
+		// monotonic ms, comparable across processes.
+		inline int64_t monotonicMs() {
+        #if !defined(_WIN32)
+			struct timespec ts;
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			return int64_t(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+        #else
+			return 0;
+        #endif
+		}
+
+		// ring header at the head of the shared memory, followed by capacity bytes.
+		struct ShmRingHeader {
+			std::atomic<uint32_t> magic;
+			uint32_t version;
+			uint64_t capacity;
+			int32_t pid;
+			std::atomic<uint32_t> closed;
+			std::atomic<uint64_t> dropped;
+			// producer's write position and consumer's read position(monotonic).
+			alignas(64) std::atomic<uint64_t> head;
+			alignas(64) std::atomic<uint64_t> tail;
+			// collector's last beat.
+			alignas(64) std::atomic<int64_t> heartbeat;
+		};
+
+		// the shared ring, mapped by the producer or the collector.
+		class ShmRing final {
+		public:
+			~ShmRing() {
+				this->unmap();
+			}
+			ShmRing(const ShmRing &rhs) = delete;
+			ShmRing& operator=(const ShmRing &rhs) = delete;
+
+			// the shm object name of a producer.
+			static std::string objectName(const std::string &name, int pid) {
+				return "/alog." + name + "." + std::to_string(pid);
+			}
+
+			// create creates the ring of this process, returns nullptr on failure.
+			static std::unique_ptr<ShmRing> create(const std::string &name, size_t capacity) {
+        #if !defined(_WIN32)
+				std::string object = objectName(name, int(getpid()));
+				int fd = shm_open(object.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+				if (fd < 0) {
+					return nullptr;
+				}
+				size_t size = sizeof(ShmRingHeader) + capacity;
+				void *p = ftruncate(fd, off_t(size)) == 0 ?
+					mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+				::close(fd);
+				if (p == MAP_FAILED) {
+					shm_unlink(object.c_str());
+					return nullptr;
+				}
+
+				std::unique_ptr<ShmRing> ring(new ShmRing(object, p, size));
+				ShmRingHeader *header = new (p) ShmRingHeader();
+				header->version = gShm_version;
+				header->capacity = capacity;
+				header->pid = int32_t(getpid());
+				header->closed.store(0);
+				header->dropped.store(0);
+				header->head.store(0);
+				header->tail.store(0);
+				header->heartbeat.store(INT64_MIN / 2);
+				// the magic is the last one, then the collector can attach it.
+				header->magic.store(gShm_magic, std::memory_order_release);
+				return ring;
+        #else
+				(void)name;
+				(void)capacity;
+				return nullptr;
+        #endif
+			}
+
+			// attach maps a producer's ring, returns nullptr if it is not ready.
+			static std::unique_ptr<ShmRing> attach(const std::string &object) {
+        #if !defined(_WIN32)
+				int fd = shm_open(object.c_str(), O_RDWR, 0600);
+				if (fd < 0) {
+					return nullptr;
+				}
+				struct stat st;
+				void *p = MAP_FAILED;
+				if (fstat(fd, &st) == 0 && size_t(st.st_size) > sizeof(ShmRingHeader)) {
+					p = mmap(nullptr, size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+				}
+				::close(fd);
+				if (p == MAP_FAILED) {
+					return nullptr;
+				}
+				std::unique_ptr<ShmRing> ring(new ShmRing(object, p, size_t(st.st_size)));
+				const ShmRingHeader *header = ring->m_header;
+				if (header->magic.load(std::memory_order_acquire) != gShm_magic ||
+					header->version != gShm_version ||
+					header->capacity + sizeof(ShmRingHeader) > size_t(st.st_size)) {
+					return nullptr;
+				}
+				return ring;
+        #else
+				(void)object;
+				return nullptr;
+        #endif
+			}
+
+		public:
+			/* ============================================================== */
+			// producer side.
+
+			// whether the collector beats.
+			bool collectorAlive() const {
+				return monotonicMs() - m_header->heartbeat.load(std::memory_order_relaxed) <
+					gShm_heartbeat_timeout_ms;
+			}
+
+			// push copies a record into the ring, returns false if it has no room.
+			bool push(eLogLevel level, const char *data, size_t len) {
+				const uint64_t capacity = m_header->capacity;
+				const size_t need = sizeof(RecordHeader) + len;
+				if (need > capacity / 2) {
+					return false;
+				}
+				uint64_t head = m_header->head.load(std::memory_order_relaxed);
+				uint64_t tail = m_header->tail.load(std::memory_order_acquire);
+
+				// skip to the wrap if the record does not fit before it.
+				size_t offset = size_t(head % capacity);
+				size_t contiguous = size_t(capacity) - offset;
+				size_t skip = contiguous < need ? contiguous : 0;
+				if (head + skip + need - tail > capacity) {
+					m_header->dropped.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				}
+				if (skip >= sizeof(RecordHeader)) {
+					RecordHeader pad;
+					pad.len = uint32_t(skip - sizeof(RecordHeader));
+					pad.flags = gRecordFlag_pad;
+					memcpy(m_data + offset, &pad, sizeof(pad));
+				}
+				head += skip;
+				offset = size_t(head % capacity);
+
+				RecordHeader header;
+				header.len = uint32_t(len);
+				header.level = uint8_t(level);
+				memcpy(m_data + offset, &header, sizeof(header));
+				memcpy(m_data + offset + sizeof(header), data, len);
+				m_header->head.store(head + need, std::memory_order_release);
+				return true;
+			}
+
+			// close tells the collector that no more records come, the collector
+			// removes the ring after draining it. without a collector it is removed now.
+			void close() {
+				m_header->closed.store(1, std::memory_order_release);
+				if (!this->collectorAlive()) {
+					this->unlink();
+				}
+			}
+
+			/* ============================================================== */
+			// collector side.
+
+			void beat() {
+				m_header->heartbeat.store(monotonicMs(), std::memory_order_relaxed);
+			}
+
+			// drain calls output(batch, len) with the contiguous runs of framed records,
+			// returns the drained bytes.
+			template <typename Output>
+			size_t drain(Output &&output) {
+				const uint64_t capacity = m_header->capacity;
+				uint64_t tail = m_header->tail.load(std::memory_order_relaxed);
+				uint64_t head = m_header->head.load(std::memory_order_acquire);
+				uint64_t begin = tail;
+				while (tail < head) {
+					size_t offset = size_t(tail % capacity);
+					size_t contiguous = size_t(capacity) - offset;
+
+					// a run of records up to the head or the wrap.
+					size_t run = 0;
+					bool wrap = false;
+					while (tail + run < head) {
+						if (contiguous - run < sizeof(RecordHeader)) {
+							wrap = true;
+							break;
+						}
+						RecordHeader header;
+						memcpy(&header, m_data + offset + run, sizeof(header));
+						if ((header.flags & gRecordFlag_pad) != 0) {
+							wrap = true;
+							break;
+						}
+						run += sizeof(header) + header.len;
+					}
+					if (run > 0) {
+						output((const char*)m_data + offset, run);
+					}
+					tail += run;
+					if (wrap) {
+						tail += contiguous - run;
+					}
+					m_header->tail.store(tail, std::memory_order_release);
+				}
+				return size_t(tail - begin);
+			}
+
+			// whether the producer is gone(closed or dead) and the ring is drained.
+			bool finished() const {
+				if (m_header->tail.load(std::memory_order_acquire) !=
+					m_header->head.load(std::memory_order_acquire)) {
+					return false;
+				}
+				if (m_header->closed.load(std::memory_order_acquire) != 0) {
+					return true;
+				}
+        #if !defined(_WIN32)
+				return kill(pid_t(m_header->pid), 0) != 0 && errno == ESRCH;
+        #else
+				return false;
+        #endif
+			}
+
+			// records dropped by the producer as the ring was full.
+			uint64_t dropped() const {
+				return m_header->dropped.load(std::memory_order_relaxed);
+			}
+			int pid() const {
+				return int(m_header->pid);
+			}
+			const std::string& object() const {
+				return m_object;
+			}
+
+			void unlink() {
+        #if !defined(_WIN32)
+				shm_unlink(m_object.c_str());
+        #endif
+			}
+
+		private:
+			ShmRing(const std::string &object, void *memory, size_t size) :
+				m_object(object), m_memory(memory), m_size(size),
+				m_header((ShmRingHeader*)memory), m_data((char*)memory + sizeof(ShmRingHeader)) {}
+
+			void unmap() {
+        #if !defined(_WIN32)
+				if (m_memory != nullptr) {
+					munmap(m_memory, m_size);
+					m_memory = nullptr;
+				}
+        #endif
+			}
+
+		private:
+			std::string m_object;
+			void *m_memory{ nullptr };
+			size_t m_size{ 0 };
+			ShmRingHeader *m_header{ nullptr };
+			char *m_data{ nullptr };
+		};
+
+		// listShmRings returns the shm objects of the name's producers.
+		inline std::vector<std::string> listShmRings(const std::string &name) {
+			std::vector<std::string> objects;
+        #if !defined(_WIN32)
+			// linux keeps the shm objects in /dev/shm.
+			std::string prefix = "alog." + name + ".";
+			DIR *dir = opendir("/dev/shm");
+			if (dir == nullptr) {
+				return objects;
+			}
+			while (struct dirent *entry = readdir(dir)) {
+				if (strncmp(entry->d_name, prefix.c_str(), prefix.size()) == 0) {
+					objects.push_back(std::string("/") + entry->d_name);
+				}
+			}
+			closedir(dir);
+        #else
+			(void)name;
+        #endif
+			return objects;
+		}
+
+		// collector side of all rings of a name: attaches the new producers' rings,
+		// beats, drains them and removes the finished ones.
+		class ShmCollector final {
+		public:
+			explicit ShmCollector(const std::string &name) : m_name(name) {}
+
+			// poll drains all rings once with output(batch, len), returns the bytes.
+			template <typename Output>
+			size_t poll(Output &&output) {
+				int64_t now = monotonicMs();
+				if (now - m_lastScan >= gShm_scan_ms) {
+					m_lastScan = now;
+					this->scan();
+				}
+
+				size_t bytes = 0;
+				for (size_t i = 0; i < m_rings.size();) {
+					ShmRing &ring = *m_rings[i];
+					ring.beat();
+					bytes += ring.drain(output);
+					if (ring.finished() && ring.drain(output) == 0) {
+						ring.unlink();
+						m_rings.erase(m_rings.begin() + long(i));
+					} else {
+						++i;
+					}
+				}
+				return bytes;
+			}
+
+			size_t ringCount() const {
+				return m_rings.size();
+			}
+
+		private:
+			// rescan period of the new rings.
+			static constexpr int64_t gShm_scan_ms = 200;
+
+			void scan() {
+				for (auto &object : listShmRings(m_name)) {
+					bool attached = false;
+					for (auto &ring : m_rings) {
+						attached = attached || ring->object() == object;
+					}
+					if (attached) {
+						continue;
+					}
+					auto ring = ShmRing::attach(object);
+					if (ring != nullptr) {
+						// beat at once, so the producer switches to the ring.
+						ring->beat();
+						m_rings.push_back(std::move(ring));
+					}
+				}
+			}
+
+		private:
+			std::string m_name;
+			std::vector<std::unique_ptr<ShmRing>> m_rings;
+			int64_t m_lastScan{ INT64_MIN / 2 };
+		};
+	}
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+/*
+ * number formatting kernels for the stream strings: integers, floating points
+ * and pointers are rendered straight into the caller's buffer without any
+ * allocation or locale lookup.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <type_traits>
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+
+namespace SStreamSpace {
+	// the max length of a rendered number.
+	constexpr int number_max_size = 32;
+
+	// "00" ~ "99" table, two digits a time.
+	static constexpr char gDigitsLut[201] =
+		"0001020304050607080910111213141516171819"
+		"2021222324252627282930313233343536373839"
+		"4041424344454647484950515253545556575859"
+		"6061626364656667686970717273747576777879"
+		"8081828384858687888990919293949596979899";
+
+	// formatUnsigned writes value to pBuf, returns the written size.
+	inline int formatUnsigned(char *pBuf, uint64_t value) {
+		char szTmp[number_max_size];
+		char *pEnd = szTmp + sizeof(szTmp);
+		char *p = pEnd;
+		while (value >= 100) {
+			auto index = size_t(value % 100) * 2;
+			value /= 100;
+			*--p = gDigitsLut[index + 1];
+			*--p = gDigitsLut[index];
+		}
+		if (value < 10) {
+			*--p = char('0' + value);
+		} else {
+			auto index = size_t(value) * 2;
+			*--p = gDigitsLut[index + 1];
+			*--p = gDigitsLut[index];
+		}
+		int n = int(pEnd - p);
+		memcpy(pBuf, p, size_t(n));
+		return n;
+	}
+
+	// formatSigned writes value to pBuf, returns the written size.
+	inline int formatSigned(char *pBuf, int64_t value) {
+		if (value < 0) {
+			*pBuf = '-';
+			// negate as unsigned to be safe for INT64_MIN.
+			return 1 + formatUnsigned(pBuf + 1, 0 - uint64_t(value));
+		}
+		return formatUnsigned(pBuf, uint64_t(value));
+	}
+
+	// formatDouble writes the shortest round-trip form of value to pBuf.
+	inline int formatDouble(char *pBuf, double value) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+		auto ret = std::to_chars(pBuf, pBuf + number_max_size, value);
+		if (ret.ec == std::errc()) {
+			return int(ret.ptr - pBuf);
+		}
+#endif
+		int n = std::snprintf(pBuf, number_max_size, "%.17g", value);
+		return n > 0 ? n : 0;
+	}
+	inline int formatFloat(char *pBuf, float value) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+		auto ret = std::to_chars(pBuf, pBuf + number_max_size, value);
+		if (ret.ec == std::errc()) {
+			return int(ret.ptr - pBuf);
+		}
+#endif
+		int n = std::snprintf(pBuf, number_max_size, "%.9g", double(value));
+		return n > 0 ? n : 0;
+	}
+
+	// formatHex writes value as lower case hex digits(no prefix) to pBuf.
+	inline int formatHex(char *pBuf, uint64_t value) {
+		static constexpr char hexDigits[] = "0123456789abcdef";
+		char szTmp[number_max_size];
+		char *pEnd = szTmp + sizeof(szTmp);
+		char *p = pEnd;
+		do {
+			*--p = hexDigits[value & 0xf];
+			value >>= 4;
+		} while (value != 0);
+		int n = int(pEnd - p);
+		memcpy(pBuf, p, size_t(n));
+		return n;
+	}
+
+	// formatPointer writes pointer as 0x... to pBuf, or "null".
+	inline int formatPointer(char *pBuf, const void *ptr) {
+		if (ptr == nullptr) {
+			memcpy(pBuf, "null", 4);
+			return 4;
+		}
+		pBuf[0] = '0';
+		pBuf[1] = 'x';
+		return 2 + formatHex(pBuf + 2, uint64_t(uintptr_t(ptr)));
+	}
+
+	// formatNumber renders all kinds of arithmetic values, it returns the written size.
+	// pBuf must have number_max_size bytes at least.
+	template <typename T>
+	inline int formatNumber(char *pBuf, T value) {
+		static_assert(std::is_arithmetic<T>::value, "not an arithmetic type");
+		if constexpr (std::is_same<T, float>::value) {
+			return formatFloat(pBuf, value);
+		} else if constexpr (std::is_floating_point<T>::value) {
+			return formatDouble(pBuf, double(value));
+		} else if constexpr (std::is_signed<T>::value) {
+			return formatSigned(pBuf, int64_t(value));
+		} else {
+			return formatUnsigned(pBuf, uint64_t(value));
+		}
+	}
+}
@@ -8,6 +8,10 @@
 #include "string.h"
 #include <assert.h>
 #include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include "stream_number.h"
 
 namespace SStreamSpace {
 	constexpr size_t default_buffer_init_size = 1024;
@@ -29,67 +33,51 @@ namespace SStreamSpace {
   #define myMin(a,b)            (((a) < (b)) ? (a) : (b))
 #endif
 
-	// grow size
-#define grow(nNeedSize, nDefaultGrowSize)    {             \
-	int nSize1 = Align(nNeedSize);                         \
-	int nSize2 = Align(nDefaultGrowSize);                  \
-	m_vecBuffer.resize(m_pos + myMax(nSize1, nSize2), 0);  \
-}
-
-	// size check
-#define sizeCheck(nNeedSize) {                                 \
-	if (int(m_pos + (nNeedSize)) >= int(m_vecBuffer.size())) { \
-		grow((nNeedSize)+1, default_buffer_grow_size);         \
-	}                                                          \
-}
-
-	// unlimited stream string object
+	// unlimited stream string object.
+	// the first SIZE bytes live inline(on the stack for local objects), and
+	// it only spills to the heap when a message overflows them. the buffer is
+	// never zero filled: just the byte after the written data is kept as 0.
 	template <size_t SIZE>
 	class StreamStringUnlimit {
 	public:
-		StreamStringUnlimit() : m_pos(0) {		
-			m_vecBuffer.resize(Align(SIZE), 0);
+		StreamStringUnlimit() : m_pos(0), m_cap(int(sizeof(m_szInline))), m_pBuf(m_szInline) {
+			m_szInline[0] = 0;
 		}
-		virtual ~StreamStringUnlimit() {
-			m_pos = 0;
+		~StreamStringUnlimit() {
+			this->freeHeap();
 		}
+		StreamStringUnlimit(const StreamStringUnlimit &rhs) = delete;
+		StreamStringUnlimit& operator=(const StreamStringUnlimit &rhs) = delete;
 
 	public:
 		bool empty() const {
-			return m_vecBuffer.empty();
+			return m_pos == 0;
 		}
 
+		// buffer capacity.
 		size_t length() const {
-			return m_vecBuffer.size();
+			return size_t(m_cap);
 		}
 
 		char operator [](size_t index) {
-			if (index >= m_vecBuffer.size()) {
+			if (index >= size_t(m_pos)) {
 				return 0;
 			}
-			return m_vecBuffer[index];
+			return m_pBuf[index];
 		}
 
 		// const char*
 		const char* str() const {
-			if (m_vecBuffer.empty()) {
-				return "";
-			} else {
-			    return &m_vecBuffer[0];
-			}
+			return m_pBuf;
 		}
 
 		std::string string() {
-			return  std::string(str());
+			return std::string(m_pBuf, size_t(m_pos));
 		}
 
 		// char* data
 		const char* data() {
-			if (m_vecBuffer.empty()) {
-				return "";
-			} else {
-			    return &m_vecBuffer[0];
-			}
+			return m_pBuf;
 		}
 
 		// len
@@ -97,10 +85,17 @@ namespace SStreamSpace {
 			return m_pos;
 		}
 
+		// whether the inline buffer has been overflowed.
+		bool spilled() const {
+			return m_pBuf != m_szInline;
+		}
+
 		void Reset() {
-			m_vecBuffer.clear();
-			m_vecBuffer.resize(Align(SIZE), 0);
+			this->freeHeap();
+			m_pBuf = m_szInline;
+			m_cap = int(sizeof(m_szInline));
 			m_pos = 0;
+			m_pBuf[0] = 0;
 		}
 
 		operator const char*() {
@@ -108,7 +103,20 @@ namespace SStreamSpace {
 		}
 
 		operator char*() {
-			return this->data();
+			return m_pBuf;
+		}
+
+		// prepare returns a writable area of at least nNeedSize bytes(plus the tail 0),
+		// commit it with the real written size. used for in place formatting.
+		char* prepare(int nNeedSize) {
+			this->sizeCheck(nNeedSize);
+			return m_pBuf + m_pos;
+		}
+		StreamStringUnlimit &commit(int nSize) {
+			assert(m_pos + nSize < m_cap);
+			m_pos += nSize;
+			m_pBuf[m_pos] = 0;
+			return *this;
 		}
         
 	public:
@@ -118,33 +126,21 @@ namespace SStreamSpace {
 			return *this;
 		}
 
-		// for all integer values as std::to_string();
+		// for all arithmetic values, rendered in place.
 		template<typename T>
 		StreamStringUnlimit &operator << (T data) {
-			auto &&value = std::to_string(data);
-			this->To(value.c_str(), value.length());
-			return *this;
+			if constexpr (std::is_arithmetic<T>::value) {
+				return this->commit(formatNumber(this->prepare(number_max_size), data));
+			} else {
+				auto &&value = std::to_string(data);
+				return this->To(value.c_str(), value.length());
+			}
 		}
 
 		// void*, just for pointer address.
 		template <typename T>
 		StreamStringUnlimit &operator << (T* pData) {
-			const T *pSrc = pData;
-			const char *pString = nullptr;
-			const char* format = "%p";
-			int size = sizeof(void*);
-			int flag = 0;
-			if (!pSrc) { // special for null if NULL pointer.
-				format = "%s";
-				pString = "null";
-				size = int(strlen(pString));
-				flag = 1;
-			}
-			sizeCheck(size);
-			std::sprintf(&m_vecBuffer[m_pos], format, (flag == 0? pData : pSrc));
-			m_pos += size;
-
-			return *this;
+			return this->commit(formatPointer(this->prepare(number_max_size), pData));
 		}
         
 		// all kinds of string values.
@@ -162,7 +158,7 @@ namespace SStreamSpace {
 		StreamStringUnlimit &operator << (char* szData) {
 			return this->To(szData, strlen(szData));
 		}
-		template <int N>
+		template <size_t N>
 		StreamStringUnlimit &operator << (const StreamStringUnlimit<N>& oData) {
 			return this->To(oData.str(), oData.len());
 		}
@@ -183,28 +179,73 @@ namespace SStreamSpace {
 		}
 
 		StreamStringUnlimit &AddZero() {
-			sizeCheck(2);
-			m_vecBuffer[m_pos++] = 0;
+			this->sizeCheck(1);
+			m_pBuf[m_pos++] = 0;
+			m_pBuf[m_pos] = 0;
 			return *this;
 		}
 
-		virtual StreamStringUnlimit &To(const char *data, size_t dateLen) {
+		StreamStringUnlimit &To(const char *data, size_t dateLen) {
 			// size check.
-			sizeCheck(int(dateLen));
+			this->sizeCheck(int(dateLen));
 
 			// just copy it
-			memcpy(&m_vecBuffer[m_pos], data, int(dateLen));
+			memcpy(m_pBuf + m_pos, data, dateLen);
 			m_pos += int(dateLen);
+			m_pBuf[m_pos] = 0;
 
 			return *this;
 		}
 
+	protected:
+		// size check: keep one more byte for the tail 0.
+		void sizeCheck(int nNeedSize) {
+			if (m_pos + nNeedSize >= m_cap) {
+				this->grow(nNeedSize + 1);
+			}
+		}
+
+		// grow size, at least doubles the capacity. throws std::bad_alloc as the
+		// std::vector buffer did, the buffer is kept as it is then.
+		void grow(int nNeedSize) {
+			int nSize1 = Align(m_pos + nNeedSize);
+			int nSize2 = Align(m_cap + myMax(m_cap, int(default_buffer_grow_size)));
+			int nNewCap = myMax(nSize1, nSize2);
+			if (this->spilled()) {
+				char *pNew = (char*)realloc(m_pBuf, size_t(nNewCap));
+				if (pNew == nullptr) {
+					throw std::bad_alloc();
+				}
+				m_pBuf = pNew;
+			} else {
+				char *pNew = (char*)malloc(size_t(nNewCap));
+				if (pNew == nullptr) {
+					throw std::bad_alloc();
+				}
+				memcpy(pNew, m_szInline, size_t(m_pos + 1));
+				m_pBuf = pNew;
+			}
+			m_cap = nNewCap;
+		}
+
+		void freeHeap() {
+			if (this->spilled()) {
+				free(m_pBuf);
+			}
+		}
+
 	protected:
 		// write index.
 		int m_pos;
 
-		// buffer.
-		std::vector<char> m_vecBuffer;
+		// buffer capacity.
+		int m_cap;
+
+		// buffer, points to m_szInline or heap memory.
+		char *m_pBuf;
+
+		// inline buffer.
+		char m_szInline[SIZE > 0 ? SIZE : 1];
 	};
 
 	// stream string with out buffer.
@@ -275,9 +316,13 @@ namespace SStreamSpace {
 		// as integer data
 		template<typename T>
 		StreamStringex &operator << (T nData) {
-			auto strValue = std::to_string(nData);
-			this->To(strValue.c_str(), strValue.length());
-			return *this;
+			if constexpr (std::is_arithmetic<T>::value) {
+				char szValue[number_max_size];
+				return this->To(szValue, size_t(formatNumber(szValue, nData)));
+			} else {
+				auto strValue = std::to_string(nData);
+				return this->To(strValue.c_str(), strValue.length());
+			}
 		}
 
 		template<int N>
@@ -410,9 +455,13 @@ namespace SStreamSpace {
 		// as integer data
 		template <typename T>
 		StreamString &operator << (T nData) {
-			auto &&strValue = std::string(nData);
-			this->To(strValue.c_str(), strValue.length());
-			return *this;
+			if constexpr (std::is_arithmetic<T>::value) {
+				char szValue[number_max_size];
+				return this->To(szValue, size_t(formatNumber(szValue, nData)));
+			} else {
+				auto &&strValue = std::string(nData);
+				return this->To(strValue.c_str(), strValue.length());
+			}
 		}
 
 		template <int N>
@@ -488,8 +537,6 @@ namespace SStreamSpace {
 	// fix size stream string.
 	typedef StreamString<1024> limit_streamstring;
 
-#undef grow
-#undef sizeCheck
 #undef myMax
 #undef myMin
 }
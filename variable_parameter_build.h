@@ -7,66 +7,143 @@
 #include <vector>
 #include <string>
 #include "stream_string.h"
+#include "format_spec.h"
+#include "hex_dump.h"
 
 namespace anet {
 	namespace log {
 		// user can use delim as parameter flag.
-		static const char *DELIM = "{}";
+		static constexpr const char *DELIM = "{}";
 		static constexpr int string_max_size = 1024;
 		using SStreamType = SStreamSpace::StreamStringUnlimit<string_max_size>;
 
-		// split function.
-		static void split(const char *pData, const std::string &delim, std::vector<std::string> &vec) {
-			if (!pData) { return; }
-			const char *next = strstr(pData, delim.c_str());
-			if (next) {
-				vec.push_back(std::string(pData, next - pData));
-				// whether it is over.
-				const char *pNext = next + delim.size();
-				if (pNext < (pData + strlen(pData))) {
-					split(pNext, delim, vec);
+		// one parsed placeholder: the literal text before it and its spec.
+		struct FormatSegment {
+			const char *literal{ nullptr };
+			size_t literalLen{ 0 };
+			FormatSpec spec{};
+		};
+
+		// format string parsed at compile time, where N is its placeholder count.
+		// use ALOG_FORMAT(fmt) to build it from a literal.
+		template <size_t N>
+		struct CompiledFormat {
+			constexpr explicit CompiledFormat(const char *format) {
+				const char *p = format;
+				for (size_t i = 0; i < N; i++) {
+					const char *after = nullptr;
+					const char *pos = findPlaceholder(p, segments[i].spec, after);
+					segments[i].literal = p;
+					segments[i].literalLen = size_t(pos - p);
+					p = after;
+				}
+				const char *end = p;
+				while (*end != 0) {
+					++end;
 				}
-			} else {
-				vec.push_back(pData);
+				tail = p;
+				tailLen = size_t(end - p);
 			}
-		}
+
+			FormatSegment segments[N > 0 ? N : 1]{};
+			const char *tail{ nullptr };
+			size_t tailLen{ 0 };
+		};
+
+        // build a compile time parsed format from a string literal.
+        #define ALOG_FORMAT(fmt) \
+            anet::log::CompiledFormat<anet::log::countPlaceholders(fmt)>(fmt)
 
 		/* ============================================================== */
-		// recurse call back.
-		static void _sm_log_output(SStreamType &ss, const std::vector<std::string>& format, 
-			size_t& index) {
-			(void)ss;
-			(void)index;
-			(void)format;
+		// runtime cursor, parses the format as the arguments are rendered.
+		class FormatCursor {
+		public:
+			explicit FormatCursor(const char *format) : m_pos(format ? format : "") {}
+
+			// write the literal text before the next placeholder,
+			// returns the placeholder's spec, or nullptr if there is none.
+			template <typename Stream>
+			const FormatSpec* next(Stream &ss) {
+				const char *after = nullptr;
+				const char *pos = findPlaceholder(m_pos, m_spec, after);
+				ss.To(m_pos, size_t(pos - m_pos));
+				m_pos = after;
+				return *pos != 0 ? &m_spec : nullptr;
+			}
+
+			// write the rest literal text, placeholders without arguments are dropped.
+			template <typename Stream>
+			void finish(Stream &ss) {
+				while (*m_pos != 0) {
+					this->next(ss);
+				}
+			}
+
+		private:
+			const char *m_pos;
+			FormatSpec m_spec;
+		};
+
+		// compiled cursor, just walks the parsed segments.
+		template <size_t N>
+		class CompiledFormatCursor {
+		public:
+			explicit CompiledFormatCursor(const CompiledFormat<N> &format) : m_format(format) {}
+
+			template <typename Stream>
+			const FormatSpec* next(Stream &ss) {
+				if (m_index >= N) {
+					return nullptr;
+				}
+				const FormatSegment &segment = m_format.segments[m_index++];
+				ss.To(segment.literal, segment.literalLen);
+				return &segment.spec;
+			}
+
+			template <typename Stream>
+			void finish(Stream &ss) {
+				for (; m_index < N; ++m_index) {
+					const FormatSegment &segment = m_format.segments[m_index];
+					ss.To(segment.literal, segment.literalLen);
+				}
+				ss.To(m_format.tail, m_format.tailLen);
+			}
+
+		private:
+			const CompiledFormat<N> &m_format;
+			size_t m_index{ 0 };
+		};
+
+		inline FormatCursor makeFormatCursor(const char *format) {
+			return FormatCursor(format);
+		}
+		template <size_t N>
+		inline CompiledFormatCursor<N> makeFormatCursor(const CompiledFormat<N> &format) {
+			return CompiledFormatCursor<N>(format);
 		}
 
-		template<typename T, typename... Args>
-		static void _sm_log_output(SStreamType &ss, const std::vector<std::string>& format, 
-			size_t& index, const T& first, Args&&... rest
-		) {
-			if (index < format.size()) {
-				ss << format[index];
-				ss << first;
-				_sm_log_output(ss, format, ++index, std::forward<Args>(rest)...);
+		// render one argument to the next placeholder, extra arguments are dropped.
+		template <typename Stream, typename Cursor, typename T>
+		inline void _sm_log_output(Stream &ss, Cursor &cursor, const T &arg) {
+			const FormatSpec *spec = cursor.next(ss);
+			if (spec != nullptr) {
+				formatArg(ss, *spec, arg);
 			}
 		}
 
 		// global function declare: variable_log.
-		template<typename... Args>
-		inline void variable_log(SStreamType &ss, const char* format, Args&&... args) {
-			std::vector<std::string> vec;
-			vec.reserve(8);
-			split(format, DELIM, vec);
+		// format is a const char* or a CompiledFormat, and no memory is allocated
+		// unless the message overflows ss's inline buffer.
+		template<typename Stream, typename Format, typename... Args>
+		inline void variable_log(Stream &ss, const Format &format, Args&&... args) {
+			auto cursor = makeFormatCursor(format);
 
 			// variadic parameter format.
-			size_t index = 0;
-			_sm_log_output(ss, vec, index, std::forward<Args>(args)...);
+			(_sm_log_output(ss, cursor, args), ...);
 
 			// after dealer.
-			for (; index < vec.size(); ++index) {
-				ss << vec[index];
-			}
+			cursor.finish(ss);
 		}
 		/*===============================================================*/
 	}
-}
\ No newline at end of file
+}